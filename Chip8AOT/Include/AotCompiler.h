@@ -0,0 +1,62 @@
+#pragma once
+
+#include <map>
+#include <set>
+
+#include "Core/Emulator.h"
+#include "Core/Interpreter.h"
+
+// Statically recompiles a ROM into a C++ translation unit that runs it natively, working on the Emulator's state directly.
+// Code is found by walking every path reachable from 0x200, and split into blocks at every address control can arrive at
+// from somewhere other than the previous instruction. Blocks jump straight to each other with goto; anything that can't be
+// resolved ahead of time (computed jumps, returns, code outside the ROM, code that has since been overwritten) goes back
+// through a dispatcher, which interprets instructions until it reaches a compiled block again.
+class AotCompiler
+{
+public:
+	AotCompiler(CompatibilityMode mode, std::vector<uint8_t> rom, std::string name);
+
+	// Walks the ROM and writes the translation unit. Returns false if there was nothing to compile.
+	bool Generate(std::ostream& out);
+
+	[[nodiscard]] FORCEINLINE size_t GetInstructionCount() const { return m_Instructions.size(); }
+	[[nodiscard]] FORCEINLINE size_t GetBlockCount() const { return m_Leaders.size(); }
+
+protected:
+	// How control leaves an instruction
+	enum class Flow
+	{
+		Next,    // Falls through to the next instruction
+		Jump,    // 1NNN
+		Call,    // 2NNN
+		Skip,    // Conditionally skips the next instruction
+		Store,   // Writes to memory, which might be code, so the next instruction has to be checked before running it
+		Dynamic, // Target only known at runtime: BNNN, 00EE, FX0A
+		Stop     // Stops the emulator: 00FD, invalid opcodes
+	};
+
+	struct Instruction
+	{
+		DecodedInstruction Decoded;
+		Flow ControlFlow;
+	};
+
+	void Walk();
+	[[nodiscard]] Flow GetFlow(const DecodedInstruction& instruction) const;
+	[[nodiscard]] bool IsInRom(uint32_t address) const;
+	[[nodiscard]] bool IsLeader(uint32_t address) const;
+
+	void EmitBlock(std::ostream& out, uint16_t start) const;
+	// Native code for instructions that don't touch control flow. Returns false if the interpreter has to run it.
+	[[nodiscard]] bool EmitNative(std::ostream& out, const DecodedInstruction& instruction) const;
+	void EmitFallback(std::ostream& out, uint16_t address, const DecodedInstruction& instruction) const;
+	void EmitSuccessor(std::ostream& out, uint32_t target, const char* indent) const;
+
+	CompatibilityMode m_Mode;
+	uint32_t m_Quirks;
+	std::vector<uint8_t> m_Rom;
+	std::string m_Name;
+
+	std::map<uint16_t, Instruction> m_Instructions; // Every reachable instruction, by address
+	std::set<uint16_t> m_Leaders; // Addresses that start a block
+};
@@ -0,0 +1,360 @@
+#include "c8pch.h"
+#include "AotCompiler.h"
+
+#include "Core/Aot.h"
+
+static constexpr uint16_t RomAddress = 0x200;
+
+static const char* GetCompatibilityModeEnumerator(const CompatibilityMode mode)
+{
+	switch (mode)
+	{
+	case CompatibilityMode::Chip8:
+		return "CompatibilityMode::Chip8";
+	case CompatibilityMode::Chip8E:
+		return "CompatibilityMode::Chip8E";
+	case CompatibilityMode::Chip48:
+		return "CompatibilityMode::Chip48";
+	case CompatibilityMode::SuperChip:
+		return "CompatibilityMode::SuperChip";
+	default:
+		return nullptr;
+	}
+}
+
+static std::string GetLabel(const uint32_t address)
+{
+	return fmt::format("Block_{:03X}", address);
+}
+
+AotCompiler::AotCompiler(const CompatibilityMode mode, std::vector<uint8_t> rom, std::string name)
+	: m_Mode(mode), m_Quirks(Interpreter::GetVariant(mode).Quirks), m_Rom(std::move(rom)), m_Name(std::move(name))
+{
+}
+
+bool AotCompiler::IsInRom(const uint32_t address) const
+{
+	return address >= RomAddress && address + 1 < RomAddress + m_Rom.size();
+}
+
+bool AotCompiler::IsLeader(const uint32_t address) const
+{
+	return m_Leaders.find(static_cast<uint16_t>(address)) != m_Leaders.end();
+}
+
+AotCompiler::Flow AotCompiler::GetFlow(const DecodedInstruction& instruction) const
+{
+	if (!Interpreter::IsValid(instruction))
+		return Flow::Stop;
+
+	switch (instruction.Opcode >> 12)
+	{
+	case 0x0:
+		if (instruction.Opcode == 0x00EE)
+			return Flow::Dynamic;
+		return instruction.Opcode == 0x00FD ? Flow::Stop : Flow::Next;
+	case 0x1:
+		return Flow::Jump;
+	case 0x2:
+		return Flow::Call;
+	case 0x3:
+	case 0x4:
+	case 0x5:
+	case 0x9:
+	case 0xE:
+		return Flow::Skip;
+	case 0xB:
+		return Flow::Dynamic;
+	case 0xF:
+		if (instruction.NN == 0x0A)
+			return Flow::Dynamic;
+		return instruction.NN == 0x33 || instruction.NN == 0x55 ? Flow::Store : Flow::Next;
+	default:
+		return Flow::Next;
+	}
+}
+
+void AotCompiler::Walk()
+{
+	const InterpreterVariant& interpreter = Interpreter::GetVariant(m_Mode);
+
+	std::vector<uint32_t> pending = { RomAddress };
+	std::set<uint32_t> leaders = { RomAddress };
+	while (!pending.empty())
+	{
+		const uint32_t address = pending.back();
+		pending.pop_back();
+		if (!IsInRom(address) || m_Instructions.find(static_cast<uint16_t>(address)) != m_Instructions.end())
+			continue;
+
+		const uint32_t offset = address - RomAddress;
+		const DecodedInstruction decoded = interpreter.Decode(static_cast<uint16_t>(m_Rom[offset] << 8 | m_Rom[offset + 1]));
+		const Flow flow = GetFlow(decoded);
+		m_Instructions[static_cast<uint16_t>(address)] = { decoded, flow };
+
+		const auto addSuccessor = [&](const uint32_t target, const bool leader)
+		{
+			pending.push_back(target);
+			if (leader)
+				leaders.insert(target);
+		};
+		switch (flow)
+		{
+		case Flow::Next:
+			addSuccessor(address + 2, false);
+			break;
+		case Flow::Jump:
+			addSuccessor(decoded.NNN, true);
+			break;
+		case Flow::Call:
+			addSuccessor(decoded.NNN, true);
+			addSuccessor(address + 2, true); // Where 00EE comes back to
+			break;
+		case Flow::Skip:
+			addSuccessor(address + 2, true);
+			addSuccessor(address + 4, true);
+			break;
+		case Flow::Store:
+			addSuccessor(address + 2, true);
+			break;
+		case Flow::Dynamic:
+			// FX0A carries on or waits on itself. Other targets can't be known; the dispatcher handles them.
+			if (decoded.NN == 0x0A && decoded.Opcode >> 12 == 0xF)
+			{
+				addSuccessor(address, true);
+				addSuccessor(address + 2, true);
+			}
+			break;
+		case Flow::Stop:
+			break;
+		}
+	}
+
+	// Only compiled addresses can be jumped to directly
+	for (const uint32_t leader : leaders)
+	{
+		if (m_Instructions.find(static_cast<uint16_t>(leader)) != m_Instructions.end())
+			m_Leaders.insert(static_cast<uint16_t>(leader));
+	}
+}
+
+bool AotCompiler::Generate(std::ostream& out)
+{
+	const char* modeEnumerator = GetCompatibilityModeEnumerator(m_Mode);
+	if (!modeEnumerator)
+	{
+		C8_ERROR("chip8-aot doesn't support {0} ROMs", GetCompatibilityModeName(m_Mode));
+		return false;
+	}
+
+	Walk();
+	if (m_Instructions.empty())
+	{
+		C8_ERROR("No reachable code in {0}", m_Name);
+		return false;
+	}
+
+	const uint64_t key = GetAotKey(static_cast<uint8_t>(m_Mode), m_Rom.data(), m_Rom.size());
+
+	std::string escapedName;
+	for (const char c : m_Name)
+	{
+		if (c == '"' || c == '\\')
+			escapedName += '\\';
+		escapedName += c;
+	}
+
+	out << "// Generated by chip8-aot from " << m_Name << " (" << GetCompatibilityModeName(m_Mode) << "). Do not edit; regenerate it instead.\n";
+	out << "// Build this into anything that links the emulator core, and select ExecutionBackend::Aot to run the ROM natively.\n";
+	out << "#include \"c8pch.h\"\n\n";
+	out << "#include \"Core/Aot.h\"\n";
+	out << "#include \"Core/Emulator.h\"\n";
+	out << "#include \"Core/Interpreter.h\"\n\n";
+
+	out << "static const uint8_t s_Rom[] = {";
+	for (size_t i = 0; i < m_Rom.size(); i++)
+		out << (i % 16 == 0 ? "\n\t" : " ") << fmt::format("0x{:02X},", m_Rom[i]);
+	out << "\n};\n\n";
+
+	out << "template <>\n";
+	out << fmt::format("uint64_t AotRun<{:#018x}ull>(Emulator& emulator, const uint64_t instructionCount)\n", key);
+	out << "{\n";
+	out << "\t[[maybe_unused]] uint8_t* const v = emulator.m_VRegisters;\n";
+	out << "\tconst uint8_t* const memory = emulator.m_Memory;\n";
+	out << "\tconst uint32_t memoryMask = emulator.m_CurrentMemorySize - 1;\n";
+	out << "\tuint64_t executed = 0;\n\n";
+
+	out << "Dispatch:\n";
+	out << "\tif (executed >= instructionCount || !emulator.m_Running)\n";
+	out << "\t\treturn executed;\n";
+	out << "\tswitch (emulator.m_ProgramCounter & memoryMask)\n";
+	out << "\t{\n";
+	for (const uint16_t leader : m_Leaders)
+		out << fmt::format("\tcase {:#05x}: goto {};\n", leader, GetLabel(leader));
+	out << "\tdefault: break;\n";
+	out << "\t}\n";
+	out << "Interpret:\n";
+	out << "\t// Not compiled, or overwritten since; the interpreter runs it instead.\n";
+	out << "\texecuted += emulator.m_Interpreter->Run(emulator, 1);\n";
+	out << "\tgoto Dispatch;\n";
+
+	for (const uint16_t leader : m_Leaders)
+		EmitBlock(out, leader);
+
+	out << "}\n\n";
+	out << fmt::format("static const bool s_Registered = AotRegistry::Register({{ \"{0}\", {1}, s_Rom, sizeof(s_Rom), &AotRun<{2:#018x}ull> }});\n",
+		escapedName, modeEnumerator, key);
+	return true;
+}
+
+void AotCompiler::EmitBlock(std::ostream& out, const uint16_t start) const
+{
+	// Find the end of the block first, so its code can be checked against the ROM in one go on entry.
+	std::vector<uint16_t> addresses;
+	for (uint32_t address = start;; address += 2)
+	{
+		addresses.push_back(static_cast<uint16_t>(address));
+		const auto it = m_Instructions.find(static_cast<uint16_t>(address));
+		if (it->second.ControlFlow != Flow::Next)
+			break;
+		const uint32_t next = address + 2;
+		if (IsLeader(next) || m_Instructions.find(static_cast<uint16_t>(next)) == m_Instructions.end())
+			break;
+	}
+	const uint32_t size = static_cast<uint32_t>(addresses.size() * 2);
+
+	out << "\n" << GetLabel(start) << ":\n";
+	// Blocks only run whole, so once the next one needs more than is left, the interpreter runs the rest and stops exactly
+	// where it would have on its own
+	out << fmt::format("\tif (executed + {0} > instructionCount) {{ emulator.m_ProgramCounter = {1:#05x}; return executed + emulator.m_Interpreter->Run(emulator, instructionCount - executed); }}\n",
+		addresses.size(), start);
+	out << fmt::format("\tif (memcmp(memory + {0:#05x}, s_Rom + {1:#05x}, {2}) != 0) {{ emulator.m_ProgramCounter = {0:#05x}; goto Interpret; }}\n",
+		start, start - RomAddress, size);
+
+	uint32_t count = 0;
+	for (const uint16_t address : addresses)
+	{
+		const Instruction& instruction = m_Instructions.at(address);
+		const DecodedInstruction& decoded = instruction.Decoded;
+		const uint32_t next = address + 2;
+		count++;
+
+		out << fmt::format("\t// {:#05x}: {:04X}\n", address, decoded.Opcode);
+		switch (instruction.ControlFlow)
+		{
+		case Flow::Next:
+			if (!EmitNative(out, decoded))
+			{
+				EmitFallback(out, address, decoded);
+				out << fmt::format("\tif (!emulator.m_Running) {{ executed += {}; return executed; }}\n", count);
+			}
+			if (address == addresses.back())
+			{
+				out << fmt::format("\texecuted += {};\n", count);
+				EmitSuccessor(out, next, "\t");
+			}
+			break;
+		case Flow::Jump:
+			out << fmt::format("\texecuted += {};\n", count);
+			EmitSuccessor(out, decoded.NNN, "\t");
+			break;
+		case Flow::Call:
+			EmitFallback(out, address, decoded);
+			out << fmt::format("\texecuted += {};\n", count);
+			out << "\tif (!emulator.m_Running) return executed;\n";
+			EmitSuccessor(out, decoded.NNN, "\t");
+			break;
+		case Flow::Skip:
+		{
+			std::string condition;
+			const std::string vx = fmt::format("v[{:#x}]", decoded.X), vy = fmt::format("v[{:#x}]", decoded.Y);
+			switch (decoded.Opcode >> 12)
+			{
+			case 0x3: condition = fmt::format("{} == {:#04x}", vx, decoded.NN); break;
+			case 0x4: condition = fmt::format("{} != {:#04x}", vx, decoded.NN); break;
+			case 0x5: condition = fmt::format("{} == {}", vx, vy); break;
+			case 0x9: condition = fmt::format("{} != {}", vx, vy); break;
+			default: // EX9E, EXA1
+				condition = fmt::format("{}(emulator.m_KeyStates & BIT({} & 0xF))", decoded.NN == 0x9E ? "" : "!", vx);
+				break;
+			}
+			out << fmt::format("\texecuted += {};\n", count);
+			out << "\tif (" << condition << ")\n";
+			EmitSuccessor(out, next + 2, "\t\t");
+			EmitSuccessor(out, next, "\t");
+			break;
+		}
+		case Flow::Store:
+			EmitFallback(out, address, decoded);
+			out << fmt::format("\texecuted += {};\n", count);
+			EmitSuccessor(out, next, "\t");
+			break;
+		case Flow::Dynamic:
+		case Flow::Stop:
+			EmitFallback(out, address, decoded);
+			out << fmt::format("\texecuted += {};\n", count);
+			out << "\tgoto Dispatch;\n";
+			break;
+		}
+	}
+}
+
+bool AotCompiler::EmitNative(std::ostream& out, const DecodedInstruction& instruction) const
+{
+	const std::string vx = fmt::format("v[{:#x}]", instruction.X), vy = fmt::format("v[{:#x}]", instruction.Y);
+	const std::string& shiftSource = (m_Quirks & Quirks::ShiftUsesVY) ? vy : vx;
+	const char* resetVF = (m_Quirks & Quirks::LogicResetsVF) ? " v[0xf] = 0;" : "";
+
+	switch (instruction.Opcode >> 12)
+	{
+	case 0x6:
+		out << fmt::format("\t{} = {:#04x};\n", vx, instruction.NN);
+		return true;
+	case 0x7:
+		out << fmt::format("\t{} += {:#04x};\n", vx, instruction.NN);
+		return true;
+	case 0xA:
+		out << fmt::format("\temulator.m_IRegister = {:#05x};\n", instruction.NNN);
+		return true;
+	case 0x8:
+		// VF is written last, as in the interpreter, so it holds the flag when it's also the destination.
+		switch (instruction.N)
+		{
+		case 0x0: out << fmt::format("\t{} = {};\n", vx, vy); return true;
+		case 0x1: out << fmt::format("\t{} |= {};{}\n", vx, vy, resetVF); return true;
+		case 0x2: out << fmt::format("\t{} &= {};{}\n", vx, vy, resetVF); return true;
+		case 0x3: out << fmt::format("\t{} ^= {};{}\n", vx, vy, resetVF); return true;
+		case 0x4: out << fmt::format("\t{{ const uint32_t sum = {0} + {1}; {0} = static_cast<uint8_t>(sum); v[0xf] = sum > 0xFF; }}\n", vx, vy); return true;
+		case 0x5: out << fmt::format("\t{{ const uint8_t flag = {0} >= {1}; {0} = static_cast<uint8_t>({0} - {1}); v[0xf] = flag; }}\n", vx, vy); return true;
+		case 0x6: out << fmt::format("\t{{ const uint8_t source = {1}; {0} = source >> 1; v[0xf] = source & 0x1; }}\n", vx, shiftSource); return true;
+		case 0x7: out << fmt::format("\t{{ const uint8_t flag = {1} >= {0}; {0} = static_cast<uint8_t>({1} - {0}); v[0xf] = flag; }}\n", vx, vy); return true;
+		case 0xE: out << fmt::format("\t{{ const uint8_t source = {1}; {0} = static_cast<uint8_t>(source << 1); v[0xf] = source >> 7; }}\n", vx, shiftSource); return true;
+		default: return false;
+		}
+	case 0xF:
+		switch (instruction.NN)
+		{
+		case 0x07: out << fmt::format("\t{} = emulator.m_DelayTimer;\n", vx); return true;
+		case 0x15: out << fmt::format("\temulator.m_DelayTimer = {};\n", vx); return true;
+		case 0x18: out << fmt::format("\temulator.m_SoundTimer = {};\n", vx); return true;
+		case 0x1E: out << fmt::format("\temulator.m_IRegister = static_cast<uint16_t>(emulator.m_IRegister + {});\n", vx); return true;
+		default: return false;
+		}
+	default:
+		return false;
+	}
+}
+
+void AotCompiler::EmitFallback(std::ostream& out, const uint16_t address, const DecodedInstruction& instruction) const
+{
+	out << fmt::format("\temulator.m_ProgramCounter = {:#05x};\n", address + 2);
+	out << fmt::format("\tInterpreter::Execute(emulator, {:#06x});\n", instruction.Opcode);
+}
+
+void AotCompiler::EmitSuccessor(std::ostream& out, const uint32_t target, const char* indent) const
+{
+	if (IsLeader(target))
+		out << indent << "goto " << GetLabel(target) << ";\n";
+	else
+		out << indent << fmt::format("{{ emulator.m_ProgramCounter = {:#05x}; goto Dispatch; }}\n", target);
+}
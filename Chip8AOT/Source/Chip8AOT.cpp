@@ -0,0 +1,71 @@
+#include "c8pch.h"
+
+#include <filesystem>
+#include <fstream>
+
+#include "AotCompiler.h"
+
+// chip8-aot: statically recompiles a ROM into a C++ translation unit.
+// Usage: chip8-aot <rom> [output.cpp] [chip8|chip8e|chip48|superchip]
+// The output defaults to the ROM's name with a .aot.cpp extension, and the mode to CHIP-8.
+static int Run(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		C8_ERROR("Usage: chip8-aot <rom> [output.cpp] [chip8|chip8e|chip48|superchip]");
+		return 1;
+	}
+
+	const std::filesystem::path romPath = argv[1];
+	std::filesystem::path outputPath = romPath;
+	outputPath.replace_extension(".aot.cpp");
+	if (argc > 2)
+		outputPath = argv[2];
+
+	CompatibilityMode mode = CompatibilityMode::Chip8;
+	if (argc > 3)
+	{
+		static const std::unordered_map<std::string, CompatibilityMode> modes = {
+			{ "chip8", CompatibilityMode::Chip8 },
+			{ "chip8e", CompatibilityMode::Chip8E },
+			{ "chip48", CompatibilityMode::Chip48 },
+			{ "superchip", CompatibilityMode::SuperChip }
+		};
+		const auto it = modes.find(argv[3]);
+		if (it == modes.end())
+		{
+			C8_ERROR("Unknown compatibility mode: {0}", argv[3]);
+			return 1;
+		}
+		mode = it->second;
+	}
+
+	std::ifstream file(romPath, std::ios::binary);
+	if (!file.is_open())
+	{
+		C8_ERROR("Failed to open file: {}", romPath.string());
+		return 1;
+	}
+	const std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	AotCompiler compiler(mode, rom, romPath.filename().string());
+	std::ofstream output(outputPath, std::ios::binary);
+	if (!output.is_open())
+	{
+		C8_ERROR("Failed to open output file: {}", outputPath.string());
+		return 1;
+	}
+	if (!compiler.Generate(output))
+		return 1;
+
+	C8_INFO("Compiled {0} instructions in {1} blocks to {2}", compiler.GetInstructionCount(), compiler.GetBlockCount(), outputPath.string());
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	InitLog(nullptr);
+	const int result = Run(argc, argv);
+	ShutdownLog();
+	return result;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Microbenchmark.h"
+
+// The emulator core's benchmarks, each named "<subsystem>/<case>". Every one starts from the same state with the same random
+// seed, so results only vary with the host. A friend of Emulator, so the internals that only run on a reset or mode switch
+// can be timed on their own.
+class CoreBenchmarks
+{
+public:
+	[[nodiscard]] static std::vector<Microbenchmark> Create();
+
+protected:
+	static void AddDispatchBenchmarks(std::vector<Microbenchmark>& benchmarks);
+	static void AddDrawBenchmarks(std::vector<Microbenchmark>& benchmarks);
+	static void AddClearBenchmarks(std::vector<Microbenchmark>& benchmarks);
+	static void AddModeSwitchBenchmarks(std::vector<Microbenchmark>& benchmarks);
+	static void AddRomLoadBenchmarks(std::vector<Microbenchmark>& benchmarks);
+	static void AddSaveStateBenchmarks(std::vector<Microbenchmark>& benchmarks);
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+// Does the thing being measured iterations times over
+using MicrobenchmarkBody = std::function<void(uint64_t iterations)>;
+
+struct Microbenchmark
+{
+	std::string Name;
+	// Sets up whatever the benchmark needs and returns what to time, so benchmarks that aren't run cost nothing. Returns
+	// nothing if it can't run on this host, e.g. the JIT on a platform it doesn't support.
+	std::function<MicrobenchmarkBody()> Setup;
+};
+
+struct MicrobenchmarkOptions
+{
+	uint32_t Samples = 100;
+	// Each sample runs the body enough iterations to take at least this long, so the clock's resolution doesn't matter
+	uint64_t MinSampleNs = 1'000'000;
+};
+
+// Nanoseconds per iteration, over every sample
+struct MicrobenchmarkResult
+{
+	std::string Name;
+	uint64_t Iterations = 0; // Per sample
+	uint32_t Samples = 0;
+	double MinNs = 0.0, MedianNs = 0.0, P99Ns = 0.0, MeanNs = 0.0;
+};
+
+// Works out how many iterations make a sample long enough, which also warms up caches and anything lazily created, then
+// times options.Samples samples of that many
+[[nodiscard]] MicrobenchmarkResult RunMicrobenchmark(const std::string& name, const MicrobenchmarkBody& body, const MicrobenchmarkOptions& options);
+
+// Writes the results as a JSON object, with the options they were run with
+void WriteResultsJson(std::ostream& out, const std::vector<MicrobenchmarkResult>& results, const MicrobenchmarkOptions& options);
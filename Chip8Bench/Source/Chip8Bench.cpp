@@ -0,0 +1,127 @@
+#include "c8pch.h"
+
+#include <fstream>
+
+#include "CoreBenchmarks.h"
+#include "Microbenchmark.h"
+
+static constexpr const char* Usage =
+	"Usage: chip8-bench [options]\n"
+	"  --filter <text>  Only run benchmarks with this in their name\n"
+	"  --samples <n>    Samples per benchmark, 100 by default\n"
+	"  --min-sample-us <n>  Run each sample for at least this long, 1000 by default\n"
+	"  --output <file>  Where to write the results, stdout by default\n"
+	"  --list           List the benchmarks and exit\n"
+	"  --help, -h       Show this message";
+
+static bool ParseNumber(const char* text, uint64_t& value)
+{
+	try
+	{
+		size_t end = 0;
+		value = std::stoull(text, &end, 0);
+		return text[end] == '\0';
+	}
+	catch (const std::exception&)
+	{
+		return false;
+	}
+}
+
+// chip8-bench: times the emulator core's subsystems on their own, and writes nanoseconds per operation (min, median and
+// p99 over the samples) as JSON, for tracking regressions from one commit to the next. Benchmarks run one at a time on the
+// main thread; for the steadiest numbers, pin it to a core (e.g. taskset -c 2) on an otherwise idle machine.
+static int Run(int argc, char* argv[])
+{
+	MicrobenchmarkOptions options;
+	std::string filter, outputPath;
+	bool list = false;
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--help" || arg == "-h")
+		{
+			std::cout << Usage << "\n";
+			return 0;
+		}
+		if (arg == "--list")
+		{
+			list = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			C8_ERROR("Missing value for {0}\n{1}", arg, Usage);
+			return 1;
+		}
+
+		const char* value = argv[++i];
+		uint64_t number = 0;
+		if (arg == "--filter")
+			filter = value;
+		else if (arg == "--samples" && ParseNumber(value, number) && number > 0 && number <= UINT32_MAX)
+			options.Samples = static_cast<uint32_t>(number);
+		else if (arg == "--min-sample-us" && ParseNumber(value, number) && number <= UINT64_MAX / 1000)
+			options.MinSampleNs = number * 1000;
+		else if (arg == "--output")
+			outputPath = value;
+		else
+		{
+			C8_ERROR("Invalid option: {0} {1}\n{2}", arg, value, Usage);
+			return 1;
+		}
+	}
+
+	std::vector<Microbenchmark> benchmarks = CoreBenchmarks::Create();
+	benchmarks.erase(std::remove_if(benchmarks.begin(), benchmarks.end(),
+		[&filter](const Microbenchmark& benchmark) { return benchmark.Name.find(filter) == std::string::npos; }), benchmarks.end());
+	if (list)
+	{
+		for (const Microbenchmark& benchmark : benchmarks)
+			std::cout << benchmark.Name << "\n";
+		return 0;
+	}
+	if (benchmarks.empty())
+	{
+		C8_ERROR("No benchmarks match {0}", filter);
+		return 1;
+	}
+
+	std::ofstream outputFile;
+	if (!outputPath.empty())
+	{
+		outputFile.open(outputPath, std::ios::binary);
+		if (!outputFile.is_open())
+		{
+			C8_ERROR("Failed to open output file: {}", outputPath);
+			return 1;
+		}
+	}
+	std::ostream& output = outputPath.empty() ? std::cout : outputFile;
+
+	std::vector<MicrobenchmarkResult> results;
+	for (const Microbenchmark& benchmark : benchmarks)
+	{
+		const MicrobenchmarkBody body = benchmark.Setup();
+		if (!body)
+		{
+			C8_WARN("{0}: can't run here, skipping", benchmark.Name);
+			continue;
+		}
+		results.push_back(RunMicrobenchmark(benchmark.Name, body, options));
+		// Progress goes straight to stderr, as the log would rate limit a line per benchmark
+		const MicrobenchmarkResult& result = results.back();
+		std::cerr << fmt::format("{0}: min {1:.1f}ns, median {2:.1f}ns, p99 {3:.1f}ns\n", result.Name, result.MinNs, result.MedianNs, result.P99Ns);
+	}
+
+	WriteResultsJson(output, results, options);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	InitLog(nullptr, LogTarget::Stderr);
+	const int result = Run(argc, argv);
+	ShutdownLog();
+	return result;
+}
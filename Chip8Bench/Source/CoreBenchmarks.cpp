@@ -0,0 +1,291 @@
+#include "c8pch.h"
+#include "CoreBenchmarks.h"
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+
+#include "Core/Benchmark.h"
+#include "Core/Emulator.h"
+#include "Core/Interpreter.h"
+#include "Core/OpcodeProfiler.h"
+
+static constexpr uint32_t RandomSeed = 0xC8C8C8C8;
+static constexpr uint16_t SpriteAddress = 0x300;
+
+static std::shared_ptr<Emulator> CreateEmulator(const CompatibilityMode mode, const std::vector<uint8_t>& rom)
+{
+	auto emulator = std::make_shared<Emulator>();
+	emulator->SetDebugLogs(false);
+	emulator->SetRandomSeed(RandomSeed);
+	emulator->LoadRom(mode, rom);
+	return emulator;
+}
+
+// The same bytes every time, so ROM loads always copy the same thing
+static std::vector<uint8_t> CreateRom(const size_t size)
+{
+	std::vector<uint8_t> rom(size);
+	uint32_t state = RandomSeed;
+	for (uint8_t& byte : rom)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		byte = static_cast<uint8_t>(state);
+	}
+	return rom;
+}
+
+std::vector<Microbenchmark> CoreBenchmarks::Create()
+{
+	std::vector<Microbenchmark> benchmarks;
+	AddDispatchBenchmarks(benchmarks);
+	AddDrawBenchmarks(benchmarks);
+	AddClearBenchmarks(benchmarks);
+	AddModeSwitchBenchmarks(benchmarks);
+	AddRomLoadBenchmarks(benchmarks);
+	AddSaveStateBenchmarks(benchmarks);
+	return benchmarks;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Dispatch
+// Per instruction of the built-in benchmark ROM, which never stops, through Emulator::Step like everything else runs it
+// -----------------------------------------------------------------------------------------------
+void CoreBenchmarks::AddDispatchBenchmarks(std::vector<Microbenchmark>& benchmarks)
+{
+	const auto add = [&benchmarks](const std::string& name, const ExecutionBackend backend, const bool profiled)
+	{
+		benchmarks.push_back({ name, [backend, profiled]() -> MicrobenchmarkBody
+		{
+			std::shared_ptr<Emulator> emulator = CreateEmulator(CompatibilityMode::Chip8, GetBenchmarkRom());
+			emulator->SetExecutionBackend(backend);
+			if (emulator->GetExecutionBackend() != backend)
+				return nullptr;
+			std::shared_ptr<OpcodeProfiler> profiler;
+			if (profiled)
+			{
+				profiler = std::make_shared<OpcodeProfiler>();
+				emulator->SetProfiler(profiler.get());
+			}
+			return [emulator, profiler](const uint64_t iterations) { emulator->Step(iterations); };
+		} });
+	};
+	add("dispatch/interpreter", ExecutionBackend::Interpreter, false);
+	add("dispatch/interpreter-profiled", ExecutionBackend::Interpreter, true);
+	add("dispatch/jit", ExecutionBackend::Jit, false);
+}
+
+// -----------------------------------------------------------------------------------------------
+// Sprite drawing
+// Per draw, calling the decoded handler directly, so only the draw itself is timed. Drawing the same sprite in the same
+// place again undoes it, so every other draw sets the pixels the one before cleared, at the same cost.
+// -----------------------------------------------------------------------------------------------
+struct DrawCase
+{
+	const char* Name;
+	CompatibilityMode Mode;
+	uint8_t X, Y;
+	uint8_t Rows; // 0 for a 16x16 sprite
+	bool HiRes;
+	uint8_t Planes; // Selected with FN01
+};
+
+void CoreBenchmarks::AddDrawBenchmarks(std::vector<Microbenchmark>& benchmarks)
+{
+	static constexpr DrawCase cases[] = {
+		{ "draw/chip8-8x1-aligned", CompatibilityMode::Chip8, 0, 0, 1, false, 1 },
+		{ "draw/chip8-8x15-aligned", CompatibilityMode::Chip8, 0, 0, 15, false, 1 },
+		{ "draw/chip8-8x15-unaligned", CompatibilityMode::Chip8, 29, 5, 15, false, 1 },
+		{ "draw/chip8-8x15-clipped", CompatibilityMode::Chip8, 60, 24, 15, false, 1 },
+		{ "draw/superchip-8x15-lores", CompatibilityMode::SuperChip, 29, 5, 15, false, 1 },
+		{ "draw/superchip-16x16-hires", CompatibilityMode::SuperChip, 56, 20, 0, true, 1 },
+		{ "draw/xochip-8x15-wrapped", CompatibilityMode::XOChip11, 124, 60, 15, true, 1 },
+		{ "draw/xochip-16x16-4planes", CompatibilityMode::XOChip11, 56, 20, 0, true, 0xF },
+	};
+
+	for (const DrawCase& draw : cases)
+	{
+		benchmarks.push_back({ draw.Name, [&draw]() -> MicrobenchmarkBody
+		{
+			std::shared_ptr<Emulator> emulator = CreateEmulator(draw.Mode, GetBenchmarkRom());
+			// Enough for four planes of a 16x16 sprite, with bits set all over
+			const std::vector<uint8_t> sprite = CreateRom(128);
+			emulator->WriteToMemory(SpriteAddress, sprite);
+			Interpreter::Execute(*emulator, 0xA000 | SpriteAddress);
+			Interpreter::Execute(*emulator, static_cast<uint16_t>(0x6000 | draw.X));
+			Interpreter::Execute(*emulator, static_cast<uint16_t>(0x6100 | draw.Y));
+			if (draw.HiRes)
+				Interpreter::Execute(*emulator, 0x00FF);
+			if (draw.Planes != 1)
+				Interpreter::Execute(*emulator, static_cast<uint16_t>(0xF001 | draw.Planes << 8));
+
+			const DecodedInstruction instruction = Interpreter::GetVariant(draw.Mode).Decode(static_cast<uint16_t>(0xD010 | draw.Rows));
+			return [emulator, instruction](const uint64_t iterations)
+			{
+				for (uint64_t i = 0; i < iterations; i++)
+					instruction.Handler(*emulator, instruction);
+			};
+		} });
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+// Clearing, per clear of the whole display or memory
+// -----------------------------------------------------------------------------------------------
+void CoreBenchmarks::AddClearBenchmarks(std::vector<Microbenchmark>& benchmarks)
+{
+	const auto addDisplay = [&benchmarks](const std::string& name, const CompatibilityMode mode)
+	{
+		benchmarks.push_back({ name, [mode]() -> MicrobenchmarkBody
+		{
+			std::shared_ptr<Emulator> emulator = CreateEmulator(mode, GetBenchmarkRom());
+			return [emulator](const uint64_t iterations)
+			{
+				for (uint64_t i = 0; i < iterations; i++)
+					emulator->ZeroDisplay();
+			};
+		} });
+	};
+	addDisplay("zerodisplay/chip8", CompatibilityMode::Chip8);
+	addDisplay("zerodisplay/superchip", CompatibilityMode::SuperChip);
+	addDisplay("zerodisplay/xochip", CompatibilityMode::XOChip11);
+
+	const auto addMemory = [&benchmarks](const std::string& name, const CompatibilityMode mode)
+	{
+		benchmarks.push_back({ name, [mode]() -> MicrobenchmarkBody
+		{
+			std::shared_ptr<Emulator> emulator = CreateEmulator(mode, GetBenchmarkRom());
+			return [emulator](const uint64_t iterations)
+			{
+				for (uint64_t i = 0; i < iterations; i++)
+					emulator->ZeroMem();
+			};
+		} });
+	};
+	addMemory("zeromem/chip8", CompatibilityMode::Chip8);
+	addMemory("zeromem/xochip", CompatibilityMode::XOChip11);
+}
+
+// -----------------------------------------------------------------------------------------------
+// Mode switches, per SetCompatibilityMode, alternating between two modes. That's a full Initialise, and modes with the
+// same sizes reuse their buffers, so the cases are the cheap path and the reallocating one.
+// -----------------------------------------------------------------------------------------------
+void CoreBenchmarks::AddModeSwitchBenchmarks(std::vector<Microbenchmark>& benchmarks)
+{
+	const auto add = [&benchmarks](const std::string& name, const CompatibilityMode first, const CompatibilityMode second)
+	{
+		benchmarks.push_back({ name, [first, second]() -> MicrobenchmarkBody
+		{
+			std::shared_ptr<Emulator> emulator = CreateEmulator(first, GetBenchmarkRom());
+			return [emulator, first, second](const uint64_t iterations)
+			{
+				for (uint64_t i = 0; i < iterations; i++)
+					emulator->SetCompatibilityMode(emulator->GetCompatibilityMode() == first ? second : first);
+			};
+		} });
+	};
+	add("modeswitch/chip8-chip48", CompatibilityMode::Chip8, CompatibilityMode::Chip48);
+	add("modeswitch/chip8-xochip", CompatibilityMode::Chip8, CompatibilityMode::XOChip11);
+	add("modeswitch/superchip-xochip", CompatibilityMode::SuperChip, CompatibilityMode::XOChip11);
+}
+
+// -----------------------------------------------------------------------------------------------
+// ROM loading, per load of the biggest ROM each mode can hold, into an emulator already in that mode
+// -----------------------------------------------------------------------------------------------
+// A ROM written to the temp directory for the length of a benchmark
+struct TempRomFile
+{
+	std::string Path;
+
+	explicit TempRomFile(const std::vector<uint8_t>& rom)
+	{
+		Path = (std::filesystem::temp_directory_path() / fmt::format("chip8-bench-{0}.ch8", rom.size())).string();
+		std::ofstream file(Path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(rom.data()), static_cast<std::streamsize>(rom.size()));
+		if (!file)
+			C8_ERROR("Failed to write benchmark ROM: {0}", Path);
+	}
+	~TempRomFile()
+	{
+		std::error_code error;
+		std::filesystem::remove(Path, error);
+	}
+
+	TempRomFile(const TempRomFile&) = delete;
+	TempRomFile& operator=(const TempRomFile&) = delete;
+};
+
+void CoreBenchmarks::AddRomLoadBenchmarks(std::vector<Microbenchmark>& benchmarks)
+{
+	const auto add = [&benchmarks](const std::string& name, const CompatibilityMode mode, const size_t size, const bool fromFile)
+	{
+		benchmarks.push_back({ name, [mode, size, fromFile]() -> MicrobenchmarkBody
+		{
+			std::shared_ptr<Emulator> emulator = CreateEmulator(mode, GetBenchmarkRom());
+			auto rom = std::make_shared<const std::vector<uint8_t>>(CreateRom(size));
+			if (!fromFile)
+			{
+				return [emulator, rom](const uint64_t iterations)
+				{
+					for (uint64_t i = 0; i < iterations; i++)
+						emulator->LoadRom(emulator->GetCompatibilityMode(), *rom);
+				};
+			}
+
+			auto file = std::make_shared<const TempRomFile>(*rom);
+			return [emulator, file](const uint64_t iterations)
+			{
+				for (uint64_t i = 0; i < iterations; i++)
+					emulator->LoadRom(file->Path);
+			};
+		} });
+	};
+	add("romload/chip8-bytes", CompatibilityMode::Chip8, 4096 - 0x200, false);
+	add("romload/chip8-file", CompatibilityMode::Chip8, 4096 - 0x200, true);
+	add("romload/xochip-bytes", CompatibilityMode::XOChip11, 65536 - 0x200, false);
+	add("romload/xochip-file", CompatibilityMode::XOChip11, 65536 - 0x200, true);
+}
+
+// -----------------------------------------------------------------------------------------------
+// Save states, per save, or per save and load. Each load switches to a state that differs from the last in every page
+// of memory and in the registers, so it restores everything rather than finding nothing has changed.
+// -----------------------------------------------------------------------------------------------
+void CoreBenchmarks::AddSaveStateBenchmarks(std::vector<Microbenchmark>& benchmarks)
+{
+	const auto add = [&benchmarks](const std::string& name, const CompatibilityMode mode, const bool load)
+	{
+		benchmarks.push_back({ name, [mode, load]() -> MicrobenchmarkBody
+		{
+			std::shared_ptr<Emulator> emulator = CreateEmulator(mode, GetBenchmarkRom());
+			emulator->Step(100'000);
+			// The two states to switch between, the second with a byte of every page changed and the program further on
+			auto states = std::make_shared<std::array<std::vector<uint8_t>, 2>>();
+			emulator->SaveState((*states)[0]);
+			for (uint32_t offset = Emulator::MemoryPageSize - 1; offset < emulator->GetMemorySize(); offset += Emulator::MemoryPageSize)
+			{
+				const uint8_t value = static_cast<uint8_t>(emulator->GetMemory()[offset] ^ 0xFF);
+				emulator->WriteToMemory(static_cast<int>(offset), &value, 1);
+			}
+			emulator->Step(1'000);
+			emulator->SaveState((*states)[1]);
+
+			// Kept between iterations, so only the first save allocates, as in the quick save slot
+			auto state = std::make_shared<std::vector<uint8_t>>();
+			return [emulator, states, state, load](const uint64_t iterations)
+			{
+				for (uint64_t i = 0; i < iterations; i++)
+				{
+					emulator->SaveState(*state);
+					if (load)
+						emulator->LoadState((*states)[i & 1]);
+				}
+			};
+		} });
+	};
+	add("savestate/chip8-save", CompatibilityMode::Chip8, false);
+	add("savestate/chip8-roundtrip", CompatibilityMode::Chip8, true);
+	add("savestate/xochip-save", CompatibilityMode::XOChip11, false);
+	add("savestate/xochip-roundtrip", CompatibilityMode::XOChip11, true);
+}
@@ -0,0 +1,68 @@
+#include "c8pch.h"
+#include "Microbenchmark.h"
+
+#include <chrono>
+#include <cmath>
+
+static uint64_t TimeBody(const MicrobenchmarkBody& body, const uint64_t iterations)
+{
+	const auto start = std::chrono::steady_clock::now();
+	body(iterations);
+	const auto end = std::chrono::steady_clock::now();
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+MicrobenchmarkResult RunMicrobenchmark(const std::string& name, const MicrobenchmarkBody& body, const MicrobenchmarkOptions& options)
+{
+	MicrobenchmarkResult result;
+	result.Name = name;
+	result.Samples = std::max(options.Samples, 1u);
+
+	// Grows towards the minimum sample time by however far off the last try was, with some to spare, but never by more
+	// than 10x at once, as the first few tries are too short to go by
+	uint64_t iterations = 1;
+	for (;;)
+	{
+		const uint64_t elapsed = TimeBody(body, iterations);
+		if (elapsed >= options.MinSampleNs || iterations >= UINT64_MAX / 10)
+			break;
+		const double scale = static_cast<double>(options.MinSampleNs) / static_cast<double>(std::max<uint64_t>(elapsed, 1)) * 1.2;
+		iterations = static_cast<uint64_t>(static_cast<double>(iterations) * std::clamp(scale, 2.0, 10.0));
+	}
+	result.Iterations = iterations;
+
+	std::vector<double> samples(result.Samples);
+	double total = 0.0;
+	for (double& sample : samples)
+	{
+		sample = static_cast<double>(TimeBody(body, iterations)) / static_cast<double>(iterations);
+		total += sample;
+	}
+	std::sort(samples.begin(), samples.end());
+
+	// Nearest rank, so the percentiles are always samples that were actually taken
+	const auto percentile = [&samples](const double fraction)
+	{
+		const size_t rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(samples.size())));
+		return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+	};
+	result.MinNs = samples.front();
+	result.MedianNs = percentile(0.5);
+	result.P99Ns = percentile(0.99);
+	result.MeanNs = total / static_cast<double>(samples.size());
+	return result;
+}
+
+void WriteResultsJson(std::ostream& out, const std::vector<MicrobenchmarkResult>& results, const MicrobenchmarkOptions& options)
+{
+	out << fmt::format("{{\"unit\":\"ns\",\"samples\":{},\"minSampleNs\":{},\"benchmarks\":[", options.Samples, options.MinSampleNs);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const MicrobenchmarkResult& result = results[i];
+		out << (i > 0 ? ",\n" : "\n");
+		// Names are only ever the suite's own, which never need escaping
+		out << fmt::format("{{\"name\":\"{}\",\"iterations\":{},\"min\":{:.3f},\"median\":{:.3f},\"p99\":{:.3f},\"mean\":{:.3f}}}",
+			result.Name, result.Iterations, result.MinNs, result.MedianNs, result.P99Ns, result.MeanNs);
+	}
+	out << "\n]}\n";
+}
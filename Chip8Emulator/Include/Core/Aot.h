@@ -0,0 +1,45 @@
+#pragma once
+
+// Forward declaration of Emulator
+class Emulator;
+enum class CompatibilityMode;
+
+// Statically recompiled ROMs, produced by chip8-aot (see Chip8AOT).
+// Each generated translation unit defines a specialisation of AotRun for its key, and registers itself with the
+// AotRegistry before main. Selecting ExecutionBackend::Aot then runs any registered ROM natively, and anything else
+// on the interpreter.
+
+// Identifies a ROM compiled for a particular mode: FNV-1a over the mode followed by the ROM bytes.
+[[nodiscard]] constexpr uint64_t GetAotKey(const uint8_t mode, const uint8_t* rom, const size_t size)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	hash = (hash ^ mode) * 0x100000001B3ull;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ rom[i]) * 0x100000001B3ull;
+	return hash;
+}
+
+// Defined by generated code only. Emulator befriends every specialisation, so generated code can work on its state directly.
+template <uint64_t Key>
+uint64_t AotRun(Emulator& emulator, uint64_t instructionCount);
+
+struct AotProgram
+{
+	const char* Name;
+	CompatibilityMode Mode;
+	const uint8_t* Rom;
+	uint32_t RomSize;
+	uint64_t (*Run)(Emulator& emulator, uint64_t instructionCount);
+};
+
+class AotRegistry
+{
+public:
+	// Called from the static initialisers of generated code. Returns true so it can initialise a static.
+	static bool Register(const AotProgram& program);
+	// Finds the program compiled from exactly this ROM in this mode, or nullptr if there isn't one.
+	[[nodiscard]] static const AotProgram* Find(CompatibilityMode mode, const uint8_t* rom, size_t size);
+
+private:
+	static std::vector<AotProgram>& GetPrograms();
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Core/Emulator.h"
+
+// Runs many instances of the same ROM side by side, e.g. for fuzzing with a different seed or input per instance.
+// The registers, I, PC and timers of every instance are stored structure-of-arrays: one contiguous array per register,
+// indexed by instance. Each instance still has its own memory and display.
+//
+// Step runs the instances in lockstep, one instruction each at a time. When an instance's next opcode matches the
+// leader's (the first running instance) and it's one of the register-only instructions, it runs for all of them at once
+// with SIMD. Any instance that has diverged runs its instruction through the interpreter's own handlers instead, so
+// every instance stays bit-exact with a single Emulator running the same ROM, seed and input.
+class BatchEmulator
+{
+public:
+	BatchEmulator(CompatibilityMode mode, uint32_t instanceCount);
+
+	BatchEmulator(const BatchEmulator&) = delete;
+	BatchEmulator& operator=(const BatchEmulator&) = delete;
+
+	[[nodiscard]] FORCEINLINE CompatibilityMode GetCompatibilityMode() const { return m_CompatibilityMode; }
+	[[nodiscard]] FORCEINLINE uint32_t GetInstanceCount() const { return m_InstanceCount; }
+
+	// Resets every instance and loads the same ROM into all of them. Returns false if the ROM couldn't be loaded.
+	bool LoadRom(const std::vector<uint8_t>& bytes);
+
+	// Runs up to instructionCount instructions on every running instance, returning how many lockstep steps were taken.
+	// Stops early once no instance is running.
+	uint64_t Step(uint64_t instructionCount = 1);
+	// Decrements every instance's delay and sound timers. Should be called at 60Hz, as with Emulator::TickTimers.
+	void TickTimers();
+
+	void SetKeyState(uint32_t instance, uint8_t key, bool pressed);
+	void SetRandomSeed(uint32_t instance, uint32_t seed);
+
+	[[nodiscard]] FORCEINLINE bool IsRunning(const uint32_t instance) const { return m_Running[instance] != 0; }
+	[[nodiscard]] FORCEINLINE bool IsAnyRunning() const { return m_RunningCount > 0; }
+	[[nodiscard]] FORCEINLINE EmulatorFault GetFault(const uint32_t instance) const { return m_Instances[instance].Fault; }
+	[[nodiscard]] FORCEINLINE uint16_t GetProgramCounter(const uint32_t instance) const { return m_ProgramCounter[instance]; }
+	[[nodiscard]] FORCEINLINE uint8_t GetVRegister(const uint32_t instance, const uint8_t index) const { return m_VRegisters[(index & 0xF) * m_Stride + instance]; }
+
+	// Copies an instance's whole state into emulator, which must have had a ROM loaded in the same mode.
+	// Used to check instances against an Emulator with HasSameState, or to carry on running one on its own.
+	void ExtractInstance(uint32_t instance, Emulator& emulator) const;
+
+	// Instructions run for all matching instances at once, and ones run per instance through the interpreter.
+	// The higher the first is compared to the second, the more the instances are staying in lockstep.
+	[[nodiscard]] FORCEINLINE uint64_t GetVectorInstructionCount() const { return m_VectorInstructions; }
+	[[nodiscard]] FORCEINLINE uint64_t GetScalarInstructionCount() const { return m_ScalarInstructions; }
+
+protected:
+	// What the handlers can change that isn't in the SoA arrays. Only touched when an instance runs an instruction on its own.
+	struct InstanceState
+	{
+		uint16_t Stack[64] = { 0 };
+		uint8_t FlagRegisters[16] = { 0 };
+		uint8_t AudioPattern[16] = { 0 };
+		uint8_t AudioPitch = 64;
+		uint8_t PlaneMask = 1;
+		bool HiRes = false;
+		uint16_t KeyStates = 0;
+		uint8_t WaitingKey = 0xFF;
+		uint32_t RandomState = 0xC8C8C8C8;
+		EmulatorFault Fault = EmulatorFault::None;
+		uint16_t FaultAddress = 0;
+	};
+
+	// Fetches every running instance's next opcode and moves its PC past it, as Interpreter::Run does.
+	// Returns the leader's opcode, fills in the masks of the instances that are running the same one, and lists the rest in m_Diverged.
+	[[nodiscard]] uint16_t Fetch();
+	// Runs opcode on every instance in the lane masks. Returns false if it isn't one that can be run that way.
+	bool ExecuteVector(uint16_t opcode);
+	void ExecuteScalar(uint32_t instance);
+	// Moves an instance's state into or out of m_Scratch
+	void LoadScratch(uint32_t instance);
+	void StoreScratch(uint32_t instance);
+
+	[[nodiscard]] FORCEINLINE uint8_t* GetInstanceMemory(const uint32_t instance) const { return m_Memory.get() + static_cast<size_t>(instance) * m_MemoryStride; }
+	[[nodiscard]] FORCEINLINE uint64_t* GetInstanceDisplay(const uint32_t instance) const { return m_Display.get() + static_cast<size_t>(instance) * m_DisplayWords; }
+
+	CompatibilityMode m_CompatibilityMode;
+	uint32_t m_Quirks = 0;
+	uint32_t m_InstanceCount;
+	uint32_t m_Stride; // m_InstanceCount rounded up to whole vectors; the lanes past the end are never running
+	uint32_t m_RunningCount = 0;
+	uint32_t m_LeaderCount = 0; // Instances running the leader's opcode this step
+
+	// SoA state, m_Stride entries each. V is register major: VX of every instance, then VX+1 of every instance.
+	std::vector<uint8_t> m_VRegisters;
+	std::vector<uint16_t> m_IRegister, m_ProgramCounter;
+	std::vector<uint8_t> m_DelayTimer, m_SoundTimer, m_StackPointer;
+	std::vector<uint8_t> m_Running; // 0xFF or 0, so it can be used as a lane mask
+	std::vector<uint16_t> m_Opcodes; // The instruction each instance is on this step
+	// The instances running the leader's opcode this step, as byte and 16 bit lane masks
+	std::vector<uint8_t> m_ByteMask;
+	std::vector<uint16_t> m_WordMask;
+	std::vector<uint32_t> m_Diverged; // Running instances on a different opcode to the leader this step
+
+	std::vector<InstanceState> m_Instances;
+	uint32_t m_MemorySize = 0, m_DisplayWords = 0;
+	// Instances in lockstep all read the same address at once, so their memory is staggered by a cache line. Without that, the
+	// pages are a power of two apart and every read lands in the same cache set, thrashing it.
+	uint32_t m_MemoryStride = 0;
+	std::unique_ptr<uint8_t[]> m_Memory;
+	std::unique_ptr<uint64_t[]> m_Display;
+
+	// Runs the diverged instances' instructions. Its memory and display are swapped for the instance's while it does.
+	Emulator m_Scratch;
+	uint8_t* m_ScratchMemory = nullptr;
+	uint64_t* m_ScratchDisplay = nullptr;
+
+	uint64_t m_VectorInstructions = 0, m_ScalarInstructions = 0;
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+enum class CompatibilityMode;
+enum class ExecutionBackend;
+
+// The built-in benchmark ROM, a CHIP-8 loop that touches every level of the dispatch tables. Also used by Chip8Bench.
+[[nodiscard]] const std::vector<uint8_t>& GetBenchmarkRom();
+
+// Runs a fixed, built-in ROM headlessly (no SDL, no window) for instructionCount instructions and reports the
+// backend's throughput in millions of instructions per second. Returns a process exit code.
+int RunBenchmark(uint64_t instructionCount, ExecutionBackend backend);
+
+// Runs a ROM (or the built-in benchmark ROM if romPath is empty) on the JIT and the interpreter side by side, in each of
+// the given modes in turn, comparing their state after every block of instructions. Returns a process exit code.
+int RunBackendDifferentialTest(const std::string& romPath, uint64_t instructionCount, const std::vector<CompatibilityMode>& modes);
@@ -61,12 +61,13 @@ char(*RtlpNumberOf(UNALIGNED T(&)[N]))[N];
 	#define C8_ASSERT_USED_FATAL     PPK_ASSERT_USED_FATAL
 	#define C8_ASSERT_USED_CUSTOM    PPK_ASSERT_USED_CUSTOM
 #else
-	#define C8_ASSERT                
-	#define C8_ASSERT_WARNING        
-	#define C8_ASSERT_DEBUG          
-	#define C8_ASSERT_ERROR          
-	#define C8_ASSERT_FATAL          
-	#define C8_ASSERT_CUSTOM         
+	// Expand to an empty statement rather than nothing, which would leave the bracketed arguments behind as an unused value
+	#define C8_ASSERT(...)           ((void)0)
+	#define C8_ASSERT_WARNING(...)   ((void)0)
+	#define C8_ASSERT_DEBUG(...)     ((void)0)
+	#define C8_ASSERT_ERROR(...)     ((void)0)
+	#define C8_ASSERT_FATAL(...)     ((void)0)
+	#define C8_ASSERT_CUSTOM(...)    ((void)0)
 	#define C8_ASSERT_USED           
 	#define C8_ASSERT_USED_WARNING   
 	#define C8_ASSERT_USED_DEBUG     
@@ -1,23 +1,150 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
 #include "spdlog/spdlog.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/fmt/ostr.h" // Needed for logging some types
 
+// Shared by every emulator, on any thread. Messages below the logger's level are dropped after a single atomic load, so
+// running many emulators at once with the level raised never contends on it. By default, messages that are written are
+// only formatted on the calling thread, then queued for a background thread to write out, so logging never waits on the
+// console or disk. Set up once by InitLog, which is safe to call from more than one thread, and never replaced.
 extern std::shared_ptr<spdlog::logger> s_Chip8EmulatorLogger;
 
-void InitLog(const char* prefPath);
-
-#ifndef C8_NO_LOG
-	#define C8_TRACE(...)       s_Chip8EmulatorLogger->trace(__VA_ARGS__)
-	#define C8_INFO(...)        s_Chip8EmulatorLogger->info(__VA_ARGS__)
-	#define C8_WARN(...)        s_Chip8EmulatorLogger->warn(__VA_ARGS__)
-	#define C8_ERROR(...)       s_Chip8EmulatorLogger->error(__VA_ARGS__)
-	#define C8_CRITICAL(...)    s_Chip8EmulatorLogger->critical(__VA_ARGS__)
-#else			 
-	#define C8_TRACE(...)      
-	#define C8_INFO(...)       
-	#define C8_WARN(...)       
-	#define C8_ERROR(...)      
-	#define C8_CRITICAL(...)   
+// Where log messages go. Tools that write their results to stdout log to stderr instead, and don't keep a log file.
+enum class LogTarget
+{
+	FileAndStdout,
+	Stderr
+};
+
+// How messages get to the sinks. Synchronous logging writes each message before the call returns, for when nothing can be
+// lost, e.g. when tracking down a crash.
+enum class LogMode
+{
+	Async,
+	Sync
+};
+
+void InitLog(const char* prefPath, LogTarget target = LogTarget::FileAndStdout, LogMode mode = LogMode::Async);
+// Writes out everything still queued and stops the log's background threads. Call it once at the end of main, after every
+// thread that logs has stopped; anything logged after it is dropped.
+void ShutdownLog();
+
+// Lets a call site log MaxMessages messages per Interval, and drops the rest, counting them so the next message that does
+// get logged can say how many were missed. This stops a ROM that hits the same warning every instruction from spending
+// all its time logging. Every C8_ log macro has one of its own; it's only consulted for messages at an enabled level.
+class LogRateLimiter
+{
+public:
+	static constexpr uint32_t MaxMessages = 10;
+	static constexpr std::chrono::steady_clock::duration Interval = std::chrono::seconds(1);
+
+	// Returns whether this message should be logged. If it should, suppressed is set to how many were dropped before it.
+	bool Allow(uint32_t& suppressed)
+	{
+		const int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+		int64_t windowStart = m_WindowStart.load(std::memory_order_relaxed);
+		// Only one thread gets to start the next window; the count is approximate across threads, which is fine for this
+		if (now - windowStart >= Interval.count() && m_WindowStart.compare_exchange_strong(windowStart, now, std::memory_order_relaxed))
+			m_Count.store(0, std::memory_order_relaxed);
+		if (m_Count.fetch_add(1, std::memory_order_relaxed) < MaxMessages)
+		{
+			suppressed = m_Suppressed.exchange(0, std::memory_order_relaxed);
+			return true;
+		}
+		m_Suppressed.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+private:
+	std::atomic<int64_t> m_WindowStart { INT64_MIN / 2 };
+	std::atomic<uint32_t> m_Count { 0 };
+	std::atomic<uint32_t> m_Suppressed { 0 };
+};
+
+// Compile-time log level. Every C8_ macro below it compiles to nothing, arguments and all, so it costs nothing at runtime,
+// not even the level check. Defaults to everything, but only info and up in Dist builds; C8_NO_LOG turns it all off.
+// The values match spdlog's levels.
+#define C8_LOG_LEVEL_TRACE    0
+#define C8_LOG_LEVEL_INFO     2
+#define C8_LOG_LEVEL_WARN     3
+#define C8_LOG_LEVEL_ERROR    4
+#define C8_LOG_LEVEL_CRITICAL 5
+#define C8_LOG_LEVEL_OFF      6
+
+#ifndef C8_LOG_LEVEL
+	#if defined(C8_NO_LOG)
+		#define C8_LOG_LEVEL C8_LOG_LEVEL_OFF
+	#elif defined(C8_DIST)
+		#define C8_LOG_LEVEL C8_LOG_LEVEL_INFO
+	#else
+		#define C8_LOG_LEVEL C8_LOG_LEVEL_TRACE
+	#endif
+#endif
+
+// The limiter is a static local, so every place the macro is used gets its own
+#define C8_LOG(level, ...) \
+	do \
+	{ \
+		if (s_Chip8EmulatorLogger->should_log(level)) \
+		{ \
+			static LogRateLimiter c8RateLimiter; \
+			uint32_t c8Suppressed = 0; \
+			if (c8RateLimiter.Allow(c8Suppressed)) \
+			{ \
+				if (c8Suppressed > 0) \
+					s_Chip8EmulatorLogger->log(level, "({0} more like the next were suppressed)", c8Suppressed); \
+				s_Chip8EmulatorLogger->log(level, __VA_ARGS__); \
+			} \
+		} \
+	} while (false)
+#define C8_LOG_NOTHING() do { } while (false)
+
+#if C8_LOG_LEVEL <= C8_LOG_LEVEL_TRACE
+	#define C8_TRACE(...)       C8_LOG(spdlog::level::trace, __VA_ARGS__)
+#else
+	#define C8_TRACE(...)       C8_LOG_NOTHING()
+#endif
+#if C8_LOG_LEVEL <= C8_LOG_LEVEL_INFO
+	#define C8_INFO(...)        C8_LOG(spdlog::level::info, __VA_ARGS__)
+#else
+	#define C8_INFO(...)        C8_LOG_NOTHING()
+#endif
+#if C8_LOG_LEVEL <= C8_LOG_LEVEL_WARN
+	#define C8_WARN(...)        C8_LOG(spdlog::level::warn, __VA_ARGS__)
+#else
+	#define C8_WARN(...)        C8_LOG_NOTHING()
+#endif
+#if C8_LOG_LEVEL <= C8_LOG_LEVEL_ERROR
+	#define C8_ERROR(...)       C8_LOG(spdlog::level::err, __VA_ARGS__)
+#else
+	#define C8_ERROR(...)       C8_LOG_NOTHING()
+#endif
+#if C8_LOG_LEVEL <= C8_LOG_LEVEL_CRITICAL
+	#define C8_CRITICAL(...)    C8_LOG(spdlog::level::critical, __VA_ARGS__)
+#else
+	#define C8_CRITICAL(...)    C8_LOG_NOTHING()
+#endif
+
+// Tracing from inside the interpreter's fetch/decode/execute loop, e.g. every instruction executed. It's a trace per
+// instruction, so it's far too slow to leave in: unless the build defines C8_ENABLE_HOT_TRACE (premake --hot-trace), these
+// compile to nothing, whatever C8_LOG_LEVEL is. When they are enabled, they're not rate limited, as a flood is the point.
+#if defined(C8_ENABLE_HOT_TRACE) && C8_LOG_LEVEL <= C8_LOG_LEVEL_TRACE
+	#define C8_HOT_TRACE_ENABLED 1
+	#define C8_HOT_TRACE(...)       s_Chip8EmulatorLogger->trace(__VA_ARGS__)
+	// Only traces if condition holds; the condition isn't evaluated at all when hot tracing is off
+	#define C8_HOT_TRACE_IF(condition, ...) \
+		do \
+		{ \
+			if (condition) \
+				s_Chip8EmulatorLogger->trace(__VA_ARGS__); \
+		} while (false)
+#else
+	#define C8_HOT_TRACE_ENABLED 0
+	#define C8_HOT_TRACE(...)       C8_LOG_NOTHING()
+	#define C8_HOT_TRACE_IF(...)    C8_LOG_NOTHING()
 #endif
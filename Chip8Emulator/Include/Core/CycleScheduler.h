@@ -0,0 +1,64 @@
+#pragma once
+
+// Returns nanoseconds from a monotonic clock. The starting point doesn't matter, only the differences between calls.
+using SchedulerClock = uint64_t(*)();
+
+// Works out how many instructions and timer ticks are owed from a monotonic clock, so the emulated machine runs at its
+// cycle rate however long each host frame actually took.
+// Instructions and timer ticks are both measured against a fixed starting point rather than added up frame by frame, and
+// the fraction of an instruction left over at the end of each batch is carried into the next, so nothing drifts over time.
+// The timers tick at exactly 60Hz whatever the cycle rate is.
+class CycleScheduler
+{
+public:
+	explicit CycleScheduler(SchedulerClock clock = &GetSteadyClockTime);
+
+	// Starts the timeline again from now, dropping anything owed. Call this after the machine has been paused or reset.
+	void Reset();
+
+	// Adds whatever has come due since the last call to the cycle credit, and returns how many timer ticks are owed.
+	// If the host falls more than MaxCatchUp behind (e.g. the process was suspended), the rest is dropped rather than
+	// run flat out to catch up.
+	uint32_t Advance(int cyclesPerSecond);
+	// Adds exactly one timer tick's worth of instructions to the cycle credit, whatever the clock says. For running in
+	// emulated time, e.g. fast-forwarding.
+	void AdvanceTick(int cyclesPerSecond);
+
+	// Instructions owed. Every backend stops exactly at the count it's given, so no more than this is ever consumed.
+	[[nodiscard]] FORCEINLINE uint64_t GetCycleCredit() const { return m_CycleCredit; }
+	FORCEINLINE void ConsumeCycles(const uint64_t cycles)
+	{
+		C8_ASSERT(cycles <= m_CycleCredit, "Consumed more cycles than were owed");
+		m_CycleCredit -= cycles;
+	}
+
+	// When the next timer tick is due, on the scheduler's clock
+	[[nodiscard]] uint64_t GetNextTickTime() const;
+	// Sleeps until the clock reaches deadline. Sleeps coarsely for most of the wait, then spins for the last stretch, since
+	// OS sleeps can wake up late by a millisecond or more. The spin margin follows how late sleeps have actually been.
+	void WaitUntil(uint64_t deadline);
+
+	[[nodiscard]] FORCEINLINE uint64_t Now() const { return m_Clock(); }
+
+	static uint64_t GetSteadyClockTime();
+
+	static constexpr uint64_t NanosecondsPerSecond = 1'000'000'000;
+	static constexpr uint32_t TimerFrequency = 60;
+	static constexpr uint64_t MaxCatchUp = NanosecondsPerSecond / 4;
+
+protected:
+	SchedulerClock m_Clock;
+
+	uint64_t m_LastTime = 0;      // When Advance last ran
+	uint64_t m_CycleRemainder = 0; // Leftover fraction of an instruction, in instruction-nanoseconds (i.e. out of NanosecondsPerSecond)
+	uint64_t m_CycleCredit = 0;
+	uint64_t m_TickRemainder = 0; // Leftover fraction of an instruction from AdvanceTick, out of TimerFrequency
+
+	uint64_t m_TimerEpoch = 0;    // Tick n is due at m_TimerEpoch + n / TimerFrequency seconds
+	uint64_t m_TimerTicks = 0;    // Ticks handed out since m_TimerEpoch
+
+	uint64_t m_SpinMargin = 2'000'000; // Starts wide, and narrows once sleeps have shown how late they wake up
+
+	static constexpr uint64_t MinSpinMargin = 500'000;   // 0.5ms
+	static constexpr uint64_t MaxSpinMargin = 4'000'000; // 4ms
+};
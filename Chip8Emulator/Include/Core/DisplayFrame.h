@@ -0,0 +1,29 @@
+#pragma once
+
+// A copy of the emulator's display, taken once per frame for presenting, in the same bit-packed layout as the emulator's own.
+// Presenting works from a copy so that the emulator can carry on drawing the next frame while this one is on its way to the screen.
+struct DisplayFrame
+{
+	uint16_t Width = 0, Height = 0; // 0 until the emulator has a display to copy
+	uint16_t RowWords = 0;
+	uint8_t Planes = 0;
+	std::vector<uint64_t> Pixels; // Planes planes of Height rows of RowWords words, see Emulator::m_Display
+	uint64_t DirtyRows[4] = { 0 }; // Rows changed since the previous capture
+
+	[[nodiscard]] FORCEINLINE bool IsRowDirty(const uint16_t y) const { return DirtyRows[y / 64] >> (y % 64) & 1; }
+	[[nodiscard]] FORCEINLINE bool HasDirtyRows() const { return (DirtyRows[0] | DirtyRows[1] | DirtyRows[2] | DirtyRows[3]) != 0; }
+	FORCEINLINE void MarkAllDirty() { memset(DirtyRows, 0xFF, sizeof(DirtyRows)); }
+
+	// Combines the bitplanes of rowCount rows starting at firstRow into a colour per pixel. pixels is where firstRow goes.
+	// The palette needs an entry for every combination of planes (1 << Planes).
+	void ResolveRows(uint32_t* pixels, const uint32_t* palette, uint16_t firstRow, uint16_t rowCount) const;
+	FORCEINLINE void Resolve(uint32_t* pixels, const uint32_t* palette) const { ResolveRows(pixels, palette, 0, Height); }
+
+	// ARGB, in the order of Octo's XO-Chip colours: background, plane 1, plane 2, both, then extras for the other two planes
+	static constexpr uint32_t DefaultPalette[16] = {
+		0xFF000000, 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555,
+		0xFFFF0000, 0xFF00FF00, 0xFF0000FF, 0xFFFFFF00,
+		0xFF880000, 0xFF008800, 0xFF000088, 0xFF888800,
+		0xFFFF00FF, 0xFF00FFFF, 0xFF880088, 0xFF008888
+	};
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "Core/CycleScheduler.h"
+#include "Core/DisplayFrame.h"
+#include "Core/Emulator.h"
+#include "Core/OpcodeProfiler.h"
+#include "Core/RewindBuffer.h"
+#include "Core/SpscQueue.h"
+#include "Core/TripleBuffer.h"
+
+// Something for the emulation thread to do, sent from the UI thread. Everything that changes the emulator goes through these,
+// so the emulator is only ever touched by one thread.
+struct EmulatorInput
+{
+	enum class Type : uint8_t
+	{
+		Key,               // Key pressed or released
+		CompatibilityMode, // Switch mode, which resets the emulator
+		ExecutionBackend,
+		DebugLogs,
+		CyclesPerSecond,
+		Turbo,             // Fast-forward on or off
+		SaveState,         // Save to the quick save slot
+		LoadState,         // Load from the quick save slot
+		Rewind,            // Rewinding held or released
+		Profile            // Opcode profiling on or off, see OpcodeProfiler. Turning it on starts a new profile.
+	};
+
+	Type InputType = Type::Key;
+	uint8_t Key = 0;
+	bool Pressed = false; // Key state, or whether debug logs, turbo, rewinding or profiling are on
+	uint32_t Value = 0;   // The mode, backend or cycle rate
+};
+
+// Everything the UI needs from one emulated frame
+struct EmulatorFrame
+{
+	uint64_t Sequence = 0; // Counts up by one per frame, so the consumer can tell when it has missed some
+	DisplayFrame Display;
+	CompatibilityMode Mode = CompatibilityMode::Chip8;
+	ExecutionBackend Backend = ExecutionBackend::Interpreter;
+	int CyclesPerSecond = 0;
+	bool Running = false;
+	bool DebugLogs = false;
+	bool Turbo = false; // Actually fast-forwarding, i.e. turbo is on and the emulator is running
+	bool HasSaveState = false; // Whether there's anything in the quick save slot
+	bool Rewinding = false;
+	float RewindSeconds = 0.0f; // How far back rewinding can go
+	EmulatorFault Fault = EmulatorFault::None;
+	uint64_t InstructionCount = 0; // Executed since the thread started
+	float SpeedMultiplier = 0.0f;  // Emulated time over wall time, measured over the last StatsInterval
+	float Mips = 0.0f;             // Millions of instructions per wall second, likewise
+	bool Profiling = false;
+	OpcodeProfile Profile; // While profiling, as of the last StatsInterval
+};
+
+// Runs an emulator on its own thread at its cycle rate, ticking the timers at 60Hz, paced by a CycleScheduler.
+// Once each timer tick's worth of instructions has run, the frame is published through a triple buffer, and the UI thread picks
+// up the newest one whenever it's ready to draw. Input goes the other way through a single producer/single consumer queue.
+// Neither thread ever waits on the other, so a slow present or vsync stall on the UI thread can't cost emulated cycles.
+// In turbo, frames are run back to back as fast as the host allows, with the timers ticking once per emulated frame, and
+// every one is published; it's up to the UI to skip the ones it can't keep up with.
+// Every frame is snapshotted into a RewindBuffer, and while rewinding is held, each tick steps back one snapshot instead
+// of running, so history plays backwards at the speed it was recorded.
+class EmulationThread
+{
+public:
+	// The emulator belongs to the thread while it's running; don't touch it from anywhere else until Stop.
+	// clock is what the scheduler paces the emulator by, see CycleScheduler
+	explicit EmulationThread(Emulator& emulator, SchedulerClock clock = &CycleScheduler::GetSteadyClockTime);
+	~EmulationThread();
+
+	EmulationThread(const EmulationThread&) = delete;
+	EmulationThread& operator=(const EmulationThread&) = delete;
+
+	void Start();
+	void Stop();
+	[[nodiscard]] FORCEINLINE bool IsStarted() const { return m_Thread.joinable(); }
+
+	// UI thread only. Returns false if the queue is full, in which case the input is dropped.
+	bool PushInput(const EmulatorInput& input);
+	// UI thread only. Hands a ROM over to be loaded before the next frame, in mode and at cyclesPerSecond, or the current rate
+	// if that's 0. Replaces any ROM handed over before that hasn't been loaded yet.
+	void LoadRom(std::vector<uint8_t> rom, CompatibilityMode mode, int cyclesPerSecond);
+
+	// UI thread only. Picks up the newest completed frame, returning false if there hasn't been one since the last call.
+	bool AcquireFrame();
+	// The frame picked up by the last successful AcquireFrame. Stays valid until the next one.
+	[[nodiscard]] FORCEINLINE const EmulatorFrame& GetFrame() const { return m_Frames.GetReadBuffer(); }
+
+	static constexpr int FramesPerSecond = 60;
+	static constexpr uint64_t StatsInterval = CycleScheduler::NanosecondsPerSecond / 2;
+	// Turbo runs frames far faster than they can be watched, so it only snapshots one per this much wall time
+	static constexpr uint64_t TurboSnapshotInterval = CycleScheduler::NanosecondsPerSecond / FramesPerSecond;
+
+protected:
+	void ThreadMain();
+	void ProcessInput(const EmulatorInput& input);
+	void LoadPendingRom();
+	void RunCycles(uint64_t count);
+	void RunTurboFrame();
+	// Runs a timer tick's worth of instructions, then ticks the timers
+	void RunFrame(uint64_t cycles);
+	void RewindFrame(uint64_t cycles);
+	void PublishFrame();
+	void UpdateStats();
+
+	Emulator& m_Emulator;
+	std::thread m_Thread;
+	std::atomic<bool> m_StopRequested { false };
+	CycleScheduler m_Scheduler;
+
+	SpscQueue<EmulatorInput, 256> m_Inputs;
+	// ROMs are too big to go through m_Inputs, so the newest one waits here. It's rare enough that a lock doesn't matter.
+	std::mutex m_PendingRomMutex;
+	std::vector<uint8_t> m_PendingRom;
+	CompatibilityMode m_PendingRomMode = CompatibilityMode::Chip8;
+	int m_PendingRomCyclesPerSecond = 0;
+	std::atomic<bool> m_HasPendingRom { false };
+	TripleBuffer<EmulatorFrame> m_Frames;
+	uint64_t m_FrameSequence = 0;
+	uint64_t m_InstructionCount = 0;
+
+	bool m_TurboRequested = false, m_InTurbo = false;
+
+	// The quick save slot. Kept around so saving again reuses its buffer, which makes saving every frame cheap.
+	std::vector<uint8_t> m_SaveState;
+
+	RewindBuffer m_Rewind;
+	bool m_Rewinding = false;
+	uint64_t m_LastTurboSnapshotTime = 0;
+
+	// Speed measurement, see StatsInterval
+	uint64_t m_StatsStartTime = 0, m_StatsStartInstructions = 0, m_StatsEmulatedFrames = 0;
+	float m_SpeedMultiplier = 0.0f, m_Mips = 0.0f;
+
+	// Only exists while profiling. Its snapshot is taken with the stats, as it's too slow to take every frame.
+	std::unique_ptr<OpcodeProfiler> m_Profiler;
+	OpcodeProfile m_Profile;
+};
@@ -1,5 +1,12 @@
 #pragma once
 
+struct DecodedInstruction;
+struct DisplayFrame;
+struct InterpreterVariant;
+struct AotProgram;
+class Jit;
+class OpcodeProfiler;
+
 enum class CompatibilityMode
 {
 	Chip8,
@@ -35,19 +42,122 @@ FORCEINLINE const char* GetCompatibilityModeName(CompatibilityMode mode)
 	}
 }
 
+// Why the emulator stopped, when it was the program's fault
+enum class EmulatorFault
+{
+	None,
+	InvalidOpcode,
+	StackOverflow,
+	StackUnderflow
+};
+
+FORCEINLINE const char* GetEmulatorFaultName(EmulatorFault fault)
+{
+	switch (fault)
+	{
+	case EmulatorFault::None:
+		return "None";
+	case EmulatorFault::InvalidOpcode:
+		return "Invalid opcode";
+	case EmulatorFault::StackOverflow:
+		return "Stack overflow";
+	case EmulatorFault::StackUnderflow:
+		return "Stack underflow";
+	default:
+		return "Unknown";
+	}
+}
+
+// How instructions are executed. The interpreter is the reference implementation; the others must always match it.
+enum class ExecutionBackend
+{
+	Interpreter,
+	Jit,
+	Aot, // ROMs compiled by chip8-aot into this binary, and the interpreter for anything else
+	NumBackends
+};
+
+FORCEINLINE const char* GetExecutionBackendName(ExecutionBackend backend)
+{
+	switch (backend)
+	{
+	case ExecutionBackend::Interpreter:
+		return "Interpreter";
+	case ExecutionBackend::Jit:
+		return "JIT";
+	case ExecutionBackend::Aot:
+		return "AOT";
+	default:
+		return "Unknown";
+	}
+}
+
 class Emulator
 {
 	friend class Shell;
+	friend class Interpreter;
+	friend class Jit;
+	friend class BatchEmulator;
+	friend class CoreBenchmarks; // Chip8Bench, which times some of the internals on their own
+	template <uint64_t Key> // Statically recompiled ROMs, see Aot.h
+	friend uint64_t AotRun(Emulator& emulator, uint64_t instructionCount);
 
 public:
+	Emulator();
+	~Emulator();
+
+	Emulator(const Emulator&) = delete;
+	Emulator& operator=(const Emulator&) = delete;
+
 	[[nodiscard]] FORCEINLINE CompatibilityMode GetCompatibilityMode() const { return m_CompatibilityMode; }
 	void SetCompatibilityMode(CompatibilityMode mode);
 
+	[[nodiscard]] FORCEINLINE ExecutionBackend GetExecutionBackend() const { return m_ExecutionBackend; }
+	// Falls back to the interpreter if the JIT isn't supported on this platform.
+	void SetExecutionBackend(ExecutionBackend backend);
+	// With the AOT backend, whether the loaded ROM was compiled into this binary and is running natively.
+	[[nodiscard]] FORCEINLINE bool IsRunningAotProgram() const { return m_AotProgram != nullptr; }
+
+	// Counts what the program executes into profiler, until it's set back to null. It's not owned, and isn't passed on to
+	// forks. The JIT and AOT backends don't execute an instruction at a time, so while it's set the interpreter runs instead.
+	FORCEINLINE void SetProfiler(OpcodeProfiler* const profiler) { m_Profiler = profiler; }
+	[[nodiscard]] FORCEINLINE OpcodeProfiler* GetProfiler() const { return m_Profiler; }
+
+	[[nodiscard]] FORCEINLINE bool IsRunning() const { return m_Running; }
+	// The fault that stopped the program, and the address of the instruction that caused it
+	[[nodiscard]] FORCEINLINE EmulatorFault GetFault() const { return m_Fault; }
+	[[nodiscard]] FORCEINLINE uint16_t GetFaultAddress() const { return m_FaultAddress; }
+
+	// Read-only access to the program's state, for tools that report on it
+	[[nodiscard]] FORCEINLINE uint16_t GetProgramCounter() const { return m_ProgramCounter; }
+	[[nodiscard]] FORCEINLINE uint16_t GetIRegister() const { return m_IRegister; }
+	[[nodiscard]] FORCEINLINE uint8_t GetVRegister(const uint8_t index) const { return m_VRegisters[index & 0xF]; }
+	[[nodiscard]] FORCEINLINE uint8_t GetDelayTimer() const { return m_DelayTimer; }
+	[[nodiscard]] FORCEINLINE uint8_t GetSoundTimer() const { return m_SoundTimer; }
+	[[nodiscard]] FORCEINLINE uint8_t GetStackPointer() const { return m_StackPointer; }
+	[[nodiscard]] FORCEINLINE const uint8_t* GetMemory() const { return m_Memory; }
+	[[nodiscard]] FORCEINLINE uint32_t GetMemorySize() const { return m_CurrentMemorySize; }
+
+	// Pages of memory written to since ClearDirtyPages, by the program or anything else, so snapshots and viewers only have
+	// to look at what's changed. Like the dirty rows, there's one set of these, so only one consumer should clear them.
+	static constexpr uint32_t MemoryPageSize = 256;
+	static constexpr uint32_t MaxMemoryPages = 65536 / MemoryPageSize;
+	[[nodiscard]] FORCEINLINE uint32_t GetMemoryPageCount() const { return m_CurrentMemorySize / MemoryPageSize; }
+	[[nodiscard]] FORCEINLINE bool IsPageDirty(const uint32_t page) const { return m_DirtyPages[page / 64] >> (page % 64) & 1; }
+	[[nodiscard]] FORCEINLINE bool HasDirtyPages() const { return (m_DirtyPages[0] | m_DirtyPages[1] | m_DirtyPages[2] | m_DirtyPages[3]) != 0; }
+	// A bit per page, MaxMemoryPages of them, 64 to a word from the least significant bit
+	[[nodiscard]] FORCEINLINE const uint64_t* GetDirtyPages() const { return m_DirtyPages; }
+	FORCEINLINE void ClearDirtyPages() { memset(m_DirtyPages, 0, sizeof(m_DirtyPages)); }
+
 	// TODO: Ability to load empty rom for editing
 	void LoadRom(CompatibilityMode mode, const std::string& path);
 	void LoadRom(CompatibilityMode mode, const std::vector<uint8_t>& bytes);
+	void LoadRom(CompatibilityMode mode, const uint8_t* bytes, size_t size);
+	// The file is memory-mapped, so the ROM is copied once, straight from it into memory at 0x200
 	void LoadRom(const std::string& path);
-	void LoadRomFromBytes(const std::vector<uint8_t>& bytes);
+	// Resets the emulator and copies the ROM into memory at 0x200. The bytes only need to live for the call.
+	void LoadRomFromBytes(const uint8_t* bytes, size_t size);
+	FORCEINLINE void LoadRomFromBytes(const std::vector<uint8_t>& bytes) { LoadRomFromBytes(bytes.data(), bytes.size()); }
 
 	bool WriteToMemory(int offset, const void* data, size_t size);
 	FORCEINLINE bool WriteToMemory(int offset, const std::vector<uint8_t>& data)
@@ -55,34 +165,158 @@ public:
 		return WriteToMemory(offset, data.data(), data.size());
 	}
 
+	// Executes up to instructionCount instructions, returning how many were actually executed.
+	uint64_t Step(uint64_t instructionCount = 1);
+	// Decrements the delay and sound timers. Should be called at 60Hz, independently of the instruction rate.
+	void TickTimers();
+	void SetKeyState(uint8_t key, bool pressed);
+	FORCEINLINE void SetRandomSeed(const uint32_t seed) { m_RandomState = seed != 0 ? seed : 1; }
+	[[nodiscard]] FORCEINLINE int GetCyclesPerSecond() const { return m_CyclesPerSecond; }
+	FORCEINLINE void SetCyclesPerSecond(const int cyclesPerSecond) { m_CyclesPerSecond = std::max(cyclesPerSecond, 1); }
+	[[nodiscard]] FORCEINLINE bool AreDebugLogsEnabled() const { return m_DebugLogs; }
+	FORCEINLINE void SetDebugLogs(const bool enabled) { m_DebugLogs = enabled; }
+
+	[[nodiscard]] FORCEINLINE uint16_t GetDisplayWidth() const { return m_DisplayWidth; }
+	[[nodiscard]] FORCEINLINE uint16_t GetDisplayHeight() const { return m_DisplayHeight; }
+	[[nodiscard]] FORCEINLINE uint8_t GetDisplayPlanes() const { return m_DisplayPlanes; }
+	[[nodiscard]] FORCEINLINE bool IsHiRes() const { return m_HiRes; }
+	// The packed display, see m_Display: GetDisplayPlanes() planes of GetDisplayHeight() rows of GetDisplayRowWords() words
+	[[nodiscard]] FORCEINLINE const uint64_t* GetDisplayData() const { return m_Display; }
+	[[nodiscard]] FORCEINLINE uint16_t GetDisplayRowWords() const { return m_DisplayRowWords; }
+	// One bit per bitplane the pixel is set in, which is also its index into a palette
+	[[nodiscard]] FORCEINLINE uint8_t GetPixelPlanes(const uint16_t x, const uint16_t y) const
+	{
+		const uint32_t planeWords = m_DisplayRowWords * m_DisplayHeight;
+		const uint64_t* word = m_Display + y * m_DisplayRowWords + x / 64;
+		uint8_t planes = 0;
+		for (uint8_t plane = 0; plane < m_DisplayPlanes; plane++)
+			planes |= static_cast<uint8_t>((word[plane * planeWords] >> (63 - x % 64) & 1) << plane);
+		return planes;
+	}
+	[[nodiscard]] FORCEINLINE bool IsPixelSet(const uint16_t x, const uint16_t y) const { return GetPixelPlanes(x, y) != 0; }
+	// Copies the display into frame for presenting, along with the rows that have changed since the last capture, then clears those.
+	void CaptureDisplay(DisplayFrame& frame);
+
+	// Rows of the display that have changed since ClearDirtyRows, so a presenter only has to upload those.
+	[[nodiscard]] FORCEINLINE bool IsRowDirty(const uint16_t y) const { return m_DirtyRows[y / 64] >> (y % 64) & 1; }
+	[[nodiscard]] FORCEINLINE bool HasDirtyRows() const { return (m_DirtyRows[0] | m_DirtyRows[1] | m_DirtyRows[2] | m_DirtyRows[3]) != 0; }
+	FORCEINLINE void ClearDirtyRows() { memset(m_DirtyRows, 0, sizeof(m_DirtyRows)); }
+	// Marks the whole display as changed, e.g. when the presenter has lost its copy of it.
+	FORCEINLINE void MarkDisplayDirty() { MarkRowsDirty(0, m_DisplayHeight); }
+
+	// Compares everything a program can observe: registers, timers, stack, memory and display. Used to check backends against each other.
+	[[nodiscard]] bool HasSameState(const Emulator& other) const;
+
+	// Save states hold everything HasSameState compares, plus what's needed to carry on exactly where it left off; see SaveState.h.
+	// The keypad isn't included, so loading a state doesn't change what the player is holding down.
+	[[nodiscard]] size_t GetSaveStateSize() const;
+	// Writes a save state in one pass into buffer. Returns the size written, or 0 if there's nothing to save or it doesn't fit.
+	size_t SaveState(uint8_t* buffer, size_t bufferSize) const;
+	// Resizes state to fit and writes into it. Only allocates if state hasn't held one this big before.
+	bool SaveState(std::vector<uint8_t>& state) const;
+	// Restores a save state, switching compatibility mode first if it was taken in a different one. Returns false if the state
+	// is invalid: the header is checked before anything changes, and the sizes in it against the mode's buffers once it's switched to.
+	bool LoadState(const uint8_t* data, size_t size);
+	FORCEINLINE bool LoadState(const std::vector<uint8_t>& state) { return LoadState(state.data(), state.size()); }
+
+	// Makes child an exact copy of this emulator's state, e.g. for trying out inputs ahead of time. The child keeps its own
+	// execution backend. Nothing is shared, so writes in a child never show up anywhere else, but a child that was last
+	// forked from this emulator only copies back the memory pages either of them has written to since, rather than all of
+	// it. So for searching ahead many times a frame, keep a pool of children and fork into those over and over.
+	void ForkInto(Emulator& child) const;
+	// Forks into a new emulator on the same backend. This has to copy all of memory; see ForkInto.
+	[[nodiscard]] std::unique_ptr<Emulator> Fork() const;
+
 protected:
 	void FDE();
 	void Initialise();
 	void CreateBuffers();
+	// The sizes of everything CreateBuffers makes for a mode. Returns false for an unknown mode.
+	struct ModeLayout
+	{
+		uint32_t MemorySize;
+		uint16_t DisplayWidth, DisplayHeight;
+		uint8_t DisplayPlanes;
+		uint8_t StackDepth;
+
+		[[nodiscard]] FORCEINLINE uint32_t GetDisplayWords() const { return DisplayPlanes * (DisplayWidth / 64u) * DisplayHeight; }
+	};
+	[[nodiscard]] static bool GetModeLayout(CompatibilityMode mode, ModeLayout& layout);
 	void ResetEmulatorState();
 	void ZeroMem();
 	void ZeroDisplay();
 	void AddFontToMemory();
 
+	// Must be called whenever memory is written to, so cached decodes and translated code don't go stale. Marks the pages
+	// written to as dirty, too.
+	void InvalidateCode(uint32_t address, uint32_t size);
+	// Marks every page dirty, for when all of memory has been replaced
+	void MarkMemoryDirty();
+	// Copies memory and the decode cache's validity from source, which has the same layout, see ForkInto
+	void CopyMemoryFrom(const Emulator& source);
+	// Throws away all cached decodes and translated code, e.g. after the memory buffer has been recreated.
+	void ResetCode();
+	void FindAotProgram();
+	// Stops the emulator, recording why. The program counter should already point past the faulting instruction.
+	void RaiseFault(EmulatorFault fault);
+	void MarkRowsDirty(uint16_t firstRow, uint16_t rowCount);
+
+	static constexpr uint16_t FontAddress = 0x050;
+	static constexpr uint16_t BigFontAddress = 0x0A0; // SUPER-CHIP 8x10 font, straight after the regular one
+	static constexpr uint8_t MaxStackDepth = 64; // Deepest stack of any mode; m_StackDepth is the current mode's
+	static constexpr uint8_t MaxPlanes = 4; // XO-Chip bitplanes, selected with FN01
+	static constexpr uint16_t MaxDisplayHeight = 256;
+
 	// --------------
 	// Emulator state
 	// --------------
 	bool m_Running = false;
 	uint8_t* m_Memory = nullptr;
 	uint32_t m_CurrentMemorySize = 0;
+	uint32_t m_RomSize = 0; // Size of the ROM last loaded at 0x200
+	DecodedInstruction* m_DecodeCache = nullptr; // One entry per even address in m_Memory, see Interpreter
+	uint64_t m_StaleDecodePages[MaxMemoryPages / 64] = { 0 }; // One bit per page whose decode cache entries the interpreter resets before it next runs
 	uint16_t m_ProgramCounter = 0x200;
 	uint16_t m_IRegister = 0;
-	std::stack<uint16_t> m_Stack;
+	uint16_t m_Stack[MaxStackDepth] = { 0 };
+	uint8_t m_StackPointer = 0; // Number of return addresses on m_Stack
+	uint8_t m_StackDepth = 16; // Set per mode by CreateBuffers
 	uint8_t m_DelayTimer = 0;
 	uint8_t m_SoundTimer = 0;
 	uint8_t m_VRegisters[16] = { 0 };
-	uint8_t* m_Display = nullptr;
+	uint8_t m_FlagRegisters[16] = { 0 }; // SUPER-CHIP RPL user flags, FX75/FX85
+	uint64_t* m_Display = nullptr; // One bit per pixel, m_DisplayRowWords words per row. The most significant bit of a row's first word is its leftmost pixel.
 	uint16_t m_DisplayWidth = 64, m_DisplayHeight = 32;
+	uint16_t m_DisplayRowWords = 1; // Widths are always a multiple of 64, so rows never share a word
+	uint8_t m_DisplayPlanes = 1; // Bitplanes in m_Display, one after the other
+	uint8_t m_PlaneMask = 1; // The planes that are drawn to, scrolled and cleared, set by FN01
+	uint64_t m_DirtyRows[MaxDisplayHeight / 64] = { 0 }; // One bit per display row changed since the last present. Not part of the program's state.
+	uint64_t m_DirtyPages[MaxMemoryPages / 64] = { 0 }; // One bit per page of memory written since ClearDirtyPages, likewise
+	// Memory write versions, for ForkInto. m_MemoryVersion counts up with every write, and each page has the version it
+	// was last written at. m_MemoryId is unique to each memory buffer created, across all emulators.
+	uint64_t m_MemoryId = 0;
+	uint64_t m_MemoryVersion = 0;
+	uint64_t m_PageVersions[MaxMemoryPages] = { 0 };
+	// What this emulator's memory was last forked from: the source's buffer and version, and this one's version, at the time
+	uint64_t m_ForkSourceId = 0, m_ForkSourceVersion = 0, m_ForkVersion = 0;
+	uint8_t m_AudioPattern[16] = { 0 }; // XO-Chip 1 bit audio samples, loaded by F002
+	uint8_t m_AudioPitch = 64; // XO-Chip playback rate of m_AudioPattern, set by FX3A. 64 is 4000Hz.
+	bool m_HiRes = false; // On displays bigger than 64x32, lo-res mode draws each pixel as a block of display pixels
+	uint16_t m_KeyStates = 0; // One bit per key, 0x0-0xF
+	uint8_t m_WaitingKey = 0xFF; // Key pressed during FX0A, which completes once it's released. 0xFF when not waiting.
+	uint32_t m_RandomState = 0xC8C8C8C8; // xorshift32 state for CXNN
+	EmulatorFault m_Fault = EmulatorFault::None;
+	uint16_t m_FaultAddress = 0;
 
 	// -----------------
 	// Emulator settings
 	// -----------------
 	CompatibilityMode m_CompatibilityMode = CompatibilityMode::Chip8;
+	const InterpreterVariant* m_Interpreter = nullptr; // The interpreter compiled for this mode's quirks, set by Initialise
+	ExecutionBackend m_ExecutionBackend = ExecutionBackend::Interpreter;
+	std::unique_ptr<Jit> m_Jit; // Only exists while the JIT backend is selected
+	const AotProgram* m_AotProgram = nullptr; // The loaded ROM's compiled code, if the AOT backend is selected and it has any
+	OpcodeProfiler* m_Profiler = nullptr;
 	int m_CyclesPerSecond = 700;
 	
 #ifdef C8_DEBUG
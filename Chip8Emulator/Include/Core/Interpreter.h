@@ -0,0 +1,172 @@
+#pragma once
+
+#include "Core/Quirks.h"
+
+// Forward declaration of Emulator
+class Emulator;
+enum class CompatibilityMode;
+struct DecodedInstruction;
+
+// Every opcode handler has this signature. The instruction has already been fetched and decoded, and the program
+// counter already points at the next instruction by the time a handler runs.
+using OpcodeHandler = void(*)(Emulator& emulator, const DecodedInstruction& instruction);
+
+// An instruction with its handler resolved and its operands extracted.
+// The emulator keeps one of these per even address in memory (the decode cache), so an instruction is only decoded
+// the first time it runs after being written to memory.
+struct DecodedInstruction
+{
+	OpcodeHandler Handler;
+	uint16_t Opcode;
+	uint16_t NNN;
+	uint8_t X, Y, N, NN;
+};
+static_assert(sizeof(DecodedInstruction) <= 16, "DecodedInstruction should stay small enough that four fit in a cache line");
+
+// One instantiation of the interpreter, compiled for a fixed set of quirks.
+// The emulator holds a pointer to the variant for its compatibility mode, so switching modes is a single pointer swap.
+struct InterpreterVariant
+{
+	uint32_t Quirks;
+	uint64_t (*Run)(Emulator& emulator, uint64_t instructionCount);
+	uint64_t (*RunProfiled)(Emulator& emulator, uint64_t instructionCount); // Run, reporting to the emulator's OpcodeProfiler
+	DecodedInstruction (*Decode)(uint16_t opcode);
+	OpcodeHandler Undecoded;
+};
+
+// Table-driven CHIP-8 interpreter.
+// Instead of one big nested switch, opcodes are decoded on their top nibble through a 16 entry table.
+// The groups that can't be identified by the top nibble alone (0x00__, 0x8XY_, 0xEX__ and 0xFX__) have their own second-level tables.
+// Decoding resolves all the way down to the final handler, so a cached instruction costs a single indirect call to execute.
+//
+// Handlers whose behaviour differs between modes are templated on a QuirkSet, and so are the tables, so each variant
+// only contains the handlers its mode needs and never checks the compatibility mode at runtime.
+class Interpreter
+{
+public:
+	[[nodiscard]] static const InterpreterVariant& GetVariant(CompatibilityMode mode);
+
+	// Fetches, decodes and executes a single instruction.
+	static void Step(Emulator& emulator);
+	// Runs up to instructionCount instructions, stopping early if the emulator stops running. Returns the number executed.
+	// The Profiled instantiation also counts and samples each instruction into the emulator's OpcodeProfiler, which must be set.
+	template <typename Quirks, bool Profiled>
+	static uint64_t Run(Emulator& emulator, uint64_t instructionCount);
+
+	template <typename Quirks>
+	[[nodiscard]] static DecodedInstruction Decode(uint16_t opcode);
+	[[nodiscard]] static FORCEINLINE bool IsValid(const DecodedInstruction& instruction) { return instruction.Handler != &Op_Invalid; }
+
+	// Decodes and executes an opcode that isn't fetched from memory, for code translated ahead of time (see Aot.h).
+	// The program counter should already point at the next instruction, as it would for a fetched one.
+	static void Execute(Emulator& emulator, uint16_t opcode);
+
+	// Marks every cached instruction as needing to be decoded again.
+	static void ResetDecodeCache(Emulator& emulator);
+	// Marks the cached instructions overlapping [address, address + size) as needing to be decoded again.
+	// Emulator::InvalidateCode calls this whenever memory is written to, or self-modifying programs would run stale instructions.
+	// Whole pages, as loading a state or forking replaces, are only marked stale, and their entries reset when the
+	// interpreter next runs. However many states are loaded in the meantime, e.g. while rewinding, it's only done once.
+	static void InvalidateDecodeCache(Emulator& emulator, uint32_t address, uint32_t size);
+
+	[[nodiscard]] static FORCEINLINE uint8_t GetX(const uint16_t opcode)    { return (opcode >> 8) & 0xF; }
+	[[nodiscard]] static FORCEINLINE uint8_t GetY(const uint16_t opcode)    { return (opcode >> 4) & 0xF; }
+	[[nodiscard]] static FORCEINLINE uint8_t GetN(const uint16_t opcode)    { return opcode & 0xF; }
+	[[nodiscard]] static FORCEINLINE uint8_t GetNN(const uint16_t opcode)   { return opcode & 0xFF; }
+	[[nodiscard]] static FORCEINLINE uint16_t GetNNN(const uint16_t opcode) { return opcode & 0xFFF; }
+
+private:
+	static void ResetStaleDecodePages(Emulator& emulator);
+
+	// Sits in every decode cache entry that hasn't been decoded yet; decodes the instruction, caches it, then runs it.
+	template <typename Quirks>
+	static void Op_Undecoded(Emulator& emulator, const DecodedInstruction& instruction);
+
+	// First level handlers, indexed by the top nibble
+	static void Op_1NNN(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_2NNN(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_3XNN(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_4XNN(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_5XY0(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_6XNN(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_7XNN(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_9XY0(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_5XY2(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_5XY3(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_ANNN(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_BNNN(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_CXNN(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_DXYN(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_DXY0(Emulator& emulator, const DecodedInstruction& instruction);
+
+	// 0x00__, indexed by the low byte
+	static void Op_00CN(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_00DN(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_00E0(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_00EE(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_00FB(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_00FC(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_00FD(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_00FE(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_00FF(Emulator& emulator, const DecodedInstruction& instruction);
+
+	// 0x8XY_, indexed by the low nibble
+	static void Op_8XY0(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_8XY1(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_8XY2(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_8XY3(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_8XY4(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_8XY5(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_8XY6(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_8XY7(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_8XYE(Emulator& emulator, const DecodedInstruction& instruction);
+
+	// 0xEX__, indexed by the low byte
+	template <typename Quirks>
+	static void Op_EX9E(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_EXA1(Emulator& emulator, const DecodedInstruction& instruction);
+
+	// 0xFX__, indexed by the low byte
+	static void Op_F000(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_FN01(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_F002(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_FX07(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_FX0A(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_FX15(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_FX18(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_FX1E(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_FX29(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_FX30(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_FX33(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_FX3A(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_FX55(Emulator& emulator, const DecodedInstruction& instruction);
+	template <typename Quirks>
+	static void Op_FX65(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_FX75(Emulator& emulator, const DecodedInstruction& instruction);
+	static void Op_FX85(Emulator& emulator, const DecodedInstruction& instruction);
+
+	static void Op_Invalid(Emulator& emulator, const DecodedInstruction& instruction);
+
+	// Skips the instruction at the program counter. On XO-Chip that can be the 4 byte F000 NNNN.
+	template <typename Quirks>
+	static void SkipNextInstruction(Emulator& emulator);
+	template <typename Quirks>
+	static void DrawSprite(Emulator& emulator, const DecodedInstruction& instruction, uint8_t rows, bool wide);
+
+	template <typename Quirks>
+	struct DispatchTables;
+};
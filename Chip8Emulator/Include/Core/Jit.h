@@ -0,0 +1,117 @@
+#pragma once
+
+#include <deque>
+
+#include "Core/Interpreter.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+	#define C8_JIT_SUPPORTED 1
+#else
+	#define C8_JIT_SUPPORTED 0
+#endif
+
+// Forward declaration of Emulator
+class Emulator;
+
+// State shared between the dispatcher and translated code. Translated code keeps a pointer to it in rbp.
+struct JitContext
+{
+	int64_t Budget = 0;    // Instructions left to run; a block returns to the dispatcher instead of starting if it wouldn't fit
+	int32_t LastExit = -1; // The exit that returned to the dispatcher, so it can be linked to its target. -1 if it can't be.
+};
+
+// x86-64 dynamic recompiler.
+// Translates basic blocks of CHIP-8 code starting at the program counter into native code in an executable code cache.
+// Register, timer and I register instructions, jumps and conditional skips are translated directly; everything else
+// calls the interpreter's handler for that instruction, so the interpreter stays the reference implementation.
+// Exits whose target is known are patched to jump straight into the next block, so hot loops never leave native code
+// until their instruction budget runs out.
+class Jit
+{
+public:
+	explicit Jit(Emulator& emulator);
+	~Jit();
+
+	Jit(const Jit&) = delete;
+	Jit& operator=(const Jit&) = delete;
+
+	[[nodiscard]] static constexpr bool IsSupported() { return C8_JIT_SUPPORTED; }
+	[[nodiscard]] FORCEINLINE bool IsValid() const { return m_Code != nullptr; }
+
+	// Runs up to instructionCount instructions, stopping early if the emulator stops running. Returns the number executed.
+	// Blocks only run whole, so once the next one needs more than is left, the interpreter runs the rest. That way the
+	// JIT always stops on exactly the same instruction as the interpreter would.
+	uint64_t Run(uint64_t instructionCount);
+
+	// Throws away translated blocks overlapping [address, address + size). Must be called whenever memory is written to.
+	void Invalidate(uint32_t address, uint32_t size);
+	// Throws away every translated block, e.g. after the memory buffer or quirks have changed.
+	void Flush();
+
+protected:
+	struct Block;
+
+	struct Exit
+	{
+		Block* Owner = nullptr;
+		Block* LinkedTo = nullptr;
+		uint8_t* JumpField = nullptr; // rel32 of the patchable jump
+		uint8_t* Unlinked = nullptr;  // Where the patchable jump goes while unlinked
+		uint16_t TargetPc = 0;
+	};
+
+	struct Block
+	{
+		uint16_t StartPc = 0;
+		uint32_t Size = 0; // In bytes of CHIP-8 code
+		uint32_t InstructionCount = 0; // If it runs straight through, which is the most budget it can use
+		uint8_t* Code = nullptr;
+		bool Valid = true;
+		std::vector<uint32_t> IncomingExits;
+	};
+
+	Block* GetOrTranslate(uint16_t programCounter);
+	Block* Translate(uint16_t programCounter);
+	void Link(uint32_t exitIndex);
+	void InvalidateBlock(Block& block);
+	void Unlink(Exit& exit);
+	bool SetCodeWritable(bool writable);
+
+	// Code emission
+	void Emit8(uint8_t value);
+	void Emit16(uint16_t value);
+	void Emit32(uint32_t value);
+	void Emit64(uint64_t value);
+	void EmitRel32(const uint8_t* target);
+	static void PatchRel32(uint8_t* field, const uint8_t* target);
+	void EmitEmulatorOp(uint8_t opcode, uint8_t reg, uint32_t offset); // op reg, [rbx + offset]
+	void EmitHandlerCall(const DecodedInstruction& instruction, uint16_t nextPc);
+	void EmitStaticExit(uint16_t targetPc, uint32_t instructionCount, Block& block);
+	void EmitDynamicExit(uint32_t instructionCount);
+	uint8_t* EmitRunningCheck();
+	bool EmitNative(const DecodedInstruction& instruction);
+
+	Emulator& m_Emulator;
+	JitContext m_Context;
+
+	uint8_t* m_Code = nullptr; // Never writable and executable at once, so it's only made executable to run it
+	size_t m_CodeCapacity = 0;
+	bool m_CodeWritable = true;
+	bool m_RunningCode = false; // Translated code is running, e.g. while a handler it called writes to memory
+	uint8_t* m_Cursor = nullptr;
+	uint8_t* m_FirstBlock = nullptr; // Everything before this is the entry/exit trampoline, which survives flushes
+	uint8_t* m_Epilogue = nullptr;
+	void (*m_Enter)(Emulator* emulator, JitContext* context, const uint8_t* code) = nullptr;
+
+	std::vector<std::unique_ptr<Block>> m_Blocks;
+	std::vector<Block*> m_BlockMap; // Indexed by start address
+	std::vector<Exit> m_Exits;
+	std::vector<std::vector<Block*>> m_GranuleBlocks; // Valid blocks overlapping each 64 bytes of memory
+	std::vector<uint32_t> m_PendingUnlinks; // Exits to unlink once translated code has returned to the dispatcher
+	std::deque<DecodedInstruction> m_Instructions; // Stable storage for instructions passed to interpreter handlers
+	uint32_t m_Generation = 0; // Bumped on every flush, so a link started before one can tell
+
+	// Byte offsets of emulator state from the emulator pointer, which translated code keeps in rbx
+	uint32_t m_ProgramCounterOffset = 0, m_IRegisterOffset = 0, m_VRegistersOffset = 0;
+	uint32_t m_DelayTimerOffset = 0, m_SoundTimerOffset = 0, m_RunningOffset = 0;
+};
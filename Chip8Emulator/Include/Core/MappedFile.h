@@ -0,0 +1,23 @@
+#pragma once
+
+// A file mapped read-only into memory, so its contents can be used straight from the OS's page cache rather than read
+// into a buffer first. Stays mapped until it's destroyed.
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Whether the file could be opened. An empty file is open, with no data.
+	[[nodiscard]] FORCEINLINE bool IsOpen() const { return m_Open; }
+	[[nodiscard]] FORCEINLINE const uint8_t* GetData() const { return m_Data; }
+	[[nodiscard]] FORCEINLINE size_t GetSize() const { return m_Size; }
+
+private:
+	const uint8_t* m_Data = nullptr;
+	size_t m_Size = 0;
+	bool m_Open = false;
+};
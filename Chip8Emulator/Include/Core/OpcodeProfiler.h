@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+
+// What the profiler groups instructions by: one per instruction, named after its encoding like the interpreter's handlers.
+// Opcodes are classified by encoding alone, so e.g. 00FF counts as 00FF even in a mode that doesn't have it.
+enum class OpcodeClass : uint8_t
+{
+	Op_0NNN, Op_00CN, Op_00DN, Op_00E0, Op_00EE, Op_00FB, Op_00FC, Op_00FD, Op_00FE, Op_00FF,
+	Op_1NNN, Op_2NNN, Op_3XNN, Op_4XNN, Op_5XY0, Op_5XY2, Op_5XY3, Op_6XNN, Op_7XNN,
+	Op_8XY0, Op_8XY1, Op_8XY2, Op_8XY3, Op_8XY4, Op_8XY5, Op_8XY6, Op_8XY7, Op_8XYE,
+	Op_9XY0, Op_ANNN, Op_BNNN, Op_CXNN, Op_DXYN, Op_DXY0, Op_EX9E, Op_EXA1,
+	Op_F000, Op_FN01, Op_F002, Op_FX07, Op_FX0A, Op_FX15, Op_FX18, Op_FX1E, Op_FX29, Op_FX30, Op_FX33, Op_FX3A,
+	Op_FX55, Op_FX65, Op_FX75, Op_FX85,
+	Invalid,
+	NumClasses
+};
+
+constexpr uint32_t NumOpcodeClasses = static_cast<uint32_t>(OpcodeClass::NumClasses);
+
+[[nodiscard]] const char* GetOpcodeClassName(OpcodeClass opcodeClass);
+
+// A copy of what an OpcodeProfiler has counted, small enough to hand to another thread every frame
+struct OpcodeProfile
+{
+	static constexpr uint32_t MaxHotSpots = 32;
+
+	struct ClassStats
+	{
+		uint64_t Count = 0;     // Instructions executed
+		uint64_t Samples = 0;   // How many of them were timed
+		uint64_t SampledNs = 0; // Host time the timed ones took, in total
+	};
+	struct HotSpot
+	{
+		uint16_t Address = 0;
+		uint64_t Count = 0;
+	};
+
+	uint64_t InstructionCount = 0;
+	ClassStats Classes[NumOpcodeClasses];
+	HotSpot HotSpots[MaxHotSpots]; // The most executed addresses, most first
+	uint32_t HotSpotCount = 0;
+
+	// Average host time per instruction of a class, from its samples
+	[[nodiscard]] FORCEINLINE double GetMeanNs(const OpcodeClass opcodeClass) const
+	{
+		const ClassStats& stats = Classes[static_cast<uint32_t>(opcodeClass)];
+		return stats.Samples > 0 ? static_cast<double>(stats.SampledNs) / static_cast<double>(stats.Samples) : 0.0;
+	}
+
+	// Writes a row per opcode class executed, then per hot spot, each starting with run, e.g. the ROM it came from
+	void WriteCsv(std::ostream& out, const std::string& run) const;
+	static void WriteCsvHeader(std::ostream& out);
+};
+
+// Counts what the interpreter executes: how many of each class of instruction, and how many times each address, and times
+// one instruction in every SampleInterval to estimate where host time goes by class. Attach it with Emulator::SetProfiler,
+// which switches the interpreter to a variant compiled with the counting in. Without one attached, the interpreter runs the
+// variant compiled without it, so profiling costs nothing when it's off. The JIT and AOT backends don't report to it.
+class OpcodeProfiler
+{
+public:
+	static constexpr uint32_t SampleInterval = 64;
+
+	OpcodeProfiler();
+
+	void Reset();
+	void TakeSnapshot(OpcodeProfile& profile) const;
+
+	// Counts an instruction about to be executed. Returns true if it should be timed, see AddSample.
+	FORCEINLINE bool Count(const uint16_t address, const uint16_t opcode)
+	{
+		m_ClassCounts[s_OpcodeClasses[opcode]]++;
+		m_AddressCounts[address]++;
+		if (--m_UntilSample != 0)
+			return false;
+		m_UntilSample = SampleInterval;
+		return true;
+	}
+	// Records how long an instruction Count asked to be timed took, in nanoseconds from GetTime
+	FORCEINLINE void AddSample(const uint16_t opcode, const uint64_t elapsed)
+	{
+		const uint8_t opcodeClass = s_OpcodeClasses[opcode];
+		m_ClassSamples[opcodeClass]++;
+		// Part of what's measured is reading the clock itself, which isn't the instruction's doing
+		m_ClassSampledNs[opcodeClass] += elapsed > m_ClockOverhead ? elapsed - m_ClockOverhead : 0;
+	}
+	[[nodiscard]] static FORCEINLINE uint64_t GetTime()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	[[nodiscard]] static FORCEINLINE OpcodeClass Classify(const uint16_t opcode) { return static_cast<OpcodeClass>(s_OpcodeClasses[opcode]); }
+
+private:
+	// The class of every opcode, looked up rather than worked out per instruction
+	static const uint8_t* const s_OpcodeClasses;
+
+	uint64_t m_ClassCounts[NumOpcodeClasses] = { 0 };
+	uint64_t m_ClassSamples[NumOpcodeClasses] = { 0 };
+	uint64_t m_ClassSampledNs[NumOpcodeClasses] = { 0 };
+	std::vector<uint64_t> m_AddressCounts; // One per address in the biggest memory of any mode
+	uint32_t m_UntilSample = SampleInterval;
+	uint64_t m_ClockOverhead = 0; // Shortest time seen between two back to back clock reads
+};
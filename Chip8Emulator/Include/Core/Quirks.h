@@ -0,0 +1,42 @@
+#pragma once
+
+// The CHIP-8 variants disagree on how a handful of instructions behave. Each of these flags selects one side of a disagreement.
+// The interpreter is compiled once per combination it needs (see QuirkSet), so none of these are checked at runtime.
+namespace Quirks
+{
+	enum : uint32_t
+	{
+		None = 0,
+		ShiftUsesVY          = BIT(0), // 8XY6/8XYE shift VY into VX, rather than shifting VX in place
+		JumpUsesVX           = BIT(1), // BNNN behaves as BXNN, jumping to XNN + VX rather than NNN + V0
+		LoadStoreIncrementsI = BIT(2), // FX55/FX65 leave I pointing just past the last register accessed
+		LogicResetsVF        = BIT(3), // 8XY1/8XY2/8XY3 reset VF to 0
+		ClipSprites          = BIT(4), // Sprites are clipped at the edges of the screen, rather than wrapping around
+
+		// Not quirks as such, but they're fixed per mode and select which handlers exist, so they're treated the same way.
+		SuperChipInstructions = BIT(5), // Scrolling, hi-res mode, 16x16 sprites, big font and the RPL flags
+		XOChipInstructions    = BIT(6), // Bitplanes, scrolling up, 16 bit I loads, register range load/store and audio patterns
+	};
+}
+
+template <uint32_t Flags>
+struct QuirkSet
+{
+	static constexpr uint32_t Value = Flags;
+
+	static constexpr bool ShiftUsesVY           = (Flags & Quirks::ShiftUsesVY) != 0;
+	static constexpr bool JumpUsesVX            = (Flags & Quirks::JumpUsesVX) != 0;
+	static constexpr bool LoadStoreIncrementsI  = (Flags & Quirks::LoadStoreIncrementsI) != 0;
+	static constexpr bool LogicResetsVF         = (Flags & Quirks::LogicResetsVF) != 0;
+	static constexpr bool ClipSprites           = (Flags & Quirks::ClipSprites) != 0;
+	static constexpr bool SuperChipInstructions = (Flags & Quirks::SuperChipInstructions) != 0;
+	static constexpr bool XOChipInstructions    = (Flags & Quirks::XOChipInstructions) != 0;
+};
+
+// The original COSMAC VIP interpreter. CHIP-8E only adds instructions, so it shares these.
+using Chip8Quirks = QuirkSet<Quirks::ShiftUsesVY | Quirks::LoadStoreIncrementsI | Quirks::LogicResetsVF | Quirks::ClipSprites>;
+// CHIP-48 on the HP-48, which SUPER-CHIP inherited its quirks from.
+using Chip48Quirks = QuirkSet<Quirks::JumpUsesVX | Quirks::ClipSprites>;
+using SuperChipQuirks = QuirkSet<Quirks::JumpUsesVX | Quirks::ClipSprites | Quirks::SuperChipInstructions>;
+// Octo's XO-Chip builds on SUPER-CHIP's instructions, but goes back to the VIP's shifts and loads/stores, and wraps sprites.
+using XOChipQuirks = QuirkSet<Quirks::ShiftUsesVY | Quirks::LoadStoreIncrementsI | Quirks::SuperChipInstructions | Quirks::XOChipInstructions>;
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Core/Emulator.h"
+
+// History for rewinding, as a save state snapshot per pushed frame.
+// Only the newest snapshot is kept whole. Every one before it is an undo record: the XOR of it and the snapshot after it,
+// which is almost all zeros as little changes from one frame to the next, with the zeros run-length encoded away. Stepping
+// back XORs the newest record into the newest snapshot, giving the one before, so going back never has to replay forward
+// from a keyframe. Keyframes, i.e. whole snapshots (still run-length encoded), are only needed where the state changes size
+// and can't be XORed against the one after it, like a compatibility mode switch.
+// Records go in a byte ring allocated up front, so once the snapshots have grown to the largest state seen, recording and
+// rewinding don't allocate at all. The oldest records are dropped as it fills up.
+class RewindBuffer
+{
+public:
+	static constexpr size_t DefaultCapacity = 32 * 1024 * 1024;
+	static constexpr uint32_t DefaultMaxSnapshots = 60 * 60 * 5; // Five minutes at 60 snapshots a second
+
+	explicit RewindBuffer(size_t capacity = DefaultCapacity, uint32_t maxSnapshots = DefaultMaxSnapshots);
+
+	RewindBuffer(const RewindBuffer&) = delete;
+	RewindBuffer& operator=(const RewindBuffer&) = delete;
+
+	// Drops all history
+	void Clear();
+
+	// Snapshots the emulator as the newest point in history. Returns false if its state couldn't be saved.
+	// Only the memory pages the emulator has marked dirty since the last push or step back are compared, and they're cleared
+	// afterwards, so nothing else should clear them in between.
+	bool Push(Emulator& emulator);
+	// Loads the snapshot before the newest into the emulator, and drops the newest. Returns false if there's no more history.
+	bool StepBack(Emulator& emulator);
+
+	// How many times StepBack can go back
+	[[nodiscard]] FORCEINLINE uint32_t GetStepCount() const { return m_RecordCount; }
+	// Bytes of undo records kept, not counting the newest snapshot
+	[[nodiscard]] FORCEINLINE size_t GetUsedBytes() const { return m_UsedBytes; }
+	[[nodiscard]] FORCEINLINE size_t GetCapacity() const { return m_Capacity; }
+
+protected:
+	struct Record
+	{
+		uint32_t Offset = 0, Size = 0; // Where the record is in m_Data
+		uint32_t StateSize = 0;        // Size of the snapshot it restores
+	};
+
+	// Makes room for a record of size bytes, dropping the oldest as needed, and returns where it goes. Returns nullptr if it
+	// could never fit.
+	uint8_t* AddRecord(uint32_t size, uint32_t stateSize);
+	void DropOldestRecord();
+
+	std::unique_ptr<uint8_t[]> m_Data;
+	size_t m_Capacity;
+	// Records run from the oldest's offset round to m_WriteOffset, plus whatever's skipped at the end of m_Data when a record
+	// wouldn't fit before it and went back to the start
+	uint32_t m_WriteOffset = 0;
+	size_t m_UsedBytes = 0;
+
+	std::vector<Record> m_Records; // A ring of m_RecordCount, from the oldest at m_FirstRecord
+	uint32_t m_FirstRecord = 0, m_RecordCount = 0;
+
+	std::vector<uint8_t> m_Newest;  // The newest snapshot, whole; empty if nothing has been pushed
+	std::vector<uint8_t> m_Pushed;  // The snapshot being pushed, which becomes m_Newest
+	std::vector<uint8_t> m_Encoded; // The record being pushed, before it's copied into m_Data
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Core/Emulator.h"
+
+class MappedFile;
+
+// What's known about a ROM: how it needs to be run, and how it's best played
+struct RomInfo
+{
+	CompatibilityMode Mode = CompatibilityMode::Chip8;
+	uint32_t Quirks = 0;      // The quirks it needs, see Quirks.h, if they're known. 0 for whatever Mode has.
+	int CyclesPerSecond = 0;  // Recommended instruction rate. 0 for no recommendation.
+	// Nibble N is the key sent by the keypad key that normally sends N, for ROMs with awkward controls. 0 for no remapping.
+	uint64_t KeyMap = 0;
+};
+
+// The key to send for a keypad key, going through a RomInfo::KeyMap
+[[nodiscard]] FORCEINLINE uint8_t MapRomKey(const uint64_t keyMap, const uint8_t key)
+{
+	return keyMap != 0 ? static_cast<uint8_t>(keyMap >> (key & 0xF) * 4 & 0xF) : key;
+}
+
+// A local database of RomInfos, indexed by the hash of the ROM's bytes, so a ROM can be run the right way as soon as it's
+// loaded without having to pick a mode first. The file is an index sorted by hash, so it's mapped as it is and searched in
+// place; opening it doesn't read or allocate per entry, and a lookup is a binary search, even with tens of thousands of them.
+// Everything in the file is little-endian:
+//
+//   Header   "C8DB", u16 version, u16 0, u32 entry count, u32 0
+//   Entries  u64 hash, u64 key map, u32 quirks, u32 cycles per second, u8 compatibility mode, u8[7] 0, in order of hash
+class RomDatabase
+{
+public:
+	static constexpr const char* FileName = "roms.c8db"; // Under the preferences path
+
+	RomDatabase();
+	~RomDatabase();
+
+	RomDatabase(const RomDatabase&) = delete;
+	RomDatabase& operator=(const RomDatabase&) = delete;
+
+	// 64 bit xxHash (XXH64, seed 0) of a ROM's bytes, which is what entries are keyed by
+	[[nodiscard]] static uint64_t HashRom(const uint8_t* bytes, size_t size);
+
+	// Maps the database at path. Returns false if there isn't a valid one there, in which case it's empty, but Store still
+	// creates it at path.
+	bool Open(const std::string& path);
+	void Close();
+	[[nodiscard]] FORCEINLINE uint32_t GetEntryCount() const { return m_EntryCount; }
+
+	// Returns false if the ROM isn't in the database
+	bool Find(uint64_t hash, RomInfo& info) const;
+	FORCEINLINE bool Find(const uint8_t* bytes, const size_t size, RomInfo& info) const { return Find(HashRom(bytes, size), info); }
+	// Adds or replaces an entry, rewriting the file and mapping it again. Returns false if it couldn't be written.
+	bool Store(uint64_t hash, const RomInfo& info);
+
+	// The mode to run a ROM in. Usually info's own, but if it needs quirks that mode doesn't have, a mode that does, if any.
+	[[nodiscard]] static CompatibilityMode GetModeForQuirks(const RomInfo& info);
+
+protected:
+	// The first entry with a hash no lower than hash, or the entry count if there isn't one
+	[[nodiscard]] uint32_t FindIndex(uint64_t hash) const;
+	[[nodiscard]] uint64_t GetEntryHash(uint32_t index) const;
+	[[nodiscard]] RomInfo ReadEntry(uint32_t index) const;
+
+	std::string m_Path;
+	std::unique_ptr<MappedFile> m_File;
+	const uint8_t* m_Entries = nullptr; // In m_File
+	uint32_t m_EntryCount = 0;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+// Save states are a fixed size header and body, then memory and the display, everything little-endian:
+//
+//   Header   "C8ST", u16 version, u8 compatibility mode, u8 0, u32 memory size, u32 display words
+//   Body     u8 running, u8 fault, u16 fault address, u16 PC, u16 I,
+//            u8 stack pointer, delay timer, sound timer, hi-res, plane mask, audio pitch, waiting key, 0,
+//            u32 random state, u32 ROM size, u8 V[16], u8 RPL flags[16], u8 audio pattern[16], u16 stack[64]
+//   Memory   memory size bytes
+//   Display  display words u64s, in the layout of Emulator::m_Display
+//
+// Anything that changes this must bump SaveStateFormat::Version.
+namespace SaveStateFormat
+{
+	constexpr char Magic[4] = { 'C', '8', 'S', 'T' };
+	constexpr uint16_t Version = 1;
+	constexpr size_t HeaderSize = 16;
+	constexpr size_t BodySize = 24 + 16 * 3 + 64 * 2;
+	constexpr size_t FixedSize = HeaderSize + BodySize;
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	#define C8_BIG_ENDIAN 1
+#endif
+
+// Writes little-endian values one after the other into a buffer that's already known to be big enough, so nothing is
+// checked or allocated per field.
+class SaveStateWriter
+{
+public:
+	explicit SaveStateWriter(uint8_t* data) : m_Cursor(data) {}
+
+	FORCEINLINE void Write8(const uint8_t value) { *m_Cursor++ = value; }
+	FORCEINLINE void Write16(const uint16_t value)
+	{
+		m_Cursor[0] = static_cast<uint8_t>(value);
+		m_Cursor[1] = static_cast<uint8_t>(value >> 8);
+		m_Cursor += 2;
+	}
+	FORCEINLINE void Write32(const uint32_t value)
+	{
+		for (int i = 0; i < 4; i++)
+			m_Cursor[i] = static_cast<uint8_t>(value >> i * 8);
+		m_Cursor += 4;
+	}
+	FORCEINLINE void WriteBytes(const void* data, const size_t size)
+	{
+		memcpy(m_Cursor, data, size);
+		m_Cursor += size;
+	}
+	FORCEINLINE void WriteWords(const uint64_t* words, const size_t count)
+	{
+#ifdef C8_BIG_ENDIAN
+		for (size_t word = 0; word < count; word++)
+		{
+			for (int i = 0; i < 8; i++)
+				m_Cursor[i] = static_cast<uint8_t>(words[word] >> i * 8);
+			m_Cursor += 8;
+		}
+#else
+		WriteBytes(words, count * sizeof(uint64_t));
+#endif
+	}
+
+	[[nodiscard]] FORCEINLINE const uint8_t* GetCursor() const { return m_Cursor; }
+
+private:
+	uint8_t* m_Cursor;
+};
+
+// The other way round from SaveStateWriter. The size has to be checked before reading, too.
+class SaveStateReader
+{
+public:
+	explicit SaveStateReader(const uint8_t* data) : m_Cursor(data) {}
+
+	FORCEINLINE uint8_t Read8() { return *m_Cursor++; }
+	FORCEINLINE uint16_t Read16()
+	{
+		const uint16_t value = static_cast<uint16_t>(m_Cursor[0] | m_Cursor[1] << 8);
+		m_Cursor += 2;
+		return value;
+	}
+	FORCEINLINE uint32_t Read32()
+	{
+		uint32_t value = 0;
+		for (int i = 0; i < 4; i++)
+			value |= static_cast<uint32_t>(m_Cursor[i]) << i * 8;
+		m_Cursor += 4;
+		return value;
+	}
+	FORCEINLINE void ReadBytes(void* data, const size_t size)
+	{
+		memcpy(data, m_Cursor, size);
+		m_Cursor += size;
+	}
+	FORCEINLINE void Skip(const size_t size) { m_Cursor += size; }
+	FORCEINLINE void ReadWords(uint64_t* words, const size_t count)
+	{
+#ifdef C8_BIG_ENDIAN
+		for (size_t word = 0; word < count; word++)
+		{
+			words[word] = 0;
+			for (int i = 0; i < 8; i++)
+				words[word] |= static_cast<uint64_t>(m_Cursor[i]) << i * 8;
+			m_Cursor += 8;
+		}
+#else
+		ReadBytes(words, count * sizeof(uint64_t));
+#endif
+	}
+
+	[[nodiscard]] FORCEINLINE const uint8_t* GetCursor() const { return m_Cursor; }
+
+private:
+	const uint8_t* m_Cursor;
+};
@@ -2,9 +2,14 @@
 
 // Forward declaration of Emulator
 class Emulator;
+class EmulationThread;
+struct EmulatorFrame;
+struct OpcodeProfile;
+class RomDatabase;
 // Forward declaration of SDL types
 struct SDL_Window;
 struct SDL_Renderer;
+struct SDL_Texture;
 
 class Shell
 {
@@ -17,13 +22,47 @@ public:
 	void Shutdown();
 
 protected:
+	// Sends a key to the emulator if it's on the keypad
+	void HandleKeypadKey(int scancode, bool pressed);
+	// Reads a ROM and hands it to the emulator, in the mode and at the rate the ROM database has for it if it's there
+	void LoadRom(const std::string& path);
+	void SetTurbo(bool turbo);
+	// Whether a frame that came out of turbo is due to be drawn, see m_TurboFrameSkip and TurboPresentInterval
+	[[nodiscard]] bool ShouldPresentTurboFrame(const EmulatorFrame& frame) const;
+	// Uploads the display rows the emulator has changed since the last frame, if any, to m_DisplayTexture.
+	void UpdateDisplayTexture();
+	// Draws m_DisplayTexture as large as it fits in the window, keeping its aspect ratio.
+	void DrawDisplay();
+	// The opcode profile's window, while profiling
+	void DrawProfiler(const EmulatorFrame& frame);
+	// Writes a profile to a CSV file in the preferences path, named after the ROM
+	void ExportProfile(const OpcodeProfile& profile) const;
+
 	bool m_Initialised = false;
 	bool m_Running = false, m_RequestingRestart = false;
 
 	SDL_Window* m_Window;
 	SDL_Renderer* m_Renderer;
 
-	Emulator* m_Emulator = nullptr;
+	Emulator* m_Emulator = nullptr; // Owned by m_EmulationThread while it's running; only talk to it through that
+	EmulationThread* m_EmulationThread = nullptr;
+
+	RomDatabase* m_RomDatabase = nullptr;
+	std::string m_RomName; // File name of the loaded ROM; empty if none has been loaded
+	uint64_t m_RomHash = 0;
+	bool m_RomInDatabase = false;
+	uint64_t m_KeyMap = 0; // The loaded ROM's, see RomInfo::KeyMap
+
+	SDL_Texture* m_DisplayTexture = nullptr; // Streaming, recreated whenever the display size changes
+	uint16_t m_DisplayTextureWidth = 0, m_DisplayTextureHeight = 0;
+	std::vector<uint32_t> m_DisplayPixels; // Staging for resolved rows on their way to m_DisplayTexture
+	uint64_t m_PresentedFrame = 0; // Sequence number of the frame in m_DisplayTexture
+
+	bool m_Turbo = false;
+	int m_TurboFrameSkip = 0;       // Present every Nth emulated frame in turbo, as well as every TurboPresentInterval. 0 for only the latter.
+	uint64_t m_LastPresentTime = 0; // SDL_GetTicksNS of the last present
+	static constexpr uint64_t TurboPresentInterval = 1'000'000'000 / 30;
 
+	std::string m_PrefPath;
 	std::string m_ImguiIniPath;
 };
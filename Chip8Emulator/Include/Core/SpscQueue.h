@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Capacity must be a power of two, and one slot is always left empty to tell a full queue from an empty one.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+	// Producer only. Returns false if the queue is full.
+	bool Push(const T& item)
+	{
+		const size_t head = m_Head.load(std::memory_order_relaxed);
+		const size_t next = (head + 1) & (Capacity - 1);
+		if (next == m_Tail.load(std::memory_order_acquire))
+			return false;
+		m_Items[head] = item;
+		m_Head.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only. Returns false if the queue is empty.
+	bool Pop(T& item)
+	{
+		const size_t tail = m_Tail.load(std::memory_order_relaxed);
+		if (tail == m_Head.load(std::memory_order_acquire))
+			return false;
+		item = m_Items[tail];
+		m_Tail.store((tail + 1) & (Capacity - 1), std::memory_order_release);
+		return true;
+	}
+
+private:
+	T m_Items[Capacity];
+	alignas(64) std::atomic<size_t> m_Head { 0 }; // Next slot the producer writes
+	alignas(64) std::atomic<size_t> m_Tail { 0 }; // Next slot the consumer reads
+};
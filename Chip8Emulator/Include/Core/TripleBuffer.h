@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free mailbox for handing the newest of a stream of values from one thread to another.
+// The producer fills in the write buffer and publishes it; the consumer picks up whatever was published most recently.
+// There are three buffers so that each side always owns one outright, and the third sits in the middle waiting to be swapped.
+// Neither side ever waits for the other, and the consumer skips straight past values it was too slow to see.
+template <typename T>
+class TripleBuffer
+{
+public:
+	// Producer only
+	[[nodiscard]] FORCEINLINE T& GetWriteBuffer() { return m_Buffers[m_WriteIndex]; }
+	// Makes the write buffer the newest value, and takes the middle buffer to write the next one into.
+	FORCEINLINE void Publish()
+	{
+		m_WriteIndex = m_Middle.exchange(static_cast<uint8_t>(m_WriteIndex | FreshBit), std::memory_order_acq_rel) & IndexMask;
+	}
+
+	// Consumer only. Swaps in the newest published value, returning false (and leaving the read buffer alone) if there isn't one.
+	FORCEINLINE bool Acquire()
+	{
+		if (!(m_Middle.load(std::memory_order_relaxed) & FreshBit))
+			return false;
+		m_ReadIndex = m_Middle.exchange(m_ReadIndex, std::memory_order_acq_rel) & IndexMask;
+		return true;
+	}
+	[[nodiscard]] FORCEINLINE const T& GetReadBuffer() const { return m_Buffers[m_ReadIndex]; }
+
+private:
+	static constexpr uint8_t IndexMask = 0x3;
+	static constexpr uint8_t FreshBit = 0x4; // Set on the middle index when it holds a value the consumer hasn't seen
+
+	T m_Buffers[3];
+	// Each side's index on its own cache line, so they don't slow each other down
+	alignas(64) std::atomic<uint8_t> m_Middle { 1 };
+	alignas(64) uint8_t m_WriteIndex = 0;
+	alignas(64) uint8_t m_ReadIndex = 2;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// Fixed set of worker threads for running many independent jobs, e.g. one emulator per ROM.
+// Each worker has its own queue: it takes jobs from the back of that, and once it runs dry, steals from the front of the
+// others'. Jobs are spread over the queues as they're submitted, so workers rarely touch the same lock, and an uneven mix
+// of long and short jobs still keeps every thread busy. A job runs start to finish on the worker that took it, so anything
+// it creates (like an Emulator) stays with that thread.
+class WorkStealingPool
+{
+public:
+	using Job = std::function<void()>;
+
+	// threadCount of 0 for one worker per hardware thread
+	explicit WorkStealingPool(uint32_t threadCount = 0);
+	// Finishes every job already submitted before returning
+	~WorkStealingPool();
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	// Can be called from any thread, including from inside a job, in which case it goes on that worker's own queue.
+	void Submit(Job job);
+	// Blocks until every job submitted so far has finished. Don't call from inside a job.
+	void Wait();
+
+	[[nodiscard]] FORCEINLINE uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Threads.size()); }
+
+protected:
+	struct alignas(64) WorkerQueue
+	{
+		std::mutex Mutex;
+		std::deque<Job> Jobs;
+	};
+
+	void WorkerMain(uint32_t index);
+	bool TryPop(uint32_t index, Job& job);
+	bool TrySteal(uint32_t thief, Job& job);
+
+	std::vector<std::unique_ptr<WorkerQueue>> m_Queues;
+	std::vector<std::thread> m_Threads;
+	std::atomic<uint32_t> m_NextQueue { 0 };
+
+	// Queued counts jobs waiting in a queue, for waking workers; unfinished also counts the ones running, for Wait
+	std::mutex m_StateMutex;
+	std::condition_variable m_WorkAvailable, m_AllFinished;
+	std::atomic<uint64_t> m_Queued { 0 }, m_Unfinished { 0 };
+	bool m_Stopping = false;
+};
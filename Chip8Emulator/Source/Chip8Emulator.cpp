@@ -1,14 +1,58 @@
 #include "c8pch.h"
 
 #include <SDL3/SDL_main.h>
+#include "Core/Benchmark.h"
+#include "Core/Emulator.h"
 #include "Core/Shell.h"
 
 int SDL_main(int argc, char* argv[])
 {
-	Shell* shell = new Shell();
-	shell->Run();
-	delete shell;
+	int result = 0;
+	// Headless benchmark: Chip8Emulator --bench [instruction count] [--jit]
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+	{
+		const bool jit = argc > 3 && strcmp(argv[3], "--jit") == 0;
+		result = RunBenchmark(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1'000'000'000ull, jit ? ExecutionBackend::Jit : ExecutionBackend::Interpreter);
+	}
+	// Checks the JIT against the interpreter: Chip8Emulator --jit-diff [rom path] [instruction count] [mode|all]
+	// Every implemented mode is checked unless one is given; an empty ROM path uses the built-in benchmark ROM.
+	else if (argc > 1 && strcmp(argv[1], "--jit-diff") == 0)
+	{
+		static const std::unordered_map<std::string, CompatibilityMode> modes = {
+			{ "chip8", CompatibilityMode::Chip8 },
+			{ "chip8e", CompatibilityMode::Chip8E },
+			{ "chip48", CompatibilityMode::Chip48 },
+			{ "superchip", CompatibilityMode::SuperChip },
+			{ "xochip10", CompatibilityMode::XOChip10 },
+			{ "xochip11", CompatibilityMode::XOChip11 }
+		};
+		std::vector<CompatibilityMode> testModes = { CompatibilityMode::Chip8, CompatibilityMode::Chip8E, CompatibilityMode::Chip48,
+			CompatibilityMode::SuperChip, CompatibilityMode::XOChip10, CompatibilityMode::XOChip11 };
+		if (argc > 4 && strcmp(argv[4], "all") != 0)
+		{
+			const auto it = modes.find(argv[4]);
+			if (it == modes.end())
+			{
+				InitLog(nullptr);
+				C8_ERROR("Unknown compatibility mode: {0}", argv[4]);
+				testModes.clear();
+				result = 1;
+			}
+			else
+				testModes = { it->second };
+		}
+		if (!testModes.empty())
+			result = RunBackendDifferentialTest(argc > 2 ? argv[2] : "", argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 10'000'000ull, testModes);
+	}
+	else
+	{
+		Shell* shell = new Shell();
+		shell->Run();
+		delete shell;
 
-	C8_TRACE("Goodbye :)");
-	return 0;
+		C8_TRACE("Goodbye :)");
+	}
+
+	ShutdownLog();
+	return result;
 }
@@ -0,0 +1,27 @@
+#include "c8pch.h"
+#include "Core/Aot.h"
+
+#include "Core/Emulator.h"
+
+bool AotRegistry::Register(const AotProgram& program)
+{
+	GetPrograms().push_back(program);
+	return true;
+}
+
+const AotProgram* AotRegistry::Find(const CompatibilityMode mode, const uint8_t* rom, const size_t size)
+{
+	for (const AotProgram& program : GetPrograms())
+	{
+		if (program.Mode == mode && program.RomSize == size && memcmp(program.Rom, rom, size) == 0)
+			return &program;
+	}
+	return nullptr;
+}
+
+std::vector<AotProgram>& AotRegistry::GetPrograms()
+{
+	// Function local, so generated code can register from its static initialisers regardless of initialisation order.
+	static std::vector<AotProgram> programs;
+	return programs;
+}
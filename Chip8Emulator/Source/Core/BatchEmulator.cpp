@@ -0,0 +1,519 @@
+#include "c8pch.h"
+#include "Core/BatchEmulator.h"
+
+#include "Core/Interpreter.h"
+
+// As with the display code in Interpreter.cpp: SSE2 is always there on x64, AVX2 only when the build targets it (premake --avx2).
+// Without either, every instruction goes through the scalar path, which is slower but gives the same results.
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define C8_BATCH_AVX2 1
+	#define C8_BATCH_SIMD 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define C8_BATCH_SSE2 1
+	#define C8_BATCH_SIMD 1
+#endif
+
+// Stride of the SoA arrays, in instances. A multiple of every vector width, so the loops never have a partial vector left over.
+static constexpr uint32_t LaneAlignment = 64;
+static constexpr uint32_t CacheLineSize = 64;
+
+#if C8_BATCH_SIMD
+// Thin wrappers over whichever vector width is available, so each instruction is written once.
+// Byte lanes hold V registers and timers, 16 bit lanes hold I and PC. Masks are all ones or all zeros per lane.
+namespace Lanes
+{
+#if C8_BATCH_AVX2
+	using Vector = __m256i;
+	FORCEINLINE Vector Load(const void* data)            { return _mm256_loadu_si256(static_cast<const __m256i*>(data)); }
+	FORCEINLINE void Store(void* data, const Vector v)   { _mm256_storeu_si256(static_cast<__m256i*>(data), v); }
+	FORCEINLINE Vector Splat8(const uint8_t value)       { return _mm256_set1_epi8(static_cast<char>(value)); }
+	FORCEINLINE Vector Splat16(const uint16_t value)     { return _mm256_set1_epi16(static_cast<short>(value)); }
+	FORCEINLINE Vector Add8(const Vector a, const Vector b)  { return _mm256_add_epi8(a, b); }
+	FORCEINLINE Vector Sub8(const Vector a, const Vector b)  { return _mm256_sub_epi8(a, b); }
+	FORCEINLINE Vector SubSaturate8(const Vector a, const Vector b) { return _mm256_subs_epu8(a, b); }
+	FORCEINLINE Vector Max8(const Vector a, const Vector b)  { return _mm256_max_epu8(a, b); }
+	FORCEINLINE Vector Equal8(const Vector a, const Vector b)  { return _mm256_cmpeq_epi8(a, b); }
+	FORCEINLINE Vector Add16(const Vector a, const Vector b) { return _mm256_add_epi16(a, b); }
+	FORCEINLINE Vector Equal16(const Vector a, const Vector b) { return _mm256_cmpeq_epi16(a, b); }
+	FORCEINLINE Vector And(const Vector a, const Vector b)   { return _mm256_and_si256(a, b); }
+	FORCEINLINE Vector AndNot(const Vector a, const Vector b) { return _mm256_andnot_si256(a, b); }
+	FORCEINLINE Vector Or(const Vector a, const Vector b)    { return _mm256_or_si256(a, b); }
+	FORCEINLINE Vector Xor(const Vector a, const Vector b)   { return _mm256_xor_si256(a, b); }
+	FORCEINLINE Vector Select(const Vector mask, const Vector a, const Vector b) { return _mm256_blendv_epi8(b, a, mask); }
+	template <int Bits>
+	FORCEINLINE Vector ShiftRight8(const Vector a)       { return _mm256_and_si256(_mm256_srli_epi16(a, Bits), Splat8(0xFF >> Bits)); }
+	// Zero extends a 16 bit lane's worth of bytes
+	FORCEINLINE Vector LoadWiden8(const uint8_t* data)   { return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data))); }
+#else
+	using Vector = __m128i;
+	FORCEINLINE Vector Load(const void* data)            { return _mm_loadu_si128(static_cast<const __m128i*>(data)); }
+	FORCEINLINE void Store(void* data, const Vector v)   { _mm_storeu_si128(static_cast<__m128i*>(data), v); }
+	FORCEINLINE Vector Splat8(const uint8_t value)       { return _mm_set1_epi8(static_cast<char>(value)); }
+	FORCEINLINE Vector Splat16(const uint16_t value)     { return _mm_set1_epi16(static_cast<short>(value)); }
+	FORCEINLINE Vector Add8(const Vector a, const Vector b)  { return _mm_add_epi8(a, b); }
+	FORCEINLINE Vector Sub8(const Vector a, const Vector b)  { return _mm_sub_epi8(a, b); }
+	FORCEINLINE Vector SubSaturate8(const Vector a, const Vector b) { return _mm_subs_epu8(a, b); }
+	FORCEINLINE Vector Max8(const Vector a, const Vector b)  { return _mm_max_epu8(a, b); }
+	FORCEINLINE Vector Equal8(const Vector a, const Vector b)  { return _mm_cmpeq_epi8(a, b); }
+	FORCEINLINE Vector Add16(const Vector a, const Vector b) { return _mm_add_epi16(a, b); }
+	FORCEINLINE Vector Equal16(const Vector a, const Vector b) { return _mm_cmpeq_epi16(a, b); }
+	FORCEINLINE Vector And(const Vector a, const Vector b)   { return _mm_and_si128(a, b); }
+	FORCEINLINE Vector AndNot(const Vector a, const Vector b) { return _mm_andnot_si128(a, b); }
+	FORCEINLINE Vector Or(const Vector a, const Vector b)    { return _mm_or_si128(a, b); }
+	FORCEINLINE Vector Xor(const Vector a, const Vector b)   { return _mm_xor_si128(a, b); }
+	FORCEINLINE Vector Select(const Vector mask, const Vector a, const Vector b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+	template <int Bits>
+	FORCEINLINE Vector ShiftRight8(const Vector a)       { return _mm_and_si128(_mm_srli_epi16(a, Bits), Splat8(0xFF >> Bits)); }
+	FORCEINLINE Vector LoadWiden8(const uint8_t* data)   { return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data)), _mm_setzero_si128()); }
+#endif
+
+	constexpr uint32_t ByteLanes = sizeof(Vector);
+	constexpr uint32_t WordLanes = sizeof(Vector) / 2;
+
+	// All ones in the lanes where a >= b, unsigned
+	FORCEINLINE Vector GreaterEqual8(const Vector a, const Vector b) { return Equal8(Max8(a, b), a); }
+}
+#endif
+
+BatchEmulator::BatchEmulator(const CompatibilityMode mode, const uint32_t instanceCount)
+	: m_CompatibilityMode(mode), m_InstanceCount(instanceCount),
+	m_Stride((instanceCount + LaneAlignment - 1) / LaneAlignment * LaneAlignment)
+{
+	m_VRegisters.resize(static_cast<size_t>(16) * m_Stride);
+	m_IRegister.resize(m_Stride);
+	m_ProgramCounter.resize(m_Stride);
+	m_DelayTimer.resize(m_Stride);
+	m_SoundTimer.resize(m_Stride);
+	m_StackPointer.resize(m_Stride);
+	m_Running.resize(m_Stride);
+	m_Opcodes.resize(m_Stride);
+	m_ByteMask.resize(m_Stride);
+	m_WordMask.resize(m_Stride);
+	m_Diverged.reserve(instanceCount);
+	m_Instances.resize(instanceCount);
+
+	// Every instance prints the same warnings, so only real problems get through
+	m_Scratch.SetDebugLogs(false);
+}
+
+bool BatchEmulator::LoadRom(const std::vector<uint8_t>& bytes)
+{
+	// The scratch emulator loads the ROM once, and every instance starts from a copy of what it ends up with
+	m_Scratch.LoadRom(m_CompatibilityMode, bytes);
+	m_ScratchMemory = m_Scratch.m_Memory;
+	m_ScratchDisplay = m_Scratch.m_Display;
+	std::fill(m_Running.begin(), m_Running.end(), 0);
+	m_RunningCount = 0;
+	if (!m_Scratch.IsRunning())
+	{
+		C8_ERROR("BatchEmulator: Failed to load ROM");
+		return false;
+	}
+
+	m_Quirks = m_Scratch.m_Interpreter->Quirks;
+	const uint32_t displayWords = m_Scratch.m_DisplayPlanes * m_Scratch.m_DisplayRowWords * m_Scratch.m_DisplayHeight;
+	if (!m_Memory || m_MemorySize != m_Scratch.m_CurrentMemorySize || m_DisplayWords != displayWords)
+	{
+		m_MemorySize = m_Scratch.m_CurrentMemorySize;
+		m_MemoryStride = m_MemorySize + CacheLineSize;
+		m_DisplayWords = displayWords;
+		m_Memory = std::make_unique<uint8_t[]>(static_cast<size_t>(m_MemoryStride) * m_InstanceCount);
+		m_Display = std::make_unique<uint64_t[]>(static_cast<size_t>(m_DisplayWords) * m_InstanceCount);
+	}
+
+	for (uint32_t i = 0; i < m_InstanceCount; i++)
+	{
+		memcpy(GetInstanceMemory(i), m_ScratchMemory, m_MemorySize);
+		memcpy(GetInstanceDisplay(i), m_ScratchDisplay, m_DisplayWords * sizeof(uint64_t));
+		for (uint8_t reg = 0; reg < 16; reg++)
+			m_VRegisters[reg * m_Stride + i] = m_Scratch.m_VRegisters[reg];
+		m_IRegister[i] = m_Scratch.m_IRegister;
+		m_ProgramCounter[i] = m_Scratch.m_ProgramCounter;
+		m_DelayTimer[i] = m_Scratch.m_DelayTimer;
+		m_SoundTimer[i] = m_Scratch.m_SoundTimer;
+		m_StackPointer[i] = m_Scratch.m_StackPointer;
+		m_Running[i] = 0xFF;
+
+		// Only what loading a ROM resets; like a single Emulator, the stack, RPL flags and random state carry over
+		InstanceState& state = m_Instances[i];
+		memcpy(state.AudioPattern, m_Scratch.m_AudioPattern, sizeof(state.AudioPattern));
+		state.AudioPitch = m_Scratch.m_AudioPitch;
+		state.PlaneMask = m_Scratch.m_PlaneMask;
+		state.HiRes = m_Scratch.m_HiRes;
+		state.KeyStates = m_Scratch.m_KeyStates;
+		state.WaitingKey = m_Scratch.m_WaitingKey;
+		state.Fault = m_Scratch.m_Fault;
+		state.FaultAddress = m_Scratch.m_FaultAddress;
+	}
+	m_RunningCount = m_InstanceCount;
+	return true;
+}
+
+uint64_t BatchEmulator::Step(const uint64_t instructionCount)
+{
+	uint64_t steps = 0;
+	while (steps < instructionCount && m_RunningCount > 0)
+	{
+		const uint16_t opcode = Fetch();
+		if (ExecuteVector(opcode))
+			m_VectorInstructions += m_LeaderCount;
+		else
+		{
+			for (uint32_t i = 0; i < m_InstanceCount; i++)
+			{
+				if (m_ByteMask[i])
+					ExecuteScalar(i);
+			}
+		}
+		// Once an instance stops, it's never fetched again, so everything in here was running at the start of the step
+		for (const uint32_t instance : m_Diverged)
+			ExecuteScalar(instance);
+		steps++;
+	}
+	return steps;
+}
+
+void BatchEmulator::TickTimers()
+{
+	uint32_t i = 0;
+#if C8_BATCH_SIMD
+	using namespace Lanes;
+	const Vector one = Splat8(1);
+	for (; i < m_Stride; i += ByteLanes)
+	{
+		Store(&m_DelayTimer[i], SubSaturate8(Load(&m_DelayTimer[i]), one));
+		Store(&m_SoundTimer[i], SubSaturate8(Load(&m_SoundTimer[i]), one));
+	}
+#endif
+	for (; i < m_Stride; i++)
+	{
+		if (m_DelayTimer[i] > 0)
+			m_DelayTimer[i]--;
+		if (m_SoundTimer[i] > 0)
+			m_SoundTimer[i]--;
+	}
+}
+
+void BatchEmulator::SetKeyState(const uint32_t instance, const uint8_t key, const bool pressed)
+{
+	C8_ASSERT(instance < m_InstanceCount, "Invalid instance in SetKeyState");
+	C8_ASSERT(key < 16, "Invalid key in SetKeyState");
+	uint16_t& keys = m_Instances[instance].KeyStates;
+	if (pressed)
+		keys |= BIT(key & 0xF);
+	else
+		keys &= static_cast<uint16_t>(~BIT(key & 0xF));
+}
+
+void BatchEmulator::SetRandomSeed(const uint32_t instance, const uint32_t seed)
+{
+	C8_ASSERT(instance < m_InstanceCount, "Invalid instance in SetRandomSeed");
+	m_Instances[instance].RandomState = seed != 0 ? seed : 1;
+}
+
+void BatchEmulator::ExtractInstance(const uint32_t instance, Emulator& emulator) const
+{
+	C8_ASSERT(instance < m_InstanceCount, "Invalid instance in ExtractInstance");
+	const uint32_t displayWords = emulator.m_DisplayPlanes * emulator.m_DisplayRowWords * emulator.m_DisplayHeight;
+	if (!m_Memory || !emulator.m_Memory || emulator.m_CompatibilityMode != m_CompatibilityMode
+		|| emulator.m_CurrentMemorySize != m_MemorySize || displayWords != m_DisplayWords)
+	{
+		C8_ERROR("ExtractInstance: The emulator must have a ROM loaded in {0} mode", GetCompatibilityModeName(m_CompatibilityMode));
+		return;
+	}
+
+	memcpy(emulator.m_Memory, GetInstanceMemory(instance), m_MemorySize);
+	memcpy(emulator.m_Display, GetInstanceDisplay(instance), m_DisplayWords * sizeof(uint64_t));
+	for (uint8_t reg = 0; reg < 16; reg++)
+		emulator.m_VRegisters[reg] = m_VRegisters[reg * m_Stride + instance];
+	emulator.m_IRegister = m_IRegister[instance];
+	emulator.m_ProgramCounter = m_ProgramCounter[instance];
+	emulator.m_DelayTimer = m_DelayTimer[instance];
+	emulator.m_SoundTimer = m_SoundTimer[instance];
+	emulator.m_StackPointer = m_StackPointer[instance];
+	emulator.m_Running = m_Running[instance] != 0;
+
+	const InstanceState& state = m_Instances[instance];
+	memcpy(emulator.m_Stack, state.Stack, sizeof(state.Stack));
+	memcpy(emulator.m_FlagRegisters, state.FlagRegisters, sizeof(state.FlagRegisters));
+	memcpy(emulator.m_AudioPattern, state.AudioPattern, sizeof(state.AudioPattern));
+	emulator.m_AudioPitch = state.AudioPitch;
+	emulator.m_PlaneMask = state.PlaneMask;
+	emulator.m_HiRes = state.HiRes;
+	emulator.m_KeyStates = state.KeyStates;
+	emulator.m_WaitingKey = state.WaitingKey;
+	emulator.m_RandomState = state.RandomState;
+	emulator.m_Fault = state.Fault;
+	emulator.m_FaultAddress = state.FaultAddress;
+
+	// All of memory has changed under it
+	emulator.ResetCode();
+	emulator.MarkMemoryDirty();
+	emulator.MarkDisplayDirty();
+}
+
+uint16_t BatchEmulator::Fetch()
+{
+	const uint32_t memoryMask = m_MemorySize - 1;
+	uint16_t leader = 0;
+	bool hasLeader = false;
+	m_LeaderCount = 0;
+	m_Diverged.clear();
+	for (uint32_t i = 0; i < m_InstanceCount; i++)
+	{
+		if (!m_Running[i])
+		{
+			m_ByteMask[i] = 0;
+			m_WordMask[i] = 0;
+			continue;
+		}
+
+		const uint8_t* memory = GetInstanceMemory(i);
+		const uint16_t programCounter = static_cast<uint16_t>(m_ProgramCounter[i] & memoryMask);
+		m_ProgramCounter[i] = static_cast<uint16_t>(programCounter + 2);
+		const uint16_t opcode = static_cast<uint16_t>(memory[programCounter] << 8 | memory[(programCounter + 1) & memoryMask]);
+		m_Opcodes[i] = opcode;
+		if (!hasLeader)
+		{
+			leader = opcode;
+			hasLeader = true;
+		}
+
+		const bool match = opcode == leader;
+		m_ByteMask[i] = match ? 0xFF : 0;
+		m_WordMask[i] = match ? 0xFFFF : 0;
+		m_LeaderCount += match;
+		if (!match)
+			m_Diverged.push_back(i);
+	}
+	return leader;
+}
+
+bool BatchEmulator::ExecuteVector(const uint16_t opcode)
+{
+#if C8_BATCH_SIMD
+	using namespace Lanes;
+	const uint8_t x = Interpreter::GetX(opcode), y = Interpreter::GetY(opcode), n = Interpreter::GetN(opcode);
+	const uint8_t nn = Interpreter::GetNN(opcode);
+	const uint16_t nnn = Interpreter::GetNNN(opcode);
+	uint8_t* const vx = &m_VRegisters[x * m_Stride];
+	uint8_t* const vy = &m_VRegisters[y * m_Stride];
+	uint8_t* const vf = &m_VRegisters[0xF * m_Stride];
+	const bool shiftUsesVY = (m_Quirks & Quirks::ShiftUsesVY) != 0;
+	const bool logicResetsVF = (m_Quirks & Quirks::LogicResetsVF) != 0;
+	// XO-Chip skips over F000 NNNN as a whole, which depends on what's in each instance's memory
+	const bool plainSkips = (m_Quirks & Quirks::XOChipInstructions) == 0;
+	const Vector one8 = Splat8(1), two16 = Splat16(2);
+
+	// Each of these runs body(i) for every vector's worth of instances
+	const auto forEachByte = [this](auto body) { for (uint32_t i = 0; i < m_Stride; i += ByteLanes) body(i); };
+	const auto forEachWord = [this](auto body) { for (uint32_t i = 0; i < m_Stride; i += WordLanes) body(i); };
+	// Writes result to the destination in the matching lanes, then the flag to VF, in that order so VF wins when X is F
+	const auto writeWithFlag = [&](const uint32_t i, const Vector mask, const Vector result, const Vector flag)
+	{
+		Store(vx + i, Select(mask, result, Load(vx + i)));
+		Store(vf + i, Select(mask, flag, Load(vf + i)));
+	};
+	// PC has already moved past the instruction, so a taken skip only adds another 2
+	const auto skipIf = [&](const auto condition)
+	{
+		forEachWord([&](const uint32_t i)
+		{
+			const Vector taken = And(Load(&m_WordMask[i]), condition(i));
+			Store(&m_ProgramCounter[i], Add16(Load(&m_ProgramCounter[i]), And(taken, two16)));
+		});
+	};
+
+	switch (opcode >> 12)
+	{
+	case 0x1:
+		forEachWord([&](const uint32_t i) { Store(&m_ProgramCounter[i], Select(Load(&m_WordMask[i]), Splat16(nnn), Load(&m_ProgramCounter[i]))); });
+		return true;
+	case 0x3:
+		if (!plainSkips)
+			return false;
+		skipIf([&](const uint32_t i) { return Equal16(LoadWiden8(vx + i), Splat16(nn)); });
+		return true;
+	case 0x4:
+		if (!plainSkips)
+			return false;
+		skipIf([&](const uint32_t i) { return Xor(Equal16(LoadWiden8(vx + i), Splat16(nn)), Splat16(0xFFFF)); });
+		return true;
+	case 0x5:
+		if (!plainSkips || n != 0)
+			return false;
+		skipIf([&](const uint32_t i) { return Equal16(LoadWiden8(vx + i), LoadWiden8(vy + i)); });
+		return true;
+	case 0x9:
+		if (!plainSkips || n != 0)
+			return false;
+		skipIf([&](const uint32_t i) { return Xor(Equal16(LoadWiden8(vx + i), LoadWiden8(vy + i)), Splat16(0xFFFF)); });
+		return true;
+	case 0x6:
+		forEachByte([&](const uint32_t i) { Store(vx + i, Select(Load(&m_ByteMask[i]), Splat8(nn), Load(vx + i))); });
+		return true;
+	case 0x7:
+		forEachByte([&](const uint32_t i) { Store(vx + i, Select(Load(&m_ByteMask[i]), Add8(Load(vx + i), Splat8(nn)), Load(vx + i))); });
+		return true;
+	case 0xA:
+		forEachWord([&](const uint32_t i) { Store(&m_IRegister[i], Select(Load(&m_WordMask[i]), Splat16(nnn), Load(&m_IRegister[i]))); });
+		return true;
+	case 0x8:
+		switch (n)
+		{
+		case 0x0:
+			forEachByte([&](const uint32_t i) { Store(vx + i, Select(Load(&m_ByteMask[i]), Load(vy + i), Load(vx + i))); });
+			return true;
+		case 0x1:
+		case 0x2:
+		case 0x3:
+			forEachByte([&](const uint32_t i)
+			{
+				const Vector mask = Load(&m_ByteMask[i]);
+				const Vector a = Load(vx + i), b = Load(vy + i);
+				const Vector result = n == 0x1 ? Or(a, b) : n == 0x2 ? And(a, b) : Xor(a, b);
+				Store(vx + i, Select(mask, result, a));
+				if (logicResetsVF)
+					Store(vf + i, AndNot(mask, Load(vf + i)));
+			});
+			return true;
+		case 0x4:
+			forEachByte([&](const uint32_t i)
+			{
+				const Vector a = Load(vx + i), sum = Add8(a, Load(vy + i));
+				// Carried if the sum wrapped round to less than what it started from
+				writeWithFlag(i, Load(&m_ByteMask[i]), sum, AndNot(GreaterEqual8(sum, a), one8));
+			});
+			return true;
+		case 0x5:
+			forEachByte([&](const uint32_t i)
+			{
+				const Vector a = Load(vx + i), b = Load(vy + i);
+				writeWithFlag(i, Load(&m_ByteMask[i]), Sub8(a, b), And(GreaterEqual8(a, b), one8));
+			});
+			return true;
+		case 0x7:
+			forEachByte([&](const uint32_t i)
+			{
+				const Vector a = Load(vx + i), b = Load(vy + i);
+				writeWithFlag(i, Load(&m_ByteMask[i]), Sub8(b, a), And(GreaterEqual8(b, a), one8));
+			});
+			return true;
+		case 0x6:
+			forEachByte([&](const uint32_t i)
+			{
+				const Vector source = Load(shiftUsesVY ? vy + i : vx + i);
+				writeWithFlag(i, Load(&m_ByteMask[i]), ShiftRight8<1>(source), And(source, one8));
+			});
+			return true;
+		case 0xE:
+			forEachByte([&](const uint32_t i)
+			{
+				const Vector source = Load(shiftUsesVY ? vy + i : vx + i);
+				writeWithFlag(i, Load(&m_ByteMask[i]), Add8(source, source), ShiftRight8<7>(source));
+			});
+			return true;
+		default:
+			return false;
+		}
+	case 0xF:
+		switch (nn)
+		{
+		case 0x07:
+			forEachByte([&](const uint32_t i) { Store(vx + i, Select(Load(&m_ByteMask[i]), Load(&m_DelayTimer[i]), Load(vx + i))); });
+			return true;
+		case 0x15:
+			forEachByte([&](const uint32_t i) { Store(&m_DelayTimer[i], Select(Load(&m_ByteMask[i]), Load(vx + i), Load(&m_DelayTimer[i]))); });
+			return true;
+		case 0x18:
+			forEachByte([&](const uint32_t i) { Store(&m_SoundTimer[i], Select(Load(&m_ByteMask[i]), Load(vx + i), Load(&m_SoundTimer[i]))); });
+			return true;
+		case 0x1E:
+			forEachWord([&](const uint32_t i) { Store(&m_IRegister[i], Add16(Load(&m_IRegister[i]), And(Load(&m_WordMask[i]), LoadWiden8(vx + i)))); });
+			return true;
+		default:
+			return false;
+		}
+	default:
+		return false;
+	}
+#else
+	return false;
+#endif
+}
+
+void BatchEmulator::ExecuteScalar(const uint32_t instance)
+{
+	LoadScratch(instance);
+	Interpreter::Execute(m_Scratch, m_Opcodes[instance]);
+	StoreScratch(instance);
+	m_ScalarInstructions++;
+}
+
+void BatchEmulator::LoadScratch(const uint32_t instance)
+{
+	// Handlers only ever go through these pointers, so swapping them in is all it takes to run on the instance's buffers
+	m_Scratch.m_Memory = GetInstanceMemory(instance);
+	m_Scratch.m_Display = GetInstanceDisplay(instance);
+	// Through locals, as byte stores could alias the vector's own pointer and it would be reloaded every iteration
+	const uint8_t* registers = m_VRegisters.data() + instance;
+	const uint32_t stride = m_Stride;
+	for (uint8_t reg = 0; reg < 16; reg++)
+		m_Scratch.m_VRegisters[reg] = registers[reg * stride];
+	m_Scratch.m_IRegister = m_IRegister[instance];
+	m_Scratch.m_ProgramCounter = m_ProgramCounter[instance];
+	m_Scratch.m_DelayTimer = m_DelayTimer[instance];
+	m_Scratch.m_SoundTimer = m_SoundTimer[instance];
+	m_Scratch.m_StackPointer = m_StackPointer[instance];
+	m_Scratch.m_Running = true;
+
+	const InstanceState& state = m_Instances[instance];
+	// Only the entries in use can be seen, and 2NNN and 00EE are the only handlers that touch them
+	memcpy(m_Scratch.m_Stack, state.Stack, m_Scratch.m_StackPointer * sizeof(uint16_t));
+	memcpy(m_Scratch.m_FlagRegisters, state.FlagRegisters, sizeof(state.FlagRegisters));
+	memcpy(m_Scratch.m_AudioPattern, state.AudioPattern, sizeof(state.AudioPattern));
+	m_Scratch.m_AudioPitch = state.AudioPitch;
+	m_Scratch.m_PlaneMask = state.PlaneMask;
+	m_Scratch.m_HiRes = state.HiRes;
+	m_Scratch.m_KeyStates = state.KeyStates;
+	m_Scratch.m_WaitingKey = state.WaitingKey;
+	m_Scratch.m_RandomState = state.RandomState;
+	m_Scratch.m_Fault = state.Fault;
+	m_Scratch.m_FaultAddress = state.FaultAddress;
+}
+
+void BatchEmulator::StoreScratch(const uint32_t instance)
+{
+	uint8_t* registers = m_VRegisters.data() + instance;
+	const uint32_t stride = m_Stride;
+	for (uint8_t reg = 0; reg < 16; reg++)
+		registers[reg * stride] = m_Scratch.m_VRegisters[reg];
+	m_IRegister[instance] = m_Scratch.m_IRegister;
+	m_ProgramCounter[instance] = m_Scratch.m_ProgramCounter;
+	m_DelayTimer[instance] = m_Scratch.m_DelayTimer;
+	m_SoundTimer[instance] = m_Scratch.m_SoundTimer;
+	m_StackPointer[instance] = m_Scratch.m_StackPointer;
+	if (!m_Scratch.m_Running)
+	{
+		m_Running[instance] = 0;
+		m_RunningCount--;
+	}
+
+	InstanceState& state = m_Instances[instance];
+	memcpy(state.Stack, m_Scratch.m_Stack, m_Scratch.m_StackPointer * sizeof(uint16_t));
+	memcpy(state.FlagRegisters, m_Scratch.m_FlagRegisters, sizeof(state.FlagRegisters));
+	memcpy(state.AudioPattern, m_Scratch.m_AudioPattern, sizeof(state.AudioPattern));
+	state.AudioPitch = m_Scratch.m_AudioPitch;
+	state.PlaneMask = m_Scratch.m_PlaneMask;
+	state.HiRes = m_Scratch.m_HiRes;
+	state.KeyStates = m_Scratch.m_KeyStates;
+	state.WaitingKey = m_Scratch.m_WaitingKey;
+	state.RandomState = m_Scratch.m_RandomState;
+	state.Fault = m_Scratch.m_Fault;
+	state.FaultAddress = m_Scratch.m_FaultAddress;
+
+	m_Scratch.m_Memory = m_ScratchMemory;
+	m_Scratch.m_Display = m_ScratchDisplay;
+}
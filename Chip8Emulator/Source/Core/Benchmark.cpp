@@ -0,0 +1,110 @@
+#include "c8pch.h"
+#include "Core/Benchmark.h"
+
+#include <chrono>
+
+#include "Core/Emulator.h"
+
+// A small ROM that spends most of its time in the ALU, with a jump, skip, call/return and a sprite draw mixed in
+// so that every level of the dispatch tables gets exercised. It loops forever.
+static const std::vector<uint8_t> s_BenchmarkRom = {
+	0x60, 0x00, // 0x200: V0 = 0
+	0x61, 0x01, // 0x202: V1 = 1
+	0xA0, 0x50, // 0x204: I = 0x050 (font)
+	0x70, 0x01, // 0x206: V0 += 1
+	0x80, 0x14, // 0x208: V0 += V1, VF = carry
+	0x82, 0x06, // 0x20A: V2 = V0 >> 1
+	0x83, 0x23, // 0x20C: V3 ^= V2
+	0x30, 0x00, // 0x20E: Skip if V0 == 0
+	0x12, 0x06, // 0x210: Jump to 0x206
+	0xD0, 0x15, // 0x212: Draw 5 rows at (V0, V1)
+	0x22, 0x18, // 0x214: Call 0x218
+	0x12, 0x06, // 0x216: Jump to 0x206
+	0xF3, 0x1E, // 0x218: I += V3
+	0xA0, 0x50, // 0x21A: I = 0x050
+	0x00, 0xEE  // 0x21C: Return
+};
+
+const std::vector<uint8_t>& GetBenchmarkRom()
+{
+	return s_BenchmarkRom;
+}
+
+int RunBenchmark(const uint64_t instructionCount, const ExecutionBackend backend)
+{
+	InitLog(nullptr);
+
+	Emulator emulator;
+	emulator.LoadRom(CompatibilityMode::Chip8, s_BenchmarkRom);
+	emulator.SetExecutionBackend(backend);
+
+	const auto start = std::chrono::steady_clock::now();
+	const uint64_t executed = emulator.Step(instructionCount);
+	const auto end = std::chrono::steady_clock::now();
+
+	if (executed != instructionCount)
+	{
+		C8_ERROR("Benchmark ROM stopped after {0} of {1} instructions", executed, instructionCount);
+		return 1;
+	}
+
+	[[maybe_unused]] const double seconds = std::chrono::duration<double>(end - start).count(); // Only used by the log, which can be compiled out
+	C8_INFO("{0}: executed {1} instructions in {2:.3f}s: {3:.1f} MIPS",
+		GetExecutionBackendName(emulator.GetExecutionBackend()),
+		executed, seconds, static_cast<double>(executed) / seconds / 1e6);
+	return 0;
+}
+
+static bool RunBackendDifferentialTest(const std::string& romPath, const uint64_t instructionCount, const CompatibilityMode mode)
+{
+	Emulator jit, reference;
+	if (romPath.empty())
+	{
+		jit.LoadRom(mode, s_BenchmarkRom);
+		reference.LoadRom(mode, s_BenchmarkRom);
+	}
+	else
+	{
+		jit.LoadRom(mode, romPath);
+		reference.LoadRom(mode, romPath);
+	}
+	jit.SetExecutionBackend(ExecutionBackend::Jit);
+	if (jit.GetExecutionBackend() != ExecutionBackend::Jit)
+		return false;
+
+	// Both backends stop on exactly the same instruction, so they're compared after every step of the same size
+	uint64_t total = 0;
+	for (uint32_t frame = 0; total < instructionCount && jit.IsRunning(); frame++)
+	{
+		const uint64_t executed = jit.Step(1000);
+		if (reference.Step(1000) != executed || !jit.HasSameState(reference))
+		{
+			C8_ERROR("{0}: JIT and interpreter diverged within instructions {1}-{2}", GetCompatibilityModeName(mode), total, total + executed);
+			return false;
+		}
+		total += executed;
+
+		// Press a different key every few frames, so programs waiting on input make progress
+		jit.TickTimers();
+		reference.TickTimers();
+		for (uint8_t key = 0; key < 16; key++)
+		{
+			jit.SetKeyState(key, key == (frame / 8) % 16);
+			reference.SetKeyState(key, key == (frame / 8) % 16);
+		}
+	}
+
+	C8_INFO("{0}: JIT and interpreter matched over {1} instructions", GetCompatibilityModeName(mode), total);
+	return true;
+}
+
+int RunBackendDifferentialTest(const std::string& romPath, const uint64_t instructionCount, const std::vector<CompatibilityMode>& modes)
+{
+	InitLog(nullptr);
+
+	// Every mode is run even after one fails, so a single run shows all the modes that diverge
+	bool matched = true;
+	for (const CompatibilityMode mode : modes)
+		matched &= RunBackendDifferentialTest(romPath, instructionCount, mode);
+	return matched ? 0 : 1;
+}
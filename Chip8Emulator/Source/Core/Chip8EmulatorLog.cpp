@@ -3,33 +3,75 @@
 
 #include <filesystem>
 #include <iomanip>
+#include <mutex>
 #include <SDL3/SDL_filesystem.h>
 
+#include "spdlog/async.h"
 #include "spdlog/sinks/basic_file_sink.h"
 
+// Messages waiting for the background thread. The slots are allocated up front, and when they're all full the oldest
+// message is dropped rather than making the emulator wait for the sinks to catch up.
+static constexpr size_t AsyncQueueSize = 8192;
+// Declared before the logger so it's destroyed after it, once the last messages have been written out
+static std::shared_ptr<spdlog::details::thread_pool> s_LogThreadPool;
 std::shared_ptr<spdlog::logger> s_Chip8EmulatorLogger;
 
-void InitLog(const char* prefPath)
+void InitLog(const char* prefPath, const LogTarget target, const LogMode mode)
 {
+	static std::mutex initMutex;
+	std::lock_guard lock(initMutex);
 	if (!s_Chip8EmulatorLogger) 
 	{
 		spdlog::set_pattern("%^[%T] %n: %v%$");
 
 		std::vector<spdlog::sink_ptr> sinks;
 
-		std::stringstream buffer;
-		const std::time_t t = std::time(nullptr);
-		const std::tm tm = *std::localtime(&t);
-		buffer << std::put_time(&tm, "%d-%m-%Y_%H-%M-%S");
-		// Ensure the logs folder exists inside the pref path (if it exists), as spdlog fails to create the file if the folder does not exist AND it is an absolute path.
-		if (prefPath)
-			std::filesystem::create_directories(fmt::format("{}Logs", prefPath));
-		std::string path = fmt::format("{}Logs{}{}.txt", prefPath != nullptr ? prefPath : "", static_cast<char>(std::filesystem::path::preferred_separator), buffer.str());
-		sinks.push_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(path));
-
-		sinks.push_back(std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
+		if (target == LogTarget::FileAndStdout)
+		{
+			std::stringstream buffer;
+			const std::time_t t = std::time(nullptr);
+			const std::tm tm = *std::localtime(&t);
+			buffer << std::put_time(&tm, "%d-%m-%Y_%H-%M-%S");
+			// Ensure the logs folder exists inside the pref path (if it exists), as spdlog fails to create the file if the folder does not exist AND it is an absolute path.
+			if (prefPath)
+				std::filesystem::create_directories(fmt::format("{}Logs", prefPath));
+			std::string path = fmt::format("{}Logs{}{}.txt", prefPath != nullptr ? prefPath : "", static_cast<char>(std::filesystem::path::preferred_separator), buffer.str());
+			sinks.push_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(path));
+
+			sinks.push_back(std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
+		}
+		else
+			sinks.push_back(std::make_shared<spdlog::sinks::stderr_color_sink_mt>());
 		
-		s_Chip8EmulatorLogger = std::make_shared<spdlog::logger>("Chip-8", std::begin(sinks), std::end(sinks));
+		if (mode == LogMode::Async)
+		{
+			s_LogThreadPool = std::make_shared<spdlog::details::thread_pool>(AsyncQueueSize, 1);
+			s_Chip8EmulatorLogger = std::make_shared<spdlog::async_logger>("Chip-8", std::begin(sinks), std::end(sinks), s_LogThreadPool,
+				spdlog::async_overflow_policy::overrun_oldest);
+		}
+		else
+			s_Chip8EmulatorLogger = std::make_shared<spdlog::logger>("Chip-8", std::begin(sinks), std::end(sinks));
 		s_Chip8EmulatorLogger->set_level(spdlog::level::trace);
+		// Anything that went wrong is flushed as soon as it's written, and everything else within a second, from spdlog's
+		// own flusher thread, which only sees loggers that are registered
+		s_Chip8EmulatorLogger->flush_on(spdlog::level::warn);
+		spdlog::register_logger(s_Chip8EmulatorLogger);
+		spdlog::flush_every(std::chrono::seconds(1));
 	}
 }
+
+void ShutdownLog()
+{
+	static std::mutex shutdownMutex;
+	std::lock_guard lock(shutdownMutex);
+	if (!s_Chip8EmulatorLogger)
+		return;
+
+	// Anything logged from here on is dropped, rather than queued for a thread that's gone. The logger itself is kept, as
+	// other threads may still be holding it.
+	s_Chip8EmulatorLogger->flush();
+	s_Chip8EmulatorLogger->set_level(spdlog::level::off);
+	// Stops the flusher thread and drops the registered loggers, then the pool writes out whatever's still queued and joins
+	spdlog::shutdown();
+	s_LogThreadPool.reset();
+}
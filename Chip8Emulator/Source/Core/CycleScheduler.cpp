@@ -0,0 +1,92 @@
+#include "c8pch.h"
+#include "Core/CycleScheduler.h"
+
+#include <chrono>
+#include <thread>
+
+CycleScheduler::CycleScheduler(const SchedulerClock clock)
+	: m_Clock(clock)
+{
+	Reset();
+}
+
+void CycleScheduler::Reset()
+{
+	m_LastTime = m_Clock();
+	m_CycleRemainder = 0;
+	m_CycleCredit = 0;
+	m_TickRemainder = 0;
+	m_TimerEpoch = m_LastTime;
+	m_TimerTicks = 0;
+}
+
+uint32_t CycleScheduler::Advance(const int cyclesPerSecond)
+{
+	const uint64_t now = m_Clock();
+	const uint64_t elapsed = std::min(now - m_LastTime, MaxCatchUp);
+	m_LastTime = now;
+
+	// Fixed point, so the fraction of an instruction that didn't make it into this batch still counts towards the next
+	const uint64_t rate = static_cast<uint64_t>(std::max(cyclesPerSecond, 1));
+	const uint64_t owed = elapsed * rate + m_CycleRemainder;
+	m_CycleCredit += owed / NanosecondsPerSecond;
+	m_CycleRemainder = owed % NanosecondsPerSecond;
+	m_CycleCredit = std::min(m_CycleCredit, rate * MaxCatchUp / NanosecondsPerSecond + 1);
+
+	// Ticks are counted from the epoch rather than added up, as 1/60s isn't a whole number of nanoseconds
+	const uint64_t dueTicks = (now - m_TimerEpoch) * TimerFrequency / NanosecondsPerSecond;
+	uint64_t ticks = dueTicks - m_TimerTicks;
+	m_TimerTicks = dueTicks;
+	constexpr uint64_t maxTicks = MaxCatchUp * TimerFrequency / NanosecondsPerSecond;
+	if (ticks > maxTicks)
+	{
+		ticks = maxTicks;
+		m_TimerEpoch = now;
+		m_TimerTicks = 0;
+	}
+	return static_cast<uint32_t>(ticks);
+}
+
+void CycleScheduler::AdvanceTick(const int cyclesPerSecond)
+{
+	const uint64_t owed = static_cast<uint64_t>(std::max(cyclesPerSecond, 1)) + m_TickRemainder;
+	m_CycleCredit += owed / TimerFrequency;
+	m_TickRemainder = owed % TimerFrequency;
+}
+
+uint64_t CycleScheduler::GetNextTickTime() const
+{
+	// Rounded up, so waking at this time always finds the tick due
+	return m_TimerEpoch + ((m_TimerTicks + 1) * NanosecondsPerSecond + TimerFrequency - 1) / TimerFrequency;
+}
+
+void CycleScheduler::WaitUntil(const uint64_t deadline)
+{
+	uint64_t now = m_Clock();
+	if (now >= deadline)
+		return;
+
+	if (deadline - now > m_SpinMargin)
+	{
+		const uint64_t wakeTarget = deadline - m_SpinMargin;
+		std::this_thread::sleep_for(std::chrono::nanoseconds(wakeTarget - now));
+
+		// Widen the margin straight away if the sleep woke up later than it allowed for, and narrow it slowly otherwise
+		now = m_Clock();
+		const uint64_t late = now > wakeTarget ? now - wakeTarget : 0;
+		const uint64_t wanted = late + MinSpinMargin / 2;
+		if (wanted > m_SpinMargin)
+			m_SpinMargin = wanted;
+		else
+			m_SpinMargin -= (m_SpinMargin - wanted) / 16;
+		m_SpinMargin = std::clamp(m_SpinMargin, MinSpinMargin, MaxSpinMargin);
+	}
+
+	while (m_Clock() < deadline)
+		std::this_thread::yield();
+}
+
+uint64_t CycleScheduler::GetSteadyClockTime()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
@@ -0,0 +1,36 @@
+#include "c8pch.h"
+#include "Core/DisplayFrame.h"
+
+void DisplayFrame::ResolveRows(uint32_t* pixels, const uint32_t* palette, const uint16_t firstRow, const uint16_t rowCount) const
+{
+	constexpr uint8_t MaxPlanes = 4;
+	C8_ASSERT(Planes <= MaxPlanes, "Too many planes to resolve");
+
+	const uint32_t planeWords = RowWords * Height;
+	const uint32_t firstWord = firstRow * RowWords;
+	const uint32_t lastWord = std::min<uint32_t>(firstRow + rowCount, Height) * RowWords;
+	for (uint32_t word = firstWord; word < lastWord; word++)
+	{
+		uint64_t planes[MaxPlanes] = { 0 };
+		uint64_t anySet = 0;
+		for (uint8_t plane = 0; plane < Planes; plane++)
+		{
+			planes[plane] = Pixels[plane * planeWords + word];
+			anySet |= planes[plane];
+		}
+
+		uint32_t* out = pixels + (word - firstWord) * 64;
+		if (!anySet)
+		{
+			std::fill(out, out + 64, palette[0]);
+			continue;
+		}
+		for (int bit = 63; bit >= 0; bit--)
+		{
+			uint8_t index = 0;
+			for (uint8_t plane = 0; plane < Planes; plane++)
+				index |= static_cast<uint8_t>((planes[plane] >> bit & 1) << plane);
+			*out++ = palette[index];
+		}
+	}
+}
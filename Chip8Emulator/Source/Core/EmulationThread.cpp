@@ -0,0 +1,273 @@
+#include "c8pch.h"
+#include "Core/EmulationThread.h"
+
+EmulationThread::EmulationThread(Emulator& emulator, const SchedulerClock clock)
+	: m_Emulator(emulator), m_Scheduler(clock)
+{ }
+
+EmulationThread::~EmulationThread()
+{
+	Stop();
+	// The emulator outlives the thread, but not the profiler
+	if (m_Profiler)
+		m_Emulator.SetProfiler(nullptr);
+}
+
+void EmulationThread::Start()
+{
+	if (IsStarted())
+		return;
+
+	// Publish the starting state straight away, so the UI has something to show before the first frame has run
+	PublishFrame();
+	m_StopRequested = false;
+	m_Thread = std::thread(&EmulationThread::ThreadMain, this);
+}
+
+void EmulationThread::Stop()
+{
+	if (!IsStarted())
+		return;
+
+	m_StopRequested = true;
+	m_Thread.join();
+}
+
+bool EmulationThread::PushInput(const EmulatorInput& input)
+{
+	if (m_Inputs.Push(input))
+		return true;
+	C8_WARN("Emulator input queue is full, dropping input");
+	return false;
+}
+
+void EmulationThread::LoadRom(std::vector<uint8_t> rom, const CompatibilityMode mode, const int cyclesPerSecond)
+{
+	std::lock_guard lock(m_PendingRomMutex);
+	m_PendingRom = std::move(rom);
+	m_PendingRomMode = mode;
+	m_PendingRomCyclesPerSecond = cyclesPerSecond;
+	m_HasPendingRom.store(true, std::memory_order_release);
+}
+
+bool EmulationThread::AcquireFrame()
+{
+	return m_Frames.Acquire();
+}
+
+void EmulationThread::ThreadMain()
+{
+	m_Scheduler.Reset();
+	m_StatsStartTime = m_Scheduler.Now();
+
+	while (!m_StopRequested)
+	{
+		EmulatorInput input;
+		while (m_Inputs.Pop(input))
+			ProcessInput(input);
+		if (m_HasPendingRom.load(std::memory_order_acquire))
+			LoadPendingRom();
+
+		// A stopped emulator has nothing to fast-forward, so it waits in real time like usual, as does rewinding
+		const bool turbo = m_TurboRequested && m_Emulator.IsRunning() && !m_Rewinding;
+		if (turbo != m_InTurbo)
+		{
+			m_InTurbo = turbo;
+			// Pick real time back up from now, rather than owing everything since turbo started
+			m_Scheduler.Reset();
+		}
+		if (m_InTurbo)
+		{
+			RunTurboFrame();
+			continue;
+		}
+
+		// Usually one tick, as the thread sleeps until the next one is due. If it has fallen behind, the instructions owed
+		// are shared out between the ticks so the timers still count down at the right points in between.
+		const uint32_t ticks = m_Scheduler.Advance(m_Emulator.GetCyclesPerSecond());
+		for (uint32_t tick = 0; tick < ticks; tick++)
+		{
+			const uint64_t cycles = m_Scheduler.GetCycleCredit() / (ticks - tick);
+			if (m_Rewinding)
+				RewindFrame(cycles);
+			else
+			{
+				RunFrame(cycles);
+				// Only running states are worth going back to, and a stopped emulator would fill history with the same one
+				if (m_Emulator.IsRunning())
+					m_Rewind.Push(m_Emulator);
+			}
+		}
+		if (ticks > 0)
+			PublishFrame();
+
+		m_Scheduler.WaitUntil(m_Scheduler.GetNextTickTime());
+	}
+}
+
+void EmulationThread::RunCycles(const uint64_t count)
+{
+	if (count == 0)
+		return;
+
+	const uint64_t ran = m_Emulator.Step(count);
+	m_InstructionCount += ran;
+	// A stopped emulator runs nothing, and shouldn't build up a backlog to rush through once it starts again
+	m_Scheduler.ConsumeCycles(m_Emulator.IsRunning() ? ran : count);
+}
+
+void EmulationThread::RunTurboFrame()
+{
+	m_Scheduler.AdvanceTick(m_Emulator.GetCyclesPerSecond());
+	RunFrame(m_Scheduler.GetCycleCredit());
+	const uint64_t now = m_Scheduler.Now();
+	if (m_Emulator.IsRunning() && now - m_LastTurboSnapshotTime >= TurboSnapshotInterval)
+	{
+		m_Rewind.Push(m_Emulator);
+		m_LastTurboSnapshotTime = now;
+	}
+	PublishFrame();
+}
+
+void EmulationThread::RunFrame(const uint64_t cycles)
+{
+	RunCycles(cycles);
+	m_Emulator.TickTimers();
+	m_StatsEmulatedFrames++;
+}
+
+void EmulationThread::RewindFrame(const uint64_t cycles)
+{
+	// Nothing runs, but the tick's instructions are still used up, so there's no backlog to rush through afterwards
+	m_Scheduler.ConsumeCycles(cycles);
+	// Once history runs out, it stays on the oldest snapshot until rewinding is let go
+	m_Rewind.StepBack(m_Emulator);
+}
+
+void EmulationThread::ProcessInput(const EmulatorInput& input)
+{
+	switch (input.InputType)
+	{
+	case EmulatorInput::Type::Key:
+		m_Emulator.SetKeyState(input.Key, input.Pressed);
+		break;
+	case EmulatorInput::Type::CompatibilityMode:
+		m_Emulator.SetCompatibilityMode(static_cast<CompatibilityMode>(input.Value));
+		break;
+	case EmulatorInput::Type::ExecutionBackend:
+		m_Emulator.SetExecutionBackend(static_cast<ExecutionBackend>(input.Value));
+		break;
+	case EmulatorInput::Type::DebugLogs:
+		m_Emulator.SetDebugLogs(input.Pressed);
+		break;
+	case EmulatorInput::Type::CyclesPerSecond:
+		m_Emulator.SetCyclesPerSecond(static_cast<int>(input.Value));
+		break;
+	case EmulatorInput::Type::Turbo:
+		m_TurboRequested = input.Pressed;
+		break;
+	case EmulatorInput::Type::SaveState:
+		if (m_Emulator.SaveState(m_SaveState))
+			C8_INFO("Saved state ({0} bytes)", m_SaveState.size());
+		else
+			m_SaveState.clear();
+		break;
+	case EmulatorInput::Type::LoadState:
+		if (m_SaveState.empty())
+			C8_WARN("No saved state to load");
+		else if (m_Emulator.LoadState(m_SaveState))
+			C8_INFO("Loaded state");
+		break;
+	case EmulatorInput::Type::Rewind:
+		m_Rewinding = input.Pressed;
+		break;
+	case EmulatorInput::Type::Profile:
+		if (input.Pressed)
+		{
+			if (!m_Profiler)
+				m_Profiler = std::make_unique<OpcodeProfiler>();
+			else
+				m_Profiler->Reset();
+			m_Profile = {};
+		}
+		else
+			m_Profiler.reset();
+		m_Emulator.SetProfiler(m_Profiler.get());
+		break;
+	default:
+		C8_ERROR("Unknown emulator input type: {0}", static_cast<int>(input.InputType));
+		break;
+	}
+}
+
+void EmulationThread::LoadPendingRom()
+{
+	std::vector<uint8_t> rom;
+	CompatibilityMode mode;
+	int cyclesPerSecond;
+	{
+		std::lock_guard lock(m_PendingRomMutex);
+		rom.swap(m_PendingRom);
+		mode = m_PendingRomMode;
+		cyclesPerSecond = m_PendingRomCyclesPerSecond;
+		m_HasPendingRom.store(false, std::memory_order_relaxed);
+	}
+
+	m_Emulator.LoadRom(mode, rom);
+	if (cyclesPerSecond > 0)
+		m_Emulator.SetCyclesPerSecond(cyclesPerSecond);
+	// History from the last ROM can't be rewound into
+	m_Rewind.Clear();
+	m_Scheduler.Reset();
+	// Nor does the last ROM's profile say anything about this one
+	if (m_Profiler)
+	{
+		m_Profiler->Reset();
+		m_Profile = {};
+	}
+}
+
+void EmulationThread::PublishFrame()
+{
+	UpdateStats();
+
+	EmulatorFrame& frame = m_Frames.GetWriteBuffer();
+	frame.Sequence = ++m_FrameSequence;
+	m_Emulator.CaptureDisplay(frame.Display);
+	frame.Mode = m_Emulator.GetCompatibilityMode();
+	frame.Backend = m_Emulator.GetExecutionBackend();
+	frame.CyclesPerSecond = m_Emulator.GetCyclesPerSecond();
+	frame.Running = m_Emulator.IsRunning();
+	frame.DebugLogs = m_Emulator.AreDebugLogsEnabled();
+	frame.Turbo = m_InTurbo;
+	frame.HasSaveState = !m_SaveState.empty();
+	frame.Rewinding = m_Rewinding;
+	frame.RewindSeconds = static_cast<float>(m_Rewind.GetStepCount()) / FramesPerSecond;
+	frame.Fault = m_Emulator.GetFault();
+	frame.InstructionCount = m_InstructionCount;
+	frame.SpeedMultiplier = m_SpeedMultiplier;
+	frame.Mips = m_Mips;
+	frame.Profiling = m_Profiler != nullptr;
+	if (frame.Profiling)
+		frame.Profile = m_Profile;
+	m_Frames.Publish();
+}
+
+void EmulationThread::UpdateStats()
+{
+	const uint64_t now = m_Scheduler.Now();
+	const uint64_t elapsed = now - m_StatsStartTime;
+	if (elapsed < StatsInterval)
+		return;
+
+	const double seconds = static_cast<double>(elapsed) / CycleScheduler::NanosecondsPerSecond;
+	m_SpeedMultiplier = static_cast<float>(m_StatsEmulatedFrames / (seconds * FramesPerSecond));
+	m_Mips = static_cast<float>((m_InstructionCount - m_StatsStartInstructions) / (seconds * 1'000'000.0));
+
+	m_StatsStartTime = now;
+	m_StatsStartInstructions = m_InstructionCount;
+	m_StatsEmulatedFrames = 0;
+
+	if (m_Profiler)
+		m_Profiler->TakeSnapshot(m_Profile);
+}
@@ -1,48 +1,116 @@
 #include <c8pch.h>
 #include "Core/Emulator.h"
 
+#include "Core/Aot.h"
+#include "Core/DisplayFrame.h"
+#include "Core/Interpreter.h"
+#include "Core/Jit.h"
+#include "Core/MappedFile.h"
+#include "Core/SaveState.h"
+
+#include <atomic>
+
+// For telling memory buffers apart in ForkInto, even across emulators
+static std::atomic<uint64_t> s_NextMemoryId { 0 };
+
+Emulator::Emulator() = default;
+
+Emulator::~Emulator()
+{
+	delete[] m_Memory;
+	delete[] m_DecodeCache;
+	delete[] m_Display;
+}
+
 void Emulator::SetCompatibilityMode(CompatibilityMode mode)
 {
 	m_CompatibilityMode = mode;
 	Initialise();
 }
 
+void Emulator::SetExecutionBackend(const ExecutionBackend backend)
+{
+	if (backend == m_ExecutionBackend)
+		return;
+
+	m_ExecutionBackend = backend;
+	m_Jit.reset();
+	m_AotProgram = nullptr;
+
+	switch (backend)
+	{
+	case ExecutionBackend::Jit:
+		if constexpr (!Jit::IsSupported())
+		{
+			C8_WARN("The JIT isn't supported on this platform, using the interpreter");
+			m_ExecutionBackend = ExecutionBackend::Interpreter;
+			return;
+		}
+
+		m_Jit = std::make_unique<Jit>(*this);
+		if (!m_Jit->IsValid())
+		{
+			C8_WARN("Failed to start the JIT, using the interpreter");
+			m_Jit.reset();
+			m_ExecutionBackend = ExecutionBackend::Interpreter;
+		}
+		return;
+	case ExecutionBackend::Aot:
+		FindAotProgram();
+		return;
+	default:
+		return;
+	}
+}
+
 void Emulator::LoadRom(CompatibilityMode mode, const std::string& path)
 {
-	SetCompatibilityMode(mode);
+	// Loading resets everything anyway, so the mode only needs setting up again if it's changing
+	if (mode != m_CompatibilityMode || !m_Memory)
+		SetCompatibilityMode(mode);
 	LoadRom(path);
 }
 
 void Emulator::LoadRom(CompatibilityMode mode, const std::vector<uint8_t>& bytes)
 {
-	SetCompatibilityMode(mode);
+	if (mode != m_CompatibilityMode || !m_Memory)
+		SetCompatibilityMode(mode);
 	LoadRomFromBytes(bytes);
 }
 
-void Emulator::LoadRom(const std::string& path)
+void Emulator::LoadRom(const CompatibilityMode mode, const uint8_t* const bytes, const size_t size)
 {
-	std::ifstream file(path);
-	if (file.is_open())
-	{
-		std::vector<uint8_t> bytes;
-		file.seekg(0, std::ios::end);
-		bytes.resize(file.tellg());
-		file.seekg(0, std::ios::beg);
-		file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
-		file.close();
+	if (mode != m_CompatibilityMode || !m_Memory)
+		SetCompatibilityMode(mode);
+	LoadRomFromBytes(bytes, size);
+}
 
-		LoadRomFromBytes(bytes);
-	}
-	else
+void Emulator::LoadRom(const std::string& path)
+{
+	const MappedFile file(path);
+	if (!file.IsOpen())
 	{
 		C8_ERROR("Failed to open file: {}", path);
+		return;
 	}
+	LoadRomFromBytes(file.GetData(), file.GetSize());
 }
 
-void Emulator::LoadRomFromBytes(const std::vector<uint8_t>& bytes)
+void Emulator::LoadRomFromBytes(const uint8_t* const bytes, const size_t size)
 {
 	if (!m_Memory)
 		Initialise();
+	else
+	{
+		ResetEmulatorState();
+		AddFontToMemory();
+	}
+
+	// Programs are loaded at 0x200; everything below that was reserved for the interpreter itself on the original hardware.
+	m_Running = WriteToMemory(0x200, bytes, size);
+	m_RomSize = m_Running ? static_cast<uint32_t>(size) : 0;
+	if (m_ExecutionBackend == ExecutionBackend::Aot)
+		FindAotProgram();
 }
 
 bool Emulator::WriteToMemory(const int offset, const void* const data, const size_t size)
@@ -53,24 +121,352 @@ bool Emulator::WriteToMemory(const int offset, const void* const data, const siz
 		return false;
 	}
 
-	if (offset + size > m_CurrentMemorySize)
+	// Written so nothing can overflow, and a negative offset doesn't wrap round to a valid one
+	if (offset < 0 || static_cast<uint32_t>(offset) > m_CurrentMemorySize || size > m_CurrentMemorySize - static_cast<uint32_t>(offset))
 	{
 		C8_ERROR("WriteToMemory: Attempted to write out of bounds: {0} + {1} > {2}", offset, size, m_CurrentMemorySize);
 		return false;
 	}
 
-	memcpy_s(m_Memory + offset, m_CurrentMemorySize - offset, data, size);
+	memcpy(m_Memory + offset, data, size);
+	InvalidateCode(offset, static_cast<uint32_t>(size));
 	
 	return true;
 }
 
+uint64_t Emulator::Step(const uint64_t instructionCount)
+{
+	if (!m_Running)
+		return 0;
+	if (m_Profiler)
+		return m_Interpreter->RunProfiled(*this, instructionCount);
+	if (m_AotProgram)
+		return m_AotProgram->Run(*this, instructionCount);
+	if (m_Jit)
+		return m_Jit->Run(instructionCount);
+	return m_Interpreter->Run(*this, instructionCount);
+}
+
+void Emulator::TickTimers()
+{
+	if (m_DelayTimer > 0)
+		m_DelayTimer--;
+	if (m_SoundTimer > 0)
+		m_SoundTimer--;
+}
+
+void Emulator::SetKeyState(const uint8_t key, const bool pressed)
+{
+	C8_ASSERT(key < 16, "Invalid key in SetKeyState");
+	if (pressed)
+		m_KeyStates |= BIT(key & 0xF);
+	else
+		m_KeyStates &= static_cast<uint16_t>(~BIT(key & 0xF));
+}
+
+bool Emulator::HasSameState(const Emulator& other) const
+{
+	return m_Running == other.m_Running
+		&& m_ProgramCounter == other.m_ProgramCounter
+		&& m_IRegister == other.m_IRegister
+		&& m_StackPointer == other.m_StackPointer
+		&& memcmp(m_Stack, other.m_Stack, m_StackPointer * sizeof(uint16_t)) == 0
+		&& m_Fault == other.m_Fault
+		&& m_DelayTimer == other.m_DelayTimer
+		&& m_SoundTimer == other.m_SoundTimer
+		&& memcmp(m_VRegisters, other.m_VRegisters, sizeof(m_VRegisters)) == 0
+		&& memcmp(m_FlagRegisters, other.m_FlagRegisters, sizeof(m_FlagRegisters)) == 0
+		&& m_HiRes == other.m_HiRes
+		&& m_WaitingKey == other.m_WaitingKey
+		&& m_RandomState == other.m_RandomState
+		&& m_CurrentMemorySize == other.m_CurrentMemorySize
+		&& memcmp(m_Memory, other.m_Memory, m_CurrentMemorySize) == 0
+		&& m_PlaneMask == other.m_PlaneMask
+		&& memcmp(m_AudioPattern, other.m_AudioPattern, sizeof(m_AudioPattern)) == 0
+		&& m_AudioPitch == other.m_AudioPitch
+		&& m_DisplayWidth == other.m_DisplayWidth && m_DisplayHeight == other.m_DisplayHeight && m_DisplayPlanes == other.m_DisplayPlanes
+		&& memcmp(m_Display, other.m_Display, m_DisplayPlanes * m_DisplayRowWords * m_DisplayHeight * sizeof(uint64_t)) == 0;
+}
+
+size_t Emulator::GetSaveStateSize() const
+{
+	return SaveStateFormat::FixedSize + m_CurrentMemorySize + static_cast<size_t>(m_DisplayPlanes) * m_DisplayRowWords * m_DisplayHeight * sizeof(uint64_t);
+}
+
+size_t Emulator::SaveState(uint8_t* const buffer, const size_t bufferSize) const
+{
+	const size_t size = GetSaveStateSize();
+	if (!m_Memory || !m_Display || bufferSize < size)
+		return 0;
+
+	const uint32_t displayWords = m_DisplayPlanes * m_DisplayRowWords * m_DisplayHeight;
+	SaveStateWriter writer(buffer);
+	writer.WriteBytes(SaveStateFormat::Magic, sizeof(SaveStateFormat::Magic));
+	writer.Write16(SaveStateFormat::Version);
+	writer.Write8(static_cast<uint8_t>(m_CompatibilityMode));
+	writer.Write8(0);
+	writer.Write32(m_CurrentMemorySize);
+	writer.Write32(displayWords);
+
+	writer.Write8(m_Running);
+	writer.Write8(static_cast<uint8_t>(m_Fault));
+	writer.Write16(m_FaultAddress);
+	writer.Write16(m_ProgramCounter);
+	writer.Write16(m_IRegister);
+	writer.Write8(m_StackPointer);
+	writer.Write8(m_DelayTimer);
+	writer.Write8(m_SoundTimer);
+	writer.Write8(m_HiRes);
+	writer.Write8(m_PlaneMask);
+	writer.Write8(m_AudioPitch);
+	writer.Write8(m_WaitingKey);
+	writer.Write8(0);
+	writer.Write32(m_RandomState);
+	writer.Write32(m_RomSize);
+	writer.WriteBytes(m_VRegisters, sizeof(m_VRegisters));
+	writer.WriteBytes(m_FlagRegisters, sizeof(m_FlagRegisters));
+	writer.WriteBytes(m_AudioPattern, sizeof(m_AudioPattern));
+	for (const uint16_t address : m_Stack)
+		writer.Write16(address);
+
+	writer.WriteBytes(m_Memory, m_CurrentMemorySize);
+	writer.WriteWords(m_Display, displayWords);
+	C8_ASSERT(writer.GetCursor() == buffer + size, "Save state size doesn't match what was written");
+	return size;
+}
+
+bool Emulator::SaveState(std::vector<uint8_t>& state) const
+{
+	state.resize(GetSaveStateSize());
+	return SaveState(state.data(), state.size()) != 0;
+}
+
+bool Emulator::LoadState(const uint8_t* const data, const size_t size)
+{
+	if (!data || size < SaveStateFormat::FixedSize || memcmp(data, SaveStateFormat::Magic, sizeof(SaveStateFormat::Magic)) != 0)
+	{
+		C8_ERROR("LoadState: Not a save state");
+		return false;
+	}
+
+	SaveStateReader reader(data + sizeof(SaveStateFormat::Magic));
+	const uint16_t version = reader.Read16();
+	if (version != SaveStateFormat::Version)
+	{
+		C8_ERROR("LoadState: Unsupported save state version {0}, expected {1}", version, SaveStateFormat::Version);
+		return false;
+	}
+	const uint8_t mode = reader.Read8();
+	reader.Read8();
+	const uint32_t memorySize = reader.Read32();
+	const uint32_t displayWords = reader.Read32();
+	if (mode >= static_cast<uint8_t>(CompatibilityMode::NumModes)
+		|| size != SaveStateFormat::FixedSize + memorySize + static_cast<size_t>(displayWords) * sizeof(uint64_t))
+	{
+		C8_ERROR("LoadState: Save state is corrupt");
+		return false;
+	}
+
+	// Everything is checked against the layout of the state's mode before anything changes, so a state that can't be
+	// loaded leaves the emulator as it was, even if it's from another mode
+	ModeLayout layout;
+	if (!GetModeLayout(static_cast<CompatibilityMode>(mode), layout) || memorySize != layout.MemorySize || displayWords != layout.GetDisplayWords())
+	{
+		C8_ERROR("LoadState: Save state doesn't match {0}'s memory or display", GetCompatibilityModeName(static_cast<CompatibilityMode>(mode)));
+		return false;
+	}
+	// As are the fields that index into something, see SaveState.h for where they are in the body
+	SaveStateReader bodyReader = reader;
+	bodyReader.Skip(1);
+	const uint8_t fault = bodyReader.Read8();
+	bodyReader.Skip(2 + 2 + 2 + 6);
+	const uint8_t waitingKey = bodyReader.Read8();
+	// StackUnderflow is the last fault there is
+	if (fault > static_cast<uint8_t>(EmulatorFault::StackUnderflow) || (waitingKey > 0xF && waitingKey != 0xFF))
+	{
+		C8_ERROR("LoadState: Save state is corrupt");
+		return false;
+	}
+
+	if (!m_Memory || static_cast<CompatibilityMode>(mode) != m_CompatibilityMode)
+		SetCompatibilityMode(static_cast<CompatibilityMode>(mode));
+	C8_ASSERT(memorySize == m_CurrentMemorySize && displayWords == static_cast<uint32_t>(m_DisplayPlanes * m_DisplayRowWords * m_DisplayHeight),
+		"The buffers CreateBuffers made don't match GetModeLayout");
+
+	m_Running = reader.Read8() != 0;
+	m_Fault = static_cast<EmulatorFault>(reader.Read8());
+	m_FaultAddress = reader.Read16();
+	m_ProgramCounter = reader.Read16();
+	m_IRegister = reader.Read16();
+	m_StackPointer = std::min(reader.Read8(), m_StackDepth);
+	m_DelayTimer = reader.Read8();
+	m_SoundTimer = reader.Read8();
+	m_HiRes = reader.Read8() != 0;
+	m_PlaneMask = reader.Read8();
+	m_AudioPitch = reader.Read8();
+	m_WaitingKey = reader.Read8();
+	reader.Read8();
+	m_RandomState = reader.Read32();
+	m_RomSize = std::min(reader.Read32(), m_CurrentMemorySize);
+	reader.ReadBytes(m_VRegisters, sizeof(m_VRegisters));
+	reader.ReadBytes(m_FlagRegisters, sizeof(m_FlagRegisters));
+	reader.ReadBytes(m_AudioPattern, sizeof(m_AudioPattern));
+	for (uint16_t& address : m_Stack)
+		address = reader.Read16();
+
+	// Only the pages of memory that differ are copied and invalidated, so loading a state close to the current one (like
+	// rewinding does) keeps almost all of the decode cache and translated code, rather than rebuilding it from scratch,
+	// and only those pages are marked dirty.
+	const uint8_t* const memory = reader.GetCursor();
+	for (uint32_t offset = 0; offset < m_CurrentMemorySize; offset += MemoryPageSize)
+	{
+		if (memcmp(m_Memory + offset, memory + offset, MemoryPageSize) == 0)
+			continue;
+		memcpy(m_Memory + offset, memory + offset, MemoryPageSize);
+		InvalidateCode(offset, MemoryPageSize);
+	}
+	reader.Skip(m_CurrentMemorySize);
+	reader.ReadWords(m_Display, displayWords);
+
+	// Compiled code is found by what's been loaded at 0x200
+	if (m_ExecutionBackend == ExecutionBackend::Aot)
+		FindAotProgram();
+	MarkDisplayDirty();
+	return true;
+}
+
+void Emulator::ForkInto(Emulator& child) const
+{
+	if (&child == this)
+		return;
+	if (!m_Memory)
+	{
+		C8_ERROR("ForkInto called before initialisation");
+		return;
+	}
+
+	// Only a child in another mode needs its buffers recreating; otherwise they're reused as they are
+	if (!child.m_Memory || child.m_CompatibilityMode != m_CompatibilityMode)
+	{
+		child.m_CompatibilityMode = m_CompatibilityMode;
+		child.m_DebugLogs = false;
+		child.Initialise();
+	}
+	child.CopyMemoryFrom(*this);
+
+	memcpy(child.m_Display, m_Display, m_DisplayPlanes * m_DisplayRowWords * m_DisplayHeight * sizeof(uint64_t));
+	child.MarkDisplayDirty();
+	child.m_Running = m_Running;
+	child.m_RomSize = m_RomSize;
+	child.m_ProgramCounter = m_ProgramCounter;
+	child.m_IRegister = m_IRegister;
+	memcpy(child.m_Stack, m_Stack, sizeof(m_Stack));
+	child.m_StackPointer = m_StackPointer;
+	child.m_DelayTimer = m_DelayTimer;
+	child.m_SoundTimer = m_SoundTimer;
+	memcpy(child.m_VRegisters, m_VRegisters, sizeof(m_VRegisters));
+	memcpy(child.m_FlagRegisters, m_FlagRegisters, sizeof(m_FlagRegisters));
+	child.m_PlaneMask = m_PlaneMask;
+	memcpy(child.m_AudioPattern, m_AudioPattern, sizeof(m_AudioPattern));
+	child.m_AudioPitch = m_AudioPitch;
+	child.m_HiRes = m_HiRes;
+	child.m_KeyStates = m_KeyStates;
+	child.m_WaitingKey = m_WaitingKey;
+	child.m_RandomState = m_RandomState;
+	child.m_Fault = m_Fault;
+	child.m_FaultAddress = m_FaultAddress;
+	child.m_CyclesPerSecond = m_CyclesPerSecond;
+	child.m_DebugLogs = m_DebugLogs;
+
+	// Compiled code is found by what's been loaded at 0x200, which is the same as here
+	if (child.m_ExecutionBackend == ExecutionBackend::Aot)
+		child.m_AotProgram = m_ExecutionBackend == ExecutionBackend::Aot ? m_AotProgram : AotRegistry::Find(m_CompatibilityMode, m_Memory + 0x200, m_RomSize);
+}
+
+std::unique_ptr<Emulator> Emulator::Fork() const
+{
+	// The buffers are made straight in this mode and left as they are, rather than initialised, as ForkInto copies over
+	// all of them
+	auto child = std::make_unique<Emulator>();
+	child->m_CompatibilityMode = m_CompatibilityMode;
+	child->m_Interpreter = m_Interpreter;
+	child->m_DebugLogs = false;
+	child->CreateBuffers();
+	child->SetExecutionBackend(m_ExecutionBackend);
+	ForkInto(*child);
+	return child;
+}
+
+void Emulator::CopyMemoryFrom(const Emulator& source)
+{
+	C8_ASSERT(m_CurrentMemorySize == source.m_CurrentMemorySize, "CopyMemoryFrom needs memory the same size");
+
+	// Pages written to by either since the last fork from the same buffer are the only ones that can differ
+	if (m_ForkSourceId == source.m_MemoryId)
+	{
+		if (source.m_MemoryVersion == m_ForkSourceVersion && m_MemoryVersion == m_ForkVersion)
+			return;
+		const uint32_t pageCount = GetMemoryPageCount();
+		for (uint32_t page = 0; page < pageCount; page++)
+		{
+			if (source.m_PageVersions[page] <= m_ForkSourceVersion && m_PageVersions[page] <= m_ForkVersion)
+				continue;
+			const uint32_t address = page * MemoryPageSize;
+			memcpy(m_Memory + address, source.m_Memory + address, MemoryPageSize);
+			InvalidateCode(address, MemoryPageSize);
+		}
+	}
+	else
+	{
+		memcpy(m_Memory, source.m_Memory, m_CurrentMemorySize);
+		ResetCode();
+		MarkMemoryDirty();
+	}
+
+	m_ForkSourceId = source.m_MemoryId;
+	m_ForkSourceVersion = source.m_MemoryVersion;
+	m_ForkVersion = m_MemoryVersion;
+}
+
+void Emulator::CaptureDisplay(DisplayFrame& frame)
+{
+	if (!m_Display)
+	{
+		frame.Width = frame.Height = 0;
+		return;
+	}
+
+	frame.Width = m_DisplayWidth;
+	frame.Height = m_DisplayHeight;
+	frame.RowWords = m_DisplayRowWords;
+	frame.Planes = m_DisplayPlanes;
+	frame.Pixels.assign(m_Display, m_Display + m_DisplayPlanes * m_DisplayRowWords * m_DisplayHeight);
+	static_assert(sizeof(frame.DirtyRows) == sizeof(m_DirtyRows), "Dirty row bitmaps should match");
+	memcpy(frame.DirtyRows, m_DirtyRows, sizeof(m_DirtyRows));
+	ClearDirtyRows();
+}
+
+void Emulator::MarkRowsDirty(const uint16_t firstRow, const uint16_t rowCount)
+{
+	const uint16_t lastRow = std::min<uint16_t>(firstRow + rowCount, m_DisplayHeight);
+	for (uint16_t row = firstRow; row < lastRow; row++)
+		m_DirtyRows[row / 64] |= 1ull << (row % 64);
+}
+
 void Emulator::FDE()
 {
 	// Fetch, decode, execute!
+	Interpreter::Step(*this);
 }
 
 void Emulator::Initialise()
 {
+	// Swap in the interpreter compiled for this mode's quirks. The decode cache is filled with its handlers, so do this first.
+	m_Interpreter = &Interpreter::GetVariant(m_CompatibilityMode);
+	// Compiled code is specific to a mode too; it's looked up again when the next ROM is loaded.
+	m_AotProgram = nullptr;
+	m_RomSize = 0;
+
 	CreateBuffers();
 	ResetEmulatorState();
 	AddFontToMemory();
@@ -78,13 +474,15 @@ void Emulator::Initialise()
 	switch (m_CompatibilityMode)
 	{
 	case CompatibilityMode::Chip8:
-		return;
-	case CompatibilityMode::Chip8E:
-	case CompatibilityMode::Chip16:
 	case CompatibilityMode::Chip48:
 	case CompatibilityMode::SuperChip:
 	case CompatibilityMode::XOChip10:
 	case CompatibilityMode::XOChip11:
+		return;
+	case CompatibilityMode::Chip8E:
+		C8_WARN("CHIP-8E specific instructions are not implemented; running with the CHIP-8 instruction set");
+		return;
+	case CompatibilityMode::Chip16:
 		C8_ERROR("Unimplemented compatibility mode: {0}", static_cast<int>(m_CompatibilityMode));
 		break;
 	case CompatibilityMode::NumModes:
@@ -94,70 +492,96 @@ void Emulator::Initialise()
 	}
 }
 
-void Emulator::CreateBuffers()
+bool Emulator::GetModeLayout(const CompatibilityMode mode, ModeLayout& layout)
 {
-	// First, create the memory buffer
-	// Let's find the size of the memory buffer based on the compatibility mode
-	uint32_t memorySize = 0;
-	switch (m_CompatibilityMode)
+	switch (mode)
 	{
 	case CompatibilityMode::Chip8:
 	case CompatibilityMode::Chip8E:
 	case CompatibilityMode::Chip48:
-		memorySize = 4096;
-		m_DisplayWidth = 64;
-		m_DisplayHeight = 32;
-		break;
+		layout = { 4096, 64, 32, 1, 16 };
+		return true;
 	case CompatibilityMode::Chip16:
-		memorySize = 65536;
-		m_DisplayWidth = 320;
-		m_DisplayHeight = 240;
-		break;
+		layout = { 65536, 320, 240, 1, 16 };
+		return true;
 	case CompatibilityMode::SuperChip:
-		memorySize = 65536;
-		m_DisplayWidth = 128;
-		m_DisplayHeight = 64;
-		break;
+		layout = { 65536, 128, 64, 1, 16 };
+		return true;
 	case CompatibilityMode::XOChip10:
 	case CompatibilityMode::XOChip11:
-		memorySize = 65536;
-		break;
+		layout = { 65536, 128, 64, MaxPlanes, MaxStackDepth };
+		return true;
 	default:
+		return false;
+	}
+}
+
+void Emulator::CreateBuffers()
+{
+	// First, create the memory buffer
+	// Let's find the size of the memory buffer based on the compatibility mode
+	const uint32_t oldDisplayWords = m_Display != nullptr ? m_DisplayPlanes * m_DisplayRowWords * m_DisplayHeight : 0;
+	ModeLayout layout;
+	if (!GetModeLayout(m_CompatibilityMode, layout))
+	{
 		C8_ERROR("Unknown compatibility mode in CreateBuffers: {0}", static_cast<int>(m_CompatibilityMode));
 		return;
 	}
+	const uint32_t memorySize = layout.MemorySize;
+	m_DisplayWidth = layout.DisplayWidth;
+	m_DisplayHeight = layout.DisplayHeight;
+	m_DisplayPlanes = layout.DisplayPlanes;
+	m_StackDepth = layout.StackDepth;
 
 	// Now, let's create the memory buffer
-	uint8_t* newMemory = new uint8_t[memorySize];
-	if (m_Memory != nullptr)
+	// Modes with the same memory size keep the buffers they already have, so switching between them doesn't reallocate
+	if (m_Memory == nullptr || memorySize != m_CurrentMemorySize)
 	{
-		// If there is currently memory, copy it over to the new memory
-		// This makes switching compatibility modes during runtime possible - even if it's not recommended
-		// Ensure we don't copy more than the new memory size
-		if (m_DebugLogs && m_CurrentMemorySize > memorySize)
+		uint8_t* newMemory = new uint8_t[memorySize];
+		if (m_Memory != nullptr)
 		{
-			C8_INFO("Current memory size is larger than new memory size: {0} bytes > {1} bytes", m_CurrentMemorySize, memorySize);
+			// If there is currently memory, copy it over to the new memory
+			// This makes switching compatibility modes during runtime possible - even if it's not recommended
+			// Ensure we don't copy more than the new memory size
+			if (m_DebugLogs && m_CurrentMemorySize > memorySize)
+			{
+				C8_INFO("Current memory size is larger than new memory size: {0} bytes > {1} bytes", m_CurrentMemorySize, memorySize);
+			}
+			m_CurrentMemorySize = std::min(m_CurrentMemorySize, memorySize);
+			if (m_DebugLogs)
+				C8_INFO("Copying {0} bytes of memory to new memory", m_CurrentMemorySize);
+			memcpy(newMemory, m_Memory, m_CurrentMemorySize);
+			delete[] m_Memory;
 		}
-		m_CurrentMemorySize = std::min(m_CurrentMemorySize, memorySize);
+		m_Memory = newMemory;
+		m_CurrentMemorySize = memorySize;
 		if (m_DebugLogs)
-			C8_INFO("Copying {0} bytes of memory to new memory", m_CurrentMemorySize);
-		memcpy(newMemory, m_Memory, m_CurrentMemorySize);
-		delete[] m_Memory;
+			C8_INFO("Memory buffer created with size: {0} bytes", m_CurrentMemorySize);
+
+		C8_ASSERT(memorySize % MemoryPageSize == 0 && memorySize / MemoryPageSize <= MaxMemoryPages, "Memory must be whole pages that the dirty page tracking allows for");
+		// The decode cache has an entry for every even address, so it needs recreating alongside memory.
+		delete[] m_DecodeCache;
+		m_DecodeCache = new DecodedInstruction[memorySize / 2];
 	}
-	m_Memory = newMemory;
-	m_CurrentMemorySize = memorySize;
-	if (m_DebugLogs)
-		C8_INFO("Memory buffer created with size: {0} bytes", m_CurrentMemorySize);
+	// The decodes in the cache are for the old mode's interpreter either way
+	m_MemoryId = ++s_NextMemoryId;
+	m_ForkSourceId = 0;
+	ResetCode();
+	MarkMemoryDirty();
 
-	uint8_t* newDisplay = new uint8_t[m_DisplayWidth * m_DisplayHeight];
-	if (m_Display)
+	C8_ASSERT(m_DisplayWidth % 64 == 0, "Display width must be a multiple of 64");
+	C8_ASSERT(m_DisplayHeight <= MaxDisplayHeight, "Display is taller than the dirty row tracking allows for");
+	const uint32_t displayWords = m_DisplayPlanes * (m_DisplayWidth / 64) * m_DisplayHeight;
+	if (displayWords != oldDisplayWords)
 	{
 		// TODO: Should we copy the display buffer as well?
 		delete[] m_Display;
+		m_Display = new uint64_t[displayWords];
+		if (m_DebugLogs)
+			C8_INFO("Display buffer created with size {0}x{1} and {2} plane(s), totalling {3} bytes", m_DisplayWidth, m_DisplayHeight, m_DisplayPlanes,
+				displayWords * sizeof(uint64_t));
 	}
-	m_Display = newDisplay;
-	if (m_DebugLogs)
-		C8_INFO("Display buffer created with size {0}x{1}, totalling {2} bytes", m_DisplayWidth, m_DisplayHeight, m_DisplayWidth * m_DisplayHeight);
+	m_DisplayRowWords = m_DisplayWidth / 64;
 }
 
 void Emulator::ResetEmulatorState()
@@ -173,30 +597,43 @@ void Emulator::ResetEmulatorState()
 	ZeroDisplay();
 	m_ProgramCounter = 0x200;
 	m_IRegister = 0;
-	while (!m_Stack.empty()) // Clear the stack
-		m_Stack.pop();
+	m_StackPointer = 0;
 	m_DelayTimer = 0;
 	m_SoundTimer = 0;
 	for (int i = 0; i < 16; i++)
 		m_VRegisters[i] = 0;
+	m_HiRes = false;
+	m_PlaneMask = 1;
+	memset(m_AudioPattern, 0, sizeof(m_AudioPattern));
+	m_AudioPitch = 64;
+	m_KeyStates = 0;
+	m_WaitingKey = 0xFF;
+	m_Fault = EmulatorFault::None;
+	m_FaultAddress = 0;
+	m_Running = false;
 }
 
 void Emulator::ZeroMem()
 {
-	C8_INFO("Zeroing memory");
+	if (m_DebugLogs)
+		C8_INFO("Zeroing memory");
 	if (!m_Memory)
 	{
 		C8_ERROR("Memory buffer is null in ZeroMem");
 		return;
 	}
 	memset(m_Memory, 0, m_CurrentMemorySize);
+	ResetCode();
+	MarkMemoryDirty();
 }
 
 void Emulator::ZeroDisplay()
 {
-	C8_INFO("Zeroing display");
+	if (m_DebugLogs)
+		C8_INFO("Zeroing display");
 	C8_ASSERT(m_Display != nullptr, "Display buffer is null in ZeroDisplay");
-	memset(m_Display, 0, m_DisplayWidth * m_DisplayHeight);
+	memset(m_Display, 0, m_DisplayPlanes * m_DisplayRowWords * m_DisplayHeight * sizeof(uint64_t));
+	MarkDisplayDirty();
 }
 
 void Emulator::AddFontToMemory()
@@ -221,5 +658,85 @@ void Emulator::AddFontToMemory()
 	};
 
 	// Apparently, most implementations of the CHIP-8 interpreter start the font at 0x050
-	memcpy(m_Memory + 0x050, font.data(), font.size());
+	memcpy(m_Memory + FontAddress, font.data(), font.size());
+	InvalidateCode(FontAddress, static_cast<uint32_t>(font.size()));
+
+	// SUPER-CHIP only had big digits 0-9, but XO-Chip programs expect A-F too, and there's no harm in always having them.
+	const std::vector<uint8_t> bigFont = {
+		0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+		0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+		0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+		0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+		0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+		0x3E, 0x7C, 0xC0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+		0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+		0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+		0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+		0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+		0xFC, 0xFE, 0xC3, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xFE, 0xFC, // B
+		0x3C, 0x7E, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0x7E, 0x3C, // C
+		0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+	};
+	memcpy(m_Memory + BigFontAddress, bigFont.data(), bigFont.size());
+	InvalidateCode(BigFontAddress, static_cast<uint32_t>(bigFont.size()));
+}
+
+void Emulator::InvalidateCode(const uint32_t address, const uint32_t size)
+{
+	Interpreter::InvalidateDecodeCache(*this, address, size);
+	if (m_Jit)
+		m_Jit->Invalidate(address, size);
+
+	if (size == 0)
+		return;
+	// Like the decode cache, the range might wrap around the end of memory
+	const uint32_t pageCount = GetMemoryPageCount();
+	const uint32_t first = (address & (m_CurrentMemorySize - 1)) / MemoryPageSize;
+	const uint32_t count = std::min((address % MemoryPageSize + size + MemoryPageSize - 1) / MemoryPageSize, pageCount);
+	const uint64_t version = ++m_MemoryVersion;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uint32_t page = (first + i) & (pageCount - 1);
+		m_DirtyPages[page / 64] |= 1ull << (page % 64);
+		m_PageVersions[page] = version;
+	}
+}
+
+void Emulator::MarkMemoryDirty()
+{
+	const uint32_t pageCount = GetMemoryPageCount();
+	for (uint32_t word = 0; word < MaxMemoryPages / 64; word++)
+	{
+		const uint32_t pages = std::min(pageCount - std::min(pageCount, word * 64), 64u);
+		m_DirtyPages[word] = pages == 64 ? ~0ull : (1ull << pages) - 1;
+	}
+	std::fill_n(m_PageVersions, pageCount, ++m_MemoryVersion);
+}
+
+void Emulator::FindAotProgram()
+{
+	m_AotProgram = m_Memory && m_RomSize ? AotRegistry::Find(m_CompatibilityMode, m_Memory + 0x200, m_RomSize) : nullptr;
+	if (!m_RomSize)
+		return;
+	if (!m_AotProgram)
+		C8_WARN("No statically recompiled code for this ROM, using the interpreter");
+	else if (m_DebugLogs)
+		C8_INFO("Running statically recompiled {0}", m_AotProgram->Name);
+}
+
+void Emulator::RaiseFault(const EmulatorFault fault)
+{
+	m_Fault = fault;
+	m_FaultAddress = static_cast<uint16_t>(m_ProgramCounter - 2);
+	m_Running = false;
+}
+
+void Emulator::ResetCode()
+{
+	Interpreter::ResetDecodeCache(*this);
+	if (m_Jit)
+		m_Jit->Flush();
 }
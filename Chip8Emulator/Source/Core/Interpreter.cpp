@@ -0,0 +1,997 @@
+#include "c8pch.h"
+#include "Core/Interpreter.h"
+
+#include <array>
+
+#include "Core/Emulator.h"
+#include "Core/OpcodeProfiler.h"
+
+// SSE2 is always there on x64. AVX2 is only used when the build targets it (premake --avx2).
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define C8_DISPLAY_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define C8_DISPLAY_SSE2 1
+#endif
+
+// -----------------------------------------------------------------------------------------------
+// Dispatch tables
+// The builders are constexpr, so the tables are constant initialised and there is no static initialisation order to worry about.
+// -----------------------------------------------------------------------------------------------
+template <typename Quirks>
+struct Interpreter::DispatchTables
+{
+	// Groups that need a second-level table are left null here; Decode resolves them.
+	static constexpr std::array<OpcodeHandler, 16> BuildMainTable()
+	{
+		return {
+			nullptr,          &Op_1NNN,         &Op_2NNN, &Op_3XNN<Quirks>,
+			&Op_4XNN<Quirks>, &Op_5XY0<Quirks>, &Op_6XNN, &Op_7XNN,
+			nullptr,          &Op_9XY0<Quirks>, &Op_ANNN, &Op_BNNN<Quirks>,
+			&Op_CXNN, &Op_DXYN<Quirks>, nullptr, nullptr
+		};
+	}
+
+	static constexpr std::array<OpcodeHandler, 256> BuildSystemTable()
+	{
+		std::array<OpcodeHandler, 256> table = {};
+		for (OpcodeHandler& handler : table)
+			handler = &Op_Invalid;
+		table[0xE0] = &Op_00E0;
+		table[0xEE] = &Op_00EE;
+		if constexpr (Quirks::SuperChipInstructions)
+		{
+			for (uint8_t n = 0x1; n <= 0xF; n++)
+				table[0xC0 | n] = &Op_00CN;
+			table[0xFB] = &Op_00FB;
+			table[0xFC] = &Op_00FC;
+			table[0xFD] = &Op_00FD;
+			table[0xFE] = &Op_00FE;
+			table[0xFF] = &Op_00FF;
+		}
+		if constexpr (Quirks::XOChipInstructions)
+		{
+			for (uint8_t n = 0x1; n <= 0xF; n++)
+				table[0xD0 | n] = &Op_00DN;
+		}
+		return table;
+	}
+
+	static constexpr std::array<OpcodeHandler, 16> BuildArithmeticTable()
+	{
+		std::array<OpcodeHandler, 16> table = {};
+		for (OpcodeHandler& handler : table)
+			handler = &Op_Invalid;
+		table[0x0] = &Op_8XY0;
+		table[0x1] = &Op_8XY1<Quirks>;
+		table[0x2] = &Op_8XY2<Quirks>;
+		table[0x3] = &Op_8XY3<Quirks>;
+		table[0x4] = &Op_8XY4;
+		table[0x5] = &Op_8XY5;
+		table[0x6] = &Op_8XY6<Quirks>;
+		table[0x7] = &Op_8XY7;
+		table[0xE] = &Op_8XYE<Quirks>;
+		return table;
+	}
+
+	static constexpr std::array<OpcodeHandler, 256> BuildKeyTable()
+	{
+		std::array<OpcodeHandler, 256> table = {};
+		for (OpcodeHandler& handler : table)
+			handler = &Op_Invalid;
+		table[0x9E] = &Op_EX9E<Quirks>;
+		table[0xA1] = &Op_EXA1<Quirks>;
+		return table;
+	}
+
+	static constexpr std::array<OpcodeHandler, 256> BuildMiscTable()
+	{
+		std::array<OpcodeHandler, 256> table = {};
+		for (OpcodeHandler& handler : table)
+			handler = &Op_Invalid;
+		table[0x07] = &Op_FX07;
+		table[0x0A] = &Op_FX0A;
+		table[0x15] = &Op_FX15;
+		table[0x18] = &Op_FX18;
+		table[0x1E] = &Op_FX1E;
+		table[0x29] = &Op_FX29;
+		table[0x33] = &Op_FX33;
+		table[0x55] = &Op_FX55<Quirks>;
+		table[0x65] = &Op_FX65<Quirks>;
+		if constexpr (Quirks::SuperChipInstructions)
+		{
+			table[0x30] = &Op_FX30;
+			table[0x75] = &Op_FX75;
+			table[0x85] = &Op_FX85;
+		}
+		if constexpr (Quirks::XOChipInstructions)
+		{
+			table[0x00] = &Op_F000; // Only with X = 0, checked by Decode
+			table[0x01] = &Op_FN01;
+			table[0x02] = &Op_F002; // Only with X = 0, checked by Decode
+			table[0x3A] = &Op_FX3A;
+		}
+		return table;
+	}
+
+	static const std::array<OpcodeHandler, 16> Main;
+	static const std::array<OpcodeHandler, 256> System;
+	static const std::array<OpcodeHandler, 16> Arithmetic;
+	static const std::array<OpcodeHandler, 256> Key;
+	static const std::array<OpcodeHandler, 256> Misc;
+};
+
+template <typename Quirks>
+const std::array<OpcodeHandler, 16> Interpreter::DispatchTables<Quirks>::Main = BuildMainTable();
+template <typename Quirks>
+const std::array<OpcodeHandler, 256> Interpreter::DispatchTables<Quirks>::System = BuildSystemTable();
+template <typename Quirks>
+const std::array<OpcodeHandler, 16> Interpreter::DispatchTables<Quirks>::Arithmetic = BuildArithmeticTable();
+template <typename Quirks>
+const std::array<OpcodeHandler, 256> Interpreter::DispatchTables<Quirks>::Key = BuildKeyTable();
+template <typename Quirks>
+const std::array<OpcodeHandler, 256> Interpreter::DispatchTables<Quirks>::Misc = BuildMiscTable();
+
+// -----------------------------------------------------------------------------------------------
+// Variants
+// -----------------------------------------------------------------------------------------------
+const InterpreterVariant& Interpreter::GetVariant(const CompatibilityMode mode)
+{
+	static constexpr InterpreterVariant chip8 = { Chip8Quirks::Value, &Run<Chip8Quirks, false>, &Run<Chip8Quirks, true>, &Decode<Chip8Quirks>, &Op_Undecoded<Chip8Quirks> };
+	static constexpr InterpreterVariant chip48 = { Chip48Quirks::Value, &Run<Chip48Quirks, false>, &Run<Chip48Quirks, true>, &Decode<Chip48Quirks>, &Op_Undecoded<Chip48Quirks> };
+	static constexpr InterpreterVariant superChip = { SuperChipQuirks::Value, &Run<SuperChipQuirks, false>, &Run<SuperChipQuirks, true>, &Decode<SuperChipQuirks>, &Op_Undecoded<SuperChipQuirks> };
+	static constexpr InterpreterVariant xoChip = { XOChipQuirks::Value, &Run<XOChipQuirks, false>, &Run<XOChipQuirks, true>, &Decode<XOChipQuirks>, &Op_Undecoded<XOChipQuirks> };
+
+	switch (mode)
+	{
+	case CompatibilityMode::Chip48:
+		return chip48;
+	case CompatibilityMode::SuperChip:
+		return superChip;
+	case CompatibilityMode::XOChip10:
+	case CompatibilityMode::XOChip11:
+		return xoChip;
+	case CompatibilityMode::Chip8:
+	case CompatibilityMode::Chip8E:
+	default: // Modes without an interpreter of their own yet get the original one, so there's always something valid to run.
+		return chip8;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+// Decoding
+// -----------------------------------------------------------------------------------------------
+template <typename Quirks>
+DecodedInstruction Interpreter::Decode(const uint16_t opcode)
+{
+	using Tables = DispatchTables<Quirks>;
+
+	DecodedInstruction instruction;
+	instruction.Opcode = opcode;
+	instruction.NNN = GetNNN(opcode);
+	instruction.X = GetX(opcode);
+	instruction.Y = GetY(opcode);
+	instruction.N = GetN(opcode);
+	instruction.NN = GetNN(opcode);
+
+	switch (opcode >> 12)
+	{
+	case 0x0:
+		// 0NNN calls a machine code routine on the original hardware, which we obviously can't run.
+		instruction.Handler = instruction.X == 0 ? Tables::System[instruction.NN] : &Op_Invalid;
+		break;
+	case 0x5:
+		// XO-Chip adds 5XY2 and 5XY3 alongside 5XY0
+		if constexpr (Quirks::XOChipInstructions)
+		{
+			if (instruction.N == 2 || instruction.N == 3)
+			{
+				instruction.Handler = instruction.N == 2 ? &Op_5XY2 : &Op_5XY3;
+				break;
+			}
+		}
+		instruction.Handler = instruction.N == 0 ? Tables::Main[opcode >> 12] : &Op_Invalid;
+		break;
+	case 0x9:
+		instruction.Handler = instruction.N == 0 ? Tables::Main[opcode >> 12] : &Op_Invalid;
+		break;
+	case 0x8:
+		instruction.Handler = Tables::Arithmetic[instruction.N];
+		break;
+	case 0xD:
+		// DXY0 draws a 16x16 sprite on SUPER-CHIP, and nothing at all otherwise
+		if constexpr (Quirks::SuperChipInstructions)
+			instruction.Handler = instruction.N == 0 ? &Op_DXY0<Quirks> : Tables::Main[opcode >> 12];
+		else
+			instruction.Handler = Tables::Main[opcode >> 12];
+		break;
+	case 0xE:
+		instruction.Handler = Tables::Key[instruction.NN];
+		break;
+	case 0xF:
+		if constexpr (Quirks::XOChipInstructions)
+		{
+			// F000 and F002 don't take a register
+			if ((instruction.NN == 0x00 || instruction.NN == 0x02) && instruction.X != 0)
+			{
+				instruction.Handler = &Op_Invalid;
+				break;
+			}
+		}
+		instruction.Handler = Tables::Misc[instruction.NN];
+		break;
+	default:
+		instruction.Handler = Tables::Main[opcode >> 12];
+		break;
+	}
+	return instruction;
+}
+
+void Interpreter::ResetDecodeCache(Emulator& emulator)
+{
+	InvalidateDecodeCache(emulator, 0, emulator.m_CurrentMemorySize);
+}
+
+void Interpreter::InvalidateDecodeCache(Emulator& emulator, const uint32_t address, const uint32_t size)
+{
+	if (size == 0)
+		return;
+
+	if (address % Emulator::MemoryPageSize == 0 && size % Emulator::MemoryPageSize == 0)
+	{
+		const uint32_t pageMask = emulator.GetMemoryPageCount() - 1;
+		const uint32_t first = (address & (emulator.m_CurrentMemorySize - 1)) / Emulator::MemoryPageSize;
+		const uint32_t count = std::min(size / Emulator::MemoryPageSize, emulator.GetMemoryPageCount());
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const uint32_t page = (first + i) & pageMask;
+			emulator.m_StaleDecodePages[page / 64] |= 1ull << (page % 64);
+		}
+		return;
+	}
+
+	// Writes from emulated code wrap around the end of memory, so the range might too.
+	const OpcodeHandler undecoded = emulator.m_Interpreter->Undecoded;
+	const uint32_t memoryMask = emulator.m_CurrentMemorySize - 1;
+	const uint32_t entryMask = memoryMask >> 1;
+	const uint32_t first = (address & memoryMask) >> 1;
+	const uint32_t count = std::min(((address & 1) + size + 1) >> 1, emulator.m_CurrentMemorySize >> 1);
+	for (uint32_t i = 0; i < count; i++)
+		emulator.m_DecodeCache[(first + i) & entryMask].Handler = undecoded;
+}
+
+void Interpreter::ResetStaleDecodePages(Emulator& emulator)
+{
+	const OpcodeHandler undecoded = emulator.m_Interpreter->Undecoded;
+	const uint32_t pageCount = emulator.GetMemoryPageCount();
+	for (uint32_t page = 0; page < pageCount; page++)
+	{
+		if (!(emulator.m_StaleDecodePages[page / 64] >> (page % 64) & 1))
+			continue;
+		DecodedInstruction* const entries = emulator.m_DecodeCache + page * (Emulator::MemoryPageSize / 2);
+		for (uint32_t i = 0; i < Emulator::MemoryPageSize / 2; i++)
+			entries[i].Handler = undecoded;
+	}
+	memset(emulator.m_StaleDecodePages, 0, sizeof(emulator.m_StaleDecodePages));
+}
+
+template <typename Quirks>
+void Interpreter::Op_Undecoded(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	const uint32_t memoryMask = emulator.m_CurrentMemorySize - 1;
+	const uint32_t index = static_cast<uint32_t>(&instruction - emulator.m_DecodeCache);
+	const uint32_t address = index << 1;
+	const uint16_t opcode = static_cast<uint16_t>(emulator.m_Memory[address] << 8 | emulator.m_Memory[(address + 1) & memoryMask]);
+
+	DecodedInstruction& entry = emulator.m_DecodeCache[index];
+	entry = Decode<Quirks>(opcode);
+	entry.Handler(emulator, entry);
+}
+
+// -----------------------------------------------------------------------------------------------
+// Fetch, decode, execute
+// -----------------------------------------------------------------------------------------------
+void Interpreter::Step(Emulator& emulator)
+{
+	if (emulator.m_Profiler)
+		emulator.m_Interpreter->RunProfiled(emulator, 1);
+	else
+		emulator.m_Interpreter->Run(emulator, 1);
+}
+
+void Interpreter::Execute(Emulator& emulator, const uint16_t opcode)
+{
+	const DecodedInstruction instruction = emulator.m_Interpreter->Decode(opcode);
+	instruction.Handler(emulator, instruction);
+}
+
+template <typename Quirks, bool Profiled>
+uint64_t Interpreter::Run(Emulator& emulator, const uint64_t instructionCount)
+{
+	// The buffers and their size can only change through Initialise, which can't happen mid-run, so hoist them out of the loop.
+	const uint8_t* const memory = emulator.m_Memory;
+	const DecodedInstruction* const decodeCache = emulator.m_DecodeCache;
+	const uint32_t memoryMask = emulator.m_CurrentMemorySize - 1;
+	[[maybe_unused]] OpcodeProfiler* const profiler = emulator.m_Profiler;
+	// Only whole pages are marked stale, and nothing the program does writes one, so they can all be reset up front
+	if (emulator.m_StaleDecodePages[0] | emulator.m_StaleDecodePages[1] | emulator.m_StaleDecodePages[2] | emulator.m_StaleDecodePages[3])
+		ResetStaleDecodePages(emulator);
+
+	uint64_t executed = 0;
+	while (executed < instructionCount && emulator.m_Running)
+	{
+		const uint16_t programCounter = static_cast<uint16_t>(emulator.m_ProgramCounter & memoryMask);
+		emulator.m_ProgramCounter = static_cast<uint16_t>(programCounter + 2);
+		const auto execute = [&]
+		{
+			if (programCounter & 1)
+			{
+				// Instructions are almost always at even addresses, which is what the decode cache covers. The odd ones are decoded every time.
+				const uint16_t opcode = static_cast<uint16_t>(memory[programCounter] << 8 | memory[(programCounter + 1) & memoryMask]);
+				const DecodedInstruction instruction = Decode<Quirks>(opcode);
+				C8_HOT_TRACE("{0:#05x}: {1:#06x}", programCounter, opcode);
+				instruction.Handler(emulator, instruction);
+			}
+			else
+			{
+				const DecodedInstruction& instruction = decodeCache[programCounter >> 1];
+				// Not the cached opcode, as the entry may not have been decoded yet
+				C8_HOT_TRACE("{0:#05x}: {1:#06x}", programCounter, memory[programCounter] << 8 | memory[programCounter + 1]);
+				instruction.Handler(emulator, instruction);
+			}
+		};
+
+		if constexpr (Profiled)
+		{
+			// From memory for the same reason as the trace
+			const uint16_t opcode = static_cast<uint16_t>(memory[programCounter] << 8 | memory[(programCounter + 1) & memoryMask]);
+			if (profiler->Count(programCounter, opcode))
+			{
+				const uint64_t start = OpcodeProfiler::GetTime();
+				execute();
+				profiler->AddSample(opcode, OpcodeProfiler::GetTime() - start);
+			}
+			else
+				execute();
+		}
+		else
+			execute();
+		executed++;
+	}
+	return executed;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------------------------------------------
+template <typename Quirks>
+FORCEINLINE void Interpreter::SkipNextInstruction(Emulator& emulator)
+{
+	uint16_t distance = 2;
+	if constexpr (Quirks::XOChipInstructions)
+	{
+		const uint32_t memoryMask = emulator.m_CurrentMemorySize - 1;
+		if (emulator.m_Memory[emulator.m_ProgramCounter & memoryMask] == 0xF0 && emulator.m_Memory[(emulator.m_ProgramCounter + 1) & memoryMask] == 0x00)
+			distance = 4;
+	}
+	emulator.m_ProgramCounter = static_cast<uint16_t>(emulator.m_ProgramCounter + distance);
+}
+
+// On a display bigger than 64x32, lo-res mode draws every pixel as a square block of display pixels.
+FORCEINLINE static uint16_t GetPixelScale(const uint16_t displayWidth, const bool hiRes)
+{
+	return hiRes ? 1 : displayWidth / 64;
+}
+
+// Repeats every bit of a byte scale times, giving 8 * scale bits, right-aligned.
+FORCEINLINE static uint64_t ScaleSpriteBits(const uint8_t bits, const uint16_t scale)
+{
+	if (scale == 1)
+		return bits;
+	if (scale == 2)
+	{
+		// Spread the bits out to every other position, then fill in the gaps
+		uint32_t spread = bits;
+		spread = (spread | spread << 4) & 0x0F0F;
+		spread = (spread | spread << 2) & 0x3333;
+		spread = (spread | spread << 1) & 0x5555;
+		return spread | spread << 1;
+	}
+
+	uint64_t scaled = 0;
+	for (int bit = 7; bit >= 0; bit--)
+		scaled = scaled << scale | ((bits >> bit & 1) ? (1ull << scale) - 1 : 0);
+	return scaled;
+}
+
+// ORs one sprite row, left-aligned in 16 bits, into a display row's worth of mask words at logical column startX.
+// Display widths are a multiple of 64, so the right edge of the display is always a word boundary.
+template <bool Clip>
+static void PlaceSpriteRow(uint64_t* mask, const uint16_t rowWords, const uint16_t spriteRow, const uint8_t spriteWidth,
+	const uint16_t startX, const uint16_t logicalWidth, const uint16_t scale)
+{
+	// A byte at a time, so the scaled bits always fit in a word
+	for (uint8_t column = 0; column < spriteWidth; column += 8)
+	{
+		uint16_t x = startX + column;
+		if (x >= logicalWidth)
+		{
+			if constexpr (Clip)
+				break;
+			x -= logicalWidth;
+		}
+
+		const uint32_t bitCount = 8u * scale;
+		const uint64_t bits = ScaleSpriteBits(static_cast<uint8_t>(spriteRow >> (8 - column)), scale) << (64 - bitCount);
+		const uint32_t position = x * scale;
+		const uint32_t word = position / 64, shift = position % 64;
+		mask[word] |= bits >> shift;
+		if (shift + bitCount > 64)
+		{
+			// The rest spills into the next word, which past the right edge is either clipped or wraps around to the left
+			if (word + 1 < rowWords)
+				mask[word + 1] |= bits << (64 - shift);
+			else if constexpr (!Clip)
+				mask[0] |= bits << (64 - shift);
+		}
+	}
+}
+
+// XORs mask into display, returning a non-zero value if any pixel that was set got turned off.
+static uint64_t XorDisplay(uint64_t* display, const uint64_t* mask, const uint32_t wordCount)
+{
+	uint64_t overlap = 0;
+	uint32_t i = 0;
+#if C8_DISPLAY_AVX2
+	__m256i overlap256 = _mm256_setzero_si256();
+	for (; i + 4 <= wordCount; i += 4)
+	{
+		const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(display + i));
+		const __m256i sprite = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask + i));
+		overlap256 = _mm256_or_si256(overlap256, _mm256_and_si256(pixels, sprite));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(display + i), _mm256_xor_si256(pixels, sprite));
+	}
+	overlap |= !_mm256_testz_si256(overlap256, overlap256);
+#endif
+#if C8_DISPLAY_SSE2
+	__m128i overlap128 = _mm_setzero_si128();
+	for (; i + 2 <= wordCount; i += 2)
+	{
+		const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(display + i));
+		const __m128i sprite = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask + i));
+		overlap128 = _mm_or_si128(overlap128, _mm_and_si128(pixels, sprite));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(display + i), _mm_xor_si128(pixels, sprite));
+	}
+	overlap |= _mm_movemask_epi8(_mm_cmpeq_epi8(overlap128, _mm_setzero_si128())) != 0xFFFF;
+#endif
+	for (; i < wordCount; i++)
+	{
+		overlap |= display[i] & mask[i];
+		display[i] ^= mask[i];
+	}
+	return overlap;
+}
+
+template <typename Quirks>
+void Interpreter::DrawSprite(Emulator& emulator, const DecodedInstruction& instruction, const uint8_t rows, const bool wide)
+{
+	const uint16_t width = emulator.m_DisplayWidth, height = emulator.m_DisplayHeight;
+	const uint16_t scale = GetPixelScale(width, emulator.m_HiRes);
+	const uint16_t logicalWidth = width / scale, logicalHeight = height / scale;
+	const uint16_t rowWords = emulator.m_DisplayRowWords;
+	const uint32_t memoryMask = emulator.m_CurrentMemorySize - 1;
+	const uint8_t spriteWidth = wide ? 16 : 8;
+
+	// The starting position always wraps. Whether the rest of the sprite does depends on the mode.
+	const uint16_t startX = emulator.m_VRegisters[instruction.X] % logicalWidth;
+	const uint16_t startY = emulator.m_VRegisters[instruction.Y] % logicalHeight;
+
+	// Every sprite row covers scale display rows, which are contiguous in the display until the sprite wraps around the bottom.
+	// Build the mask for each contiguous run, then XOR it into the display in one go.
+	const uint32_t spriteRowWords = static_cast<uint32_t>(scale) * rowWords;
+	constexpr uint32_t MaxMaskWords = 16 * 5 * 5; // 16 rows of the widest display (320 pixels) at its lo-res scale
+	C8_ASSERT(rows * spriteRowWords <= MaxMaskWords, "Sprite mask doesn't fit the display");
+	uint64_t mask[MaxMaskWords];
+
+	// Each selected plane gets its own sprite, one after the other in memory, in plane order.
+	const uint32_t planeWords = rowWords * height;
+	uint16_t spriteAddress = emulator.m_IRegister;
+	uint64_t overlap = 0;
+	for (uint8_t plane = 0; plane < emulator.m_DisplayPlanes; plane++)
+	{
+		if (!(emulator.m_PlaneMask & BIT(plane)))
+			continue;
+
+		uint64_t* const display = emulator.m_Display + plane * planeWords;
+		uint8_t row = 0;
+		uint16_t y = startY;
+		while (row < rows)
+		{
+			const uint8_t runRows = static_cast<uint8_t>(std::min<uint16_t>(rows - row, logicalHeight - y));
+			memset(mask, 0, runRows * spriteRowWords * sizeof(uint64_t));
+			for (uint8_t runRow = 0; runRow < runRows; runRow++, row++)
+			{
+				// Left-align the row in 16 bits, so both sprite widths are handled the same way.
+				const uint16_t spriteRow = wide
+					? static_cast<uint16_t>(emulator.m_Memory[(spriteAddress + row * 2) & memoryMask] << 8 | emulator.m_Memory[(spriteAddress + row * 2 + 1) & memoryMask])
+					: static_cast<uint16_t>(emulator.m_Memory[(spriteAddress + row) & memoryMask] << 8);
+				if (!spriteRow)
+					continue;
+
+				uint64_t* rowMask = mask + runRow * spriteRowWords;
+				PlaceSpriteRow<Quirks::ClipSprites>(rowMask, rowWords, spriteRow, spriteWidth, startX, logicalWidth, scale);
+				for (uint16_t blockY = 1; blockY < scale; blockY++)
+					memcpy(rowMask + blockY * rowWords, rowMask, rowWords * sizeof(uint64_t));
+			}
+			overlap |= XorDisplay(display + y * spriteRowWords, mask, runRows * spriteRowWords);
+			emulator.MarkRowsDirty(y * scale, runRows * scale);
+
+			if constexpr (Quirks::ClipSprites)
+				break;
+			else
+				y = 0;
+		}
+		spriteAddress = static_cast<uint16_t>(spriteAddress + rows * (wide ? 2 : 1));
+	}
+	emulator.m_VRegisters[0xF] = overlap != 0;
+}
+
+// -----------------------------------------------------------------------------------------------
+// First level
+// -----------------------------------------------------------------------------------------------
+void Interpreter::Op_1NNN(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_ProgramCounter = instruction.NNN;
+}
+
+void Interpreter::Op_2NNN(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	if (emulator.m_StackPointer >= emulator.m_StackDepth)
+	{
+		C8_ERROR("Stack overflow: 2NNN executed with a full stack ({0} entries) at {1:#05x}", emulator.m_StackDepth, emulator.m_ProgramCounter - 2);
+		emulator.RaiseFault(EmulatorFault::StackOverflow);
+		return;
+	}
+	emulator.m_Stack[emulator.m_StackPointer++] = emulator.m_ProgramCounter;
+	emulator.m_ProgramCounter = instruction.NNN;
+}
+
+template <typename Quirks>
+void Interpreter::Op_3XNN(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	if (emulator.m_VRegisters[instruction.X] == instruction.NN)
+		SkipNextInstruction<Quirks>(emulator);
+}
+
+template <typename Quirks>
+void Interpreter::Op_4XNN(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	if (emulator.m_VRegisters[instruction.X] != instruction.NN)
+		SkipNextInstruction<Quirks>(emulator);
+}
+
+template <typename Quirks>
+void Interpreter::Op_5XY0(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	if (emulator.m_VRegisters[instruction.X] == emulator.m_VRegisters[instruction.Y])
+		SkipNextInstruction<Quirks>(emulator);
+}
+
+void Interpreter::Op_6XNN(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_VRegisters[instruction.X] = instruction.NN;
+}
+
+void Interpreter::Op_7XNN(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	// Doesn't affect the carry flag
+	emulator.m_VRegisters[instruction.X] += instruction.NN;
+}
+
+template <typename Quirks>
+void Interpreter::Op_9XY0(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	if (emulator.m_VRegisters[instruction.X] != emulator.m_VRegisters[instruction.Y])
+		SkipNextInstruction<Quirks>(emulator);
+}
+
+// XO-Chip: VX to VY are stored or loaded in order, which can be backwards. I doesn't change.
+void Interpreter::Op_5XY2(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	const uint32_t memoryMask = emulator.m_CurrentMemorySize - 1;
+	const int8_t step = instruction.X <= instruction.Y ? 1 : -1;
+	const uint8_t count = static_cast<uint8_t>(std::abs(instruction.Y - instruction.X) + 1);
+	for (uint8_t i = 0; i < count; i++)
+		emulator.m_Memory[(emulator.m_IRegister + i) & memoryMask] = emulator.m_VRegisters[instruction.X + i * step];
+	emulator.InvalidateCode(emulator.m_IRegister, count);
+}
+
+void Interpreter::Op_5XY3(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	const uint32_t memoryMask = emulator.m_CurrentMemorySize - 1;
+	const int8_t step = instruction.X <= instruction.Y ? 1 : -1;
+	const uint8_t count = static_cast<uint8_t>(std::abs(instruction.Y - instruction.X) + 1);
+	for (uint8_t i = 0; i < count; i++)
+		emulator.m_VRegisters[instruction.X + i * step] = emulator.m_Memory[(emulator.m_IRegister + i) & memoryMask];
+}
+
+void Interpreter::Op_ANNN(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_IRegister = instruction.NNN;
+}
+
+template <typename Quirks>
+void Interpreter::Op_BNNN(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	const uint8_t offset = Quirks::JumpUsesVX ? emulator.m_VRegisters[instruction.X] : emulator.m_VRegisters[0];
+	emulator.m_ProgramCounter = static_cast<uint16_t>(instruction.NNN + offset);
+}
+
+void Interpreter::Op_CXNN(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	// xorshift32; cheap, and deterministic for a given seed, which makes runs reproducible.
+	uint32_t state = emulator.m_RandomState;
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	emulator.m_RandomState = state;
+	emulator.m_VRegisters[instruction.X] = static_cast<uint8_t>(state) & instruction.NN;
+}
+
+template <typename Quirks>
+void Interpreter::Op_DXYN(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	DrawSprite<Quirks>(emulator, instruction, instruction.N, false);
+}
+
+template <typename Quirks>
+void Interpreter::Op_DXY0(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	DrawSprite<Quirks>(emulator, instruction, 16, true);
+}
+
+// -----------------------------------------------------------------------------------------------
+// 0x00__
+// -----------------------------------------------------------------------------------------------
+void Interpreter::Op_00CN(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	const uint16_t rowWords = emulator.m_DisplayRowWords, height = emulator.m_DisplayHeight;
+	const uint16_t distance = std::min<uint16_t>(instruction.N * GetPixelScale(emulator.m_DisplayWidth, emulator.m_HiRes), height);
+	for (uint8_t plane = 0; plane < emulator.m_DisplayPlanes; plane++)
+	{
+		if (!(emulator.m_PlaneMask & BIT(plane)))
+			continue;
+		uint64_t* const display = emulator.m_Display + plane * rowWords * height;
+		memmove(display + distance * rowWords, display, (height - distance) * rowWords * sizeof(uint64_t));
+		memset(display, 0, distance * rowWords * sizeof(uint64_t));
+	}
+	emulator.MarkDisplayDirty();
+}
+
+void Interpreter::Op_00DN(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	const uint16_t rowWords = emulator.m_DisplayRowWords, height = emulator.m_DisplayHeight;
+	const uint16_t distance = std::min<uint16_t>(instruction.N * GetPixelScale(emulator.m_DisplayWidth, emulator.m_HiRes), height);
+	for (uint8_t plane = 0; plane < emulator.m_DisplayPlanes; plane++)
+	{
+		if (!(emulator.m_PlaneMask & BIT(plane)))
+			continue;
+		uint64_t* const display = emulator.m_Display + plane * rowWords * height;
+		memmove(display, display + distance * rowWords, (height - distance) * rowWords * sizeof(uint64_t));
+		memset(display + (height - distance) * rowWords, 0, distance * rowWords * sizeof(uint64_t));
+	}
+	emulator.MarkDisplayDirty();
+}
+
+void Interpreter::Op_00E0(Emulator& emulator, [[maybe_unused]] const DecodedInstruction& instruction)
+{
+	const uint32_t planeWords = emulator.m_DisplayRowWords * emulator.m_DisplayHeight;
+	for (uint8_t plane = 0; plane < emulator.m_DisplayPlanes; plane++)
+	{
+		if (emulator.m_PlaneMask & BIT(plane))
+			memset(emulator.m_Display + plane * planeWords, 0, planeWords * sizeof(uint64_t));
+	}
+	emulator.MarkDisplayDirty();
+}
+
+void Interpreter::Op_00EE(Emulator& emulator, [[maybe_unused]] const DecodedInstruction& instruction)
+{
+	if (emulator.m_StackPointer == 0)
+	{
+		C8_ERROR("Stack underflow: 00EE executed with an empty stack at {0:#05x}", emulator.m_ProgramCounter - 2);
+		emulator.RaiseFault(EmulatorFault::StackUnderflow);
+		return;
+	}
+	emulator.m_ProgramCounter = emulator.m_Stack[--emulator.m_StackPointer];
+}
+
+void Interpreter::Op_00FB(Emulator& emulator, [[maybe_unused]] const DecodedInstruction& instruction)
+{
+	// Pixels move towards the less significant end of each row, carrying between words
+	const uint16_t rowWords = emulator.m_DisplayRowWords, height = emulator.m_DisplayHeight;
+	const uint16_t distance = 4 * GetPixelScale(emulator.m_DisplayWidth, emulator.m_HiRes);
+	for (uint8_t plane = 0; plane < emulator.m_DisplayPlanes; plane++)
+	{
+		if (!(emulator.m_PlaneMask & BIT(plane)))
+			continue;
+		uint64_t* const display = emulator.m_Display + plane * rowWords * height;
+		for (uint16_t y = 0; y < height; y++)
+		{
+			uint64_t* row = display + y * rowWords;
+			for (uint16_t word = rowWords - 1; word > 0; word--)
+				row[word] = row[word] >> distance | row[word - 1] << (64 - distance);
+			row[0] >>= distance;
+		}
+	}
+	emulator.MarkDisplayDirty();
+}
+
+void Interpreter::Op_00FC(Emulator& emulator, [[maybe_unused]] const DecodedInstruction& instruction)
+{
+	const uint16_t rowWords = emulator.m_DisplayRowWords, height = emulator.m_DisplayHeight;
+	const uint16_t distance = 4 * GetPixelScale(emulator.m_DisplayWidth, emulator.m_HiRes);
+	for (uint8_t plane = 0; plane < emulator.m_DisplayPlanes; plane++)
+	{
+		if (!(emulator.m_PlaneMask & BIT(plane)))
+			continue;
+		uint64_t* const display = emulator.m_Display + plane * rowWords * height;
+		for (uint16_t y = 0; y < height; y++)
+		{
+			uint64_t* row = display + y * rowWords;
+			for (uint16_t word = 0; word + 1 < rowWords; word++)
+				row[word] = row[word] << distance | row[word + 1] >> (64 - distance);
+			row[rowWords - 1] <<= distance;
+		}
+	}
+	emulator.MarkDisplayDirty();
+}
+
+void Interpreter::Op_00FD(Emulator& emulator, [[maybe_unused]] const DecodedInstruction& instruction)
+{
+	// Exit the interpreter
+	emulator.m_Running = false;
+}
+
+void Interpreter::Op_00FE(Emulator& emulator, [[maybe_unused]] const DecodedInstruction& instruction)
+{
+	// Changing resolution clears every plane, not just the selected ones
+	emulator.m_HiRes = false;
+	memset(emulator.m_Display, 0, emulator.m_DisplayPlanes * emulator.m_DisplayRowWords * emulator.m_DisplayHeight * sizeof(uint64_t));
+	emulator.MarkDisplayDirty();
+}
+
+void Interpreter::Op_00FF(Emulator& emulator, [[maybe_unused]] const DecodedInstruction& instruction)
+{
+	emulator.m_HiRes = true;
+	memset(emulator.m_Display, 0, emulator.m_DisplayPlanes * emulator.m_DisplayRowWords * emulator.m_DisplayHeight * sizeof(uint64_t));
+	emulator.MarkDisplayDirty();
+}
+
+// -----------------------------------------------------------------------------------------------
+// 0x8XY_
+// -----------------------------------------------------------------------------------------------
+void Interpreter::Op_8XY0(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_VRegisters[instruction.X] = emulator.m_VRegisters[instruction.Y];
+}
+
+template <typename Quirks>
+void Interpreter::Op_8XY1(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_VRegisters[instruction.X] |= emulator.m_VRegisters[instruction.Y];
+	if constexpr (Quirks::LogicResetsVF)
+		emulator.m_VRegisters[0xF] = 0;
+}
+
+template <typename Quirks>
+void Interpreter::Op_8XY2(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_VRegisters[instruction.X] &= emulator.m_VRegisters[instruction.Y];
+	if constexpr (Quirks::LogicResetsVF)
+		emulator.m_VRegisters[0xF] = 0;
+}
+
+template <typename Quirks>
+void Interpreter::Op_8XY3(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_VRegisters[instruction.X] ^= emulator.m_VRegisters[instruction.Y];
+	if constexpr (Quirks::LogicResetsVF)
+		emulator.m_VRegisters[0xF] = 0;
+}
+
+// For the arithmetic ops, VF is always written last, so if VF is the destination it ends up holding the flag.
+void Interpreter::Op_8XY4(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	uint8_t* v = emulator.m_VRegisters;
+	const uint16_t sum = v[instruction.X] + v[instruction.Y];
+	v[instruction.X] = static_cast<uint8_t>(sum);
+	v[0xF] = sum > 0xFF;
+}
+
+void Interpreter::Op_8XY5(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	uint8_t* v = emulator.m_VRegisters;
+	const uint8_t notBorrow = v[instruction.X] >= v[instruction.Y];
+	v[instruction.X] = static_cast<uint8_t>(v[instruction.X] - v[instruction.Y]);
+	v[0xF] = notBorrow;
+}
+
+template <typename Quirks>
+void Interpreter::Op_8XY6(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	uint8_t* v = emulator.m_VRegisters;
+	const uint8_t source = Quirks::ShiftUsesVY ? v[instruction.Y] : v[instruction.X];
+	v[instruction.X] = source >> 1;
+	v[0xF] = source & 0x1;
+}
+
+void Interpreter::Op_8XY7(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	uint8_t* v = emulator.m_VRegisters;
+	const uint8_t notBorrow = v[instruction.Y] >= v[instruction.X];
+	v[instruction.X] = static_cast<uint8_t>(v[instruction.Y] - v[instruction.X]);
+	v[0xF] = notBorrow;
+}
+
+template <typename Quirks>
+void Interpreter::Op_8XYE(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	uint8_t* v = emulator.m_VRegisters;
+	const uint8_t source = Quirks::ShiftUsesVY ? v[instruction.Y] : v[instruction.X];
+	v[instruction.X] = static_cast<uint8_t>(source << 1);
+	v[0xF] = source >> 7;
+}
+
+// -----------------------------------------------------------------------------------------------
+// 0xEX__
+// -----------------------------------------------------------------------------------------------
+template <typename Quirks>
+void Interpreter::Op_EX9E(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	if (emulator.m_KeyStates & BIT(emulator.m_VRegisters[instruction.X] & 0xF))
+		SkipNextInstruction<Quirks>(emulator);
+}
+
+template <typename Quirks>
+void Interpreter::Op_EXA1(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	if (!(emulator.m_KeyStates & BIT(emulator.m_VRegisters[instruction.X] & 0xF)))
+		SkipNextInstruction<Quirks>(emulator);
+}
+
+// -----------------------------------------------------------------------------------------------
+// 0xFX__
+// -----------------------------------------------------------------------------------------------
+void Interpreter::Op_F000(Emulator& emulator, [[maybe_unused]] const DecodedInstruction& instruction)
+{
+	// XO-Chip's only 4 byte instruction: the address is the next 2 bytes, which are read now rather than decoded, so writes to them are always seen.
+	const uint32_t memoryMask = emulator.m_CurrentMemorySize - 1;
+	emulator.m_IRegister = static_cast<uint16_t>(emulator.m_Memory[emulator.m_ProgramCounter & memoryMask] << 8 | emulator.m_Memory[(emulator.m_ProgramCounter + 1) & memoryMask]);
+	emulator.m_ProgramCounter = static_cast<uint16_t>(emulator.m_ProgramCounter + 2);
+}
+
+void Interpreter::Op_FN01(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_PlaneMask = instruction.X & (BIT(emulator.m_DisplayPlanes) - 1);
+}
+
+void Interpreter::Op_F002(Emulator& emulator, [[maybe_unused]] const DecodedInstruction& instruction)
+{
+	const uint32_t memoryMask = emulator.m_CurrentMemorySize - 1;
+	for (uint8_t i = 0; i < sizeof(emulator.m_AudioPattern); i++)
+		emulator.m_AudioPattern[i] = emulator.m_Memory[(emulator.m_IRegister + i) & memoryMask];
+}
+
+void Interpreter::Op_FX07(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_VRegisters[instruction.X] = emulator.m_DelayTimer;
+}
+
+void Interpreter::Op_FX0A(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	// Like the original COSMAC VIP, wait for a key to be pressed *and released*.
+	// Rather than blocking, we rewind the program counter so this instruction runs again until the key comes back up.
+	if (emulator.m_WaitingKey == 0xFF)
+	{
+		for (uint8_t key = 0; key < 16; key++)
+		{
+			if (emulator.m_KeyStates & BIT(key))
+			{
+				emulator.m_WaitingKey = key;
+				break;
+			}
+		}
+	}
+	else if (!(emulator.m_KeyStates & BIT(emulator.m_WaitingKey)))
+	{
+		emulator.m_VRegisters[instruction.X] = emulator.m_WaitingKey;
+		emulator.m_WaitingKey = 0xFF;
+		return;
+	}
+	emulator.m_ProgramCounter = static_cast<uint16_t>(emulator.m_ProgramCounter - 2);
+}
+
+void Interpreter::Op_FX15(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_DelayTimer = emulator.m_VRegisters[instruction.X];
+}
+
+void Interpreter::Op_FX18(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_SoundTimer = emulator.m_VRegisters[instruction.X];
+}
+
+void Interpreter::Op_FX1E(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_IRegister = static_cast<uint16_t>(emulator.m_IRegister + emulator.m_VRegisters[instruction.X]);
+}
+
+void Interpreter::Op_FX29(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_IRegister = static_cast<uint16_t>(Emulator::FontAddress + (emulator.m_VRegisters[instruction.X] & 0xF) * 5);
+}
+
+void Interpreter::Op_FX30(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_IRegister = static_cast<uint16_t>(Emulator::BigFontAddress + (emulator.m_VRegisters[instruction.X] & 0xF) * 10);
+}
+
+void Interpreter::Op_FX33(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	const uint8_t value = emulator.m_VRegisters[instruction.X];
+	const uint32_t memoryMask = emulator.m_CurrentMemorySize - 1;
+	emulator.m_Memory[emulator.m_IRegister & memoryMask] = value / 100;
+	emulator.m_Memory[(emulator.m_IRegister + 1) & memoryMask] = (value / 10) % 10;
+	emulator.m_Memory[(emulator.m_IRegister + 2) & memoryMask] = value % 10;
+	emulator.InvalidateCode(emulator.m_IRegister, 3);
+}
+
+void Interpreter::Op_FX3A(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	emulator.m_AudioPitch = emulator.m_VRegisters[instruction.X];
+}
+
+template <typename Quirks>
+void Interpreter::Op_FX55(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	const uint8_t x = instruction.X;
+	const uint32_t memoryMask = emulator.m_CurrentMemorySize - 1;
+	for (uint8_t i = 0; i <= x; i++)
+		emulator.m_Memory[(emulator.m_IRegister + i) & memoryMask] = emulator.m_VRegisters[i];
+	emulator.InvalidateCode(emulator.m_IRegister, x + 1);
+	if constexpr (Quirks::LoadStoreIncrementsI)
+		emulator.m_IRegister = static_cast<uint16_t>(emulator.m_IRegister + x + 1);
+}
+
+template <typename Quirks>
+void Interpreter::Op_FX65(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	const uint8_t x = instruction.X;
+	const uint32_t memoryMask = emulator.m_CurrentMemorySize - 1;
+	for (uint8_t i = 0; i <= x; i++)
+		emulator.m_VRegisters[i] = emulator.m_Memory[(emulator.m_IRegister + i) & memoryMask];
+	if constexpr (Quirks::LoadStoreIncrementsI)
+		emulator.m_IRegister = static_cast<uint16_t>(emulator.m_IRegister + x + 1);
+}
+
+void Interpreter::Op_FX75(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	// The RPL user flags on the HP-48
+	memcpy(emulator.m_FlagRegisters, emulator.m_VRegisters, instruction.X + 1);
+}
+
+void Interpreter::Op_FX85(Emulator& emulator, const DecodedInstruction& instruction)
+{
+	memcpy(emulator.m_VRegisters, emulator.m_FlagRegisters, instruction.X + 1);
+}
+
+// -----------------------------------------------------------------------------------------------
+// Invalid
+// -----------------------------------------------------------------------------------------------
+void Interpreter::Op_Invalid(Emulator& emulator, [[maybe_unused]] const DecodedInstruction& instruction)
+{
+	C8_ERROR("Invalid opcode {0:#06x} at {1:#05x}, stopping", instruction.Opcode, emulator.m_ProgramCounter - 2);
+	emulator.RaiseFault(EmulatorFault::InvalidOpcode);
+}
@@ -0,0 +1,636 @@
+#include "c8pch.h"
+#include "Core/Jit.h"
+
+#include "Core/Emulator.h"
+
+#if C8_JIT_SUPPORTED && !defined(C8_PLATFORM_WINDOWS)
+	#include <sys/mman.h>
+#endif
+
+// -----------------------------------------------------------------------------------------------
+// Register usage in translated code
+//  rbx: Emulator*, all emulator state is addressed as [rbx + offset]
+//  rbp: JitContext*
+//  al, cl: scratch
+// Both are callee-saved on Windows and System V, so they survive calls into interpreter handlers.
+// The entry trampoline leaves the stack 16 byte aligned with 32 bytes of shadow space, so handlers can be called directly.
+// -----------------------------------------------------------------------------------------------
+
+static constexpr size_t CodeCacheSize = 4 * 1024 * 1024;
+static constexpr uint32_t MaxBlockInstructions = 64;
+static constexpr size_t MaxBlockCodeSize = 16 * 1024; // Comfortably more than MaxBlockInstructions worth of the largest sequences
+
+// x86 register numbers
+static constexpr uint8_t RegAL = 0, RegCL = 1;
+
+// Starts out writable, see ProtectExecutableMemory
+static uint8_t* AllocateExecutableMemory(const size_t size)
+{
+#if !C8_JIT_SUPPORTED
+	return nullptr;
+#elif defined(C8_PLATFORM_WINDOWS)
+	return static_cast<uint8_t*>(VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+	void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return memory != MAP_FAILED ? static_cast<uint8_t*>(memory) : nullptr;
+#endif
+}
+
+// Switches memory between writable and executable. It's never both, so nothing that can write to it can also run it.
+static bool ProtectExecutableMemory(uint8_t* memory, const size_t size, const bool writable)
+{
+#if !C8_JIT_SUPPORTED
+	return false;
+#elif defined(C8_PLATFORM_WINDOWS)
+	DWORD oldProtection;
+	return VirtualProtect(memory, size, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &oldProtection) != 0;
+#else
+	return mprotect(memory, size, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+static void FreeExecutableMemory(uint8_t* memory, const size_t size)
+{
+#if C8_JIT_SUPPORTED && defined(C8_PLATFORM_WINDOWS)
+	VirtualFree(memory, 0, MEM_RELEASE);
+#elif C8_JIT_SUPPORTED
+	munmap(memory, size);
+#endif
+}
+
+static uint32_t OffsetInEmulator(const Emulator& emulator, const void* member)
+{
+	return static_cast<uint32_t>(static_cast<const uint8_t*>(member) - reinterpret_cast<const uint8_t*>(&emulator));
+}
+
+Jit::Jit(Emulator& emulator)
+	: m_Emulator(emulator)
+{
+	m_ProgramCounterOffset = OffsetInEmulator(emulator, &emulator.m_ProgramCounter);
+	m_IRegisterOffset = OffsetInEmulator(emulator, &emulator.m_IRegister);
+	m_VRegistersOffset = OffsetInEmulator(emulator, &emulator.m_VRegisters);
+	m_DelayTimerOffset = OffsetInEmulator(emulator, &emulator.m_DelayTimer);
+	m_SoundTimerOffset = OffsetInEmulator(emulator, &emulator.m_SoundTimer);
+	m_RunningOffset = OffsetInEmulator(emulator, &emulator.m_Running);
+
+	m_Code = AllocateExecutableMemory(CodeCacheSize);
+	if (!m_Code)
+	{
+		C8_ERROR("Failed to allocate {0} bytes of executable memory for the JIT", CodeCacheSize);
+		return;
+	}
+	m_CodeCapacity = CodeCacheSize;
+	m_Cursor = m_Code;
+
+	// Entry trampoline: void Enter(Emulator* emulator, JitContext* context, const uint8_t* code)
+	m_Enter = reinterpret_cast<decltype(m_Enter)>(m_Cursor);
+	Emit8(0x53);                                 // push rbx
+	Emit8(0x55);                                 // push rbp
+	Emit8(0x48); Emit8(0x83); Emit8(0xEC); Emit8(0x28); // sub rsp, 40
+#ifdef C8_PLATFORM_WINDOWS
+	Emit8(0x48); Emit8(0x89); Emit8(0xCB);       // mov rbx, rcx
+	Emit8(0x48); Emit8(0x89); Emit8(0xD5);       // mov rbp, rdx
+	Emit8(0x41); Emit8(0xFF); Emit8(0xE0);       // jmp r8
+#else
+	Emit8(0x48); Emit8(0x89); Emit8(0xFB);       // mov rbx, rdi
+	Emit8(0x48); Emit8(0x89); Emit8(0xF5);       // mov rbp, rsi
+	Emit8(0xFF); Emit8(0xE2);                    // jmp rdx
+#endif
+
+	// Every exit from translated code ends up here
+	m_Epilogue = m_Cursor;
+	Emit8(0x48); Emit8(0x83); Emit8(0xC4); Emit8(0x28); // add rsp, 40
+	Emit8(0x5D);                                 // pop rbp
+	Emit8(0x5B);                                 // pop rbx
+	Emit8(0xC3);                                 // ret
+
+	m_FirstBlock = m_Cursor;
+	Flush();
+
+	// Make sure the code can actually be switched between writable and executable before relying on it
+	if (!SetCodeWritable(false) || !SetCodeWritable(true))
+	{
+		C8_ERROR("Failed to change the protection of the JIT's code cache");
+		FreeExecutableMemory(m_Code, m_CodeCapacity);
+		m_Code = nullptr;
+	}
+}
+
+Jit::~Jit()
+{
+	if (m_Code)
+		FreeExecutableMemory(m_Code, m_CodeCapacity);
+}
+
+// -----------------------------------------------------------------------------------------------
+// Dispatcher
+// -----------------------------------------------------------------------------------------------
+uint64_t Jit::Run(const uint64_t instructionCount)
+{
+	if (!m_Code)
+		return 0;
+
+	const uint32_t memoryMask = m_Emulator.m_CurrentMemorySize - 1;
+	m_Context.Budget = static_cast<int64_t>(std::min<uint64_t>(instructionCount, INT64_MAX));
+	const int64_t budget = m_Context.Budget;
+	while (m_Context.Budget > 0 && m_Emulator.m_Running)
+	{
+		const Block* block = GetOrTranslate(static_cast<uint16_t>(m_Emulator.m_ProgramCounter & memoryMask));
+		if (block->InstructionCount > static_cast<uint64_t>(m_Context.Budget))
+		{
+			m_Context.Budget -= static_cast<int64_t>(m_Emulator.m_Interpreter->Run(m_Emulator, static_cast<uint64_t>(m_Context.Budget)));
+			break;
+		}
+		m_Context.LastExit = -1;
+		SetCodeWritable(false);
+		m_RunningCode = true;
+		m_Enter(&m_Emulator, &m_Context, block->Code);
+		m_RunningCode = false;
+
+		for (const uint32_t exitIndex : m_PendingUnlinks)
+			Unlink(m_Exits[exitIndex]);
+		m_PendingUnlinks.clear();
+
+		// The block left through an exit with a known target, so next time it can jump straight there.
+		if (m_Context.LastExit >= 0)
+			Link(static_cast<uint32_t>(m_Context.LastExit));
+	}
+	return static_cast<uint64_t>(budget - m_Context.Budget);
+}
+
+Jit::Block* Jit::GetOrTranslate(const uint16_t programCounter)
+{
+	if (Block* block = m_BlockMap[programCounter])
+		return block;
+	return Translate(programCounter);
+}
+
+void Jit::Link(const uint32_t exitIndex)
+{
+	if (m_Exits[exitIndex].LinkedTo || !m_Exits[exitIndex].Owner->Valid)
+		return;
+
+	// Translating the target can flush the cache, taking the exit with it.
+	const uint32_t generation = m_Generation;
+	Block* target = GetOrTranslate(m_Exits[exitIndex].TargetPc);
+	if (generation != m_Generation)
+		return;
+
+	Exit& exit = m_Exits[exitIndex];
+	SetCodeWritable(true);
+	PatchRel32(exit.JumpField, target->Code);
+	exit.LinkedTo = target;
+	target->IncomingExits.push_back(exitIndex);
+}
+
+// -----------------------------------------------------------------------------------------------
+// Invalidation
+// -----------------------------------------------------------------------------------------------
+void Jit::Invalidate(const uint32_t address, const uint32_t size)
+{
+	if (size == 0 || m_Blocks.empty())
+		return;
+
+	const uint32_t memorySize = m_Emulator.m_CurrentMemorySize;
+	const uint32_t memoryMask = memorySize - 1;
+	const uint32_t start = address & memoryMask;
+	const uint32_t length = std::min(size, memorySize);
+
+	// Only the blocks overlapping the granules written to need looking at, and most writes are to data, which has none.
+	// Writes can wrap around the end of memory, blocks never do.
+	const uint32_t firstEnd = std::min(start + length, memorySize);
+	const uint32_t wrappedEnd = start + length - firstEnd;
+	for (uint32_t granule = start >> 6; granule <= (start + length - 1) >> 6; granule++)
+	{
+		std::vector<Block*>& blocks = m_GranuleBlocks[granule & (memoryMask >> 6)];
+		for (size_t i = 0; i < blocks.size();)
+		{
+			// Invalidating a block takes it out of this list, so the next one moves into its place
+			Block& block = *blocks[i];
+			const uint32_t blockStart = block.StartPc, blockEnd = block.StartPc + block.Size;
+			if ((blockStart < firstEnd && start < blockEnd) || blockStart < wrappedEnd)
+				InvalidateBlock(block);
+			else
+				i++;
+		}
+	}
+}
+
+void Jit::InvalidateBlock(Block& block)
+{
+	block.Valid = false;
+	if (m_BlockMap[block.StartPc] == &block)
+		m_BlockMap[block.StartPc] = nullptr;
+
+	for (uint32_t granule = block.StartPc >> 6; granule <= (block.StartPc + block.Size - 1) >> 6; granule++)
+	{
+		std::vector<Block*>& blocks = m_GranuleBlocks[granule];
+		const auto it = std::find(blocks.begin(), blocks.end(), &block);
+		*it = blocks.back();
+		blocks.pop_back();
+	}
+
+	// Anything chained to this block goes back through the dispatcher, which will translate the new code.
+	for (const uint32_t exitIndex : block.IncomingExits)
+	{
+		if (m_Exits[exitIndex].LinkedTo != &block)
+			continue;
+
+		// Translated code can't be written while it's running, which it is if one of its handlers made this write.
+		// Writes always end the block, so it goes straight back to the dispatcher, which unlinks the exit before
+		// anything can take it.
+		if (m_RunningCode)
+		{
+			m_Exits[exitIndex].LinkedTo = nullptr;
+			m_PendingUnlinks.push_back(exitIndex);
+		}
+		else
+			Unlink(m_Exits[exitIndex]);
+	}
+	block.IncomingExits.clear();
+}
+
+void Jit::Unlink(Exit& exit)
+{
+	SetCodeWritable(true);
+	PatchRel32(exit.JumpField, exit.Unlinked);
+	exit.LinkedTo = nullptr;
+}
+
+bool Jit::SetCodeWritable(const bool writable)
+{
+	if (writable == m_CodeWritable)
+		return true;
+	if (!ProtectExecutableMemory(m_Code, m_CodeCapacity, writable))
+		return false;
+	m_CodeWritable = writable;
+	return true;
+}
+
+void Jit::Flush()
+{
+	const uint32_t memorySize = m_Emulator.m_CurrentMemorySize;
+
+	m_Cursor = m_FirstBlock;
+	m_Blocks.clear();
+	m_Exits.clear();
+	m_PendingUnlinks.clear();
+	m_Instructions.clear();
+	m_BlockMap.assign(memorySize, nullptr);
+	// Cleared rather than reassigned where possible, so the lists keep their capacity
+	m_GranuleBlocks.resize(memorySize >> 6);
+	for (std::vector<Block*>& blocks : m_GranuleBlocks)
+		blocks.clear();
+	m_Generation++;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Translation
+// -----------------------------------------------------------------------------------------------
+Jit::Block* Jit::Translate(const uint16_t programCounter)
+{
+	if (static_cast<size_t>(m_Code + m_CodeCapacity - m_Cursor) < MaxBlockCodeSize)
+	{
+		if (m_Emulator.m_DebugLogs)
+			C8_INFO("JIT code cache is full, flushing");
+		Flush();
+	}
+	SetCodeWritable(true);
+
+	const uint8_t* const memory = m_Emulator.m_Memory;
+	const uint32_t memoryMask = m_Emulator.m_CurrentMemorySize - 1;
+	const InterpreterVariant& interpreter = *m_Emulator.m_Interpreter;
+
+	m_Blocks.push_back(std::make_unique<Block>());
+	Block& block = *m_Blocks.back();
+	block.StartPc = programCounter;
+	block.Code = m_Cursor;
+
+	// Every block starts by checking the whole of it fits in the budget, as linked exits jump straight here. If it doesn't,
+	// it goes back to the dispatcher without running anything, and the program counter already points here.
+	Emit8(0x48); Emit8(0x81); Emit8(0xBD); Emit32(offsetof(JitContext, Budget)); // cmp qword [rbp + budget], instruction count
+	uint8_t* const instructionCountField = m_Cursor;
+	Emit32(0);
+	Emit8(0x7D);                           // jge body
+	uint8_t* const fitsJump = m_Cursor;
+	Emit8(0);
+	Emit8(0xC7); Emit8(0x85); Emit32(offsetof(JitContext, LastExit)); Emit32(static_cast<uint32_t>(-1)); // mov dword [rbp + lastExit], -1
+	Emit8(0xE9); EmitRel32(m_Epilogue);    // jmp epilogue
+	*fitsJump = static_cast<uint8_t>(m_Cursor - fitsJump - 1);
+
+	uint32_t pc = programCounter;
+	uint32_t count = 0;
+	for (;;)
+	{
+		const uint16_t opcode = static_cast<uint16_t>(memory[pc] << 8 | memory[(pc + 1) & memoryMask]);
+		const DecodedInstruction instruction = interpreter.Decode(opcode);
+		const uint16_t nextPc = static_cast<uint16_t>((pc + 2) & memoryMask);
+		count++;
+
+		bool ended = true;
+		switch (opcode >> 12)
+		{
+		case 0x1:
+			EmitStaticExit(static_cast<uint16_t>(instruction.NNN & memoryMask), count, block);
+			break;
+		case 0x3:
+		case 0x4:
+		case 0x5:
+		case 0x9:
+		{
+			// XO-Chip skips over F000 NNNN in one go, so how far they go depends on what's in memory when they run.
+			// 5XY2/5XY3 (or invalid opcodes in other modes) also end up here.
+			if (((opcode >> 12 == 0x5 || opcode >> 12 == 0x9) && instruction.N != 0) || (interpreter.Quirks & Quirks::XOChipInstructions))
+			{
+				EmitHandlerCall(instruction, nextPc);
+				EmitDynamicExit(count);
+				break;
+			}
+
+			const uint32_t vx = m_VRegistersOffset + instruction.X;
+			bool skipIfEqual = true;
+			if (opcode >> 12 <= 0x4)
+			{
+				Emit8(0x80); Emit8(0xBB); Emit32(vx); Emit8(instruction.NN); // cmp byte [rbx + vx], NN
+				skipIfEqual = opcode >> 12 == 0x3;
+			}
+			else
+			{
+				EmitEmulatorOp(0x8A, RegAL, vx);                             // mov al, [rbx + vx]
+				EmitEmulatorOp(0x3A, RegAL, m_VRegistersOffset + instruction.Y); // cmp al, [rbx + vy]
+				skipIfEqual = opcode >> 12 == 0x5;
+			}
+			Emit8(0x0F); Emit8(skipIfEqual ? 0x84 : 0x85); // je/jne skip
+			uint8_t* skipJump = m_Cursor;
+			Emit32(0);
+			EmitStaticExit(nextPc, count, block);
+			PatchRel32(skipJump, m_Cursor);
+			EmitStaticExit(static_cast<uint16_t>((nextPc + 2) & memoryMask), count, block);
+			break;
+		}
+		case 0x2:
+		{
+			// The call faults instead of jumping if the stack is full
+			EmitHandlerCall(instruction, nextPc);
+			uint8_t* const skipExit = EmitRunningCheck();
+			EmitDynamicExit(count);
+			*skipExit = static_cast<uint8_t>(m_Cursor - skipExit - 1);
+			EmitStaticExit(static_cast<uint16_t>(instruction.NNN & memoryMask), count, block);
+			break;
+		}
+		default:
+			if (EmitNative(instruction))
+			{
+				ended = false;
+				break;
+			}
+
+			EmitHandlerCall(instruction, nextPc);
+			// Anything that changes control flow, waits or writes to memory ends the block. Writes can invalidate
+			// blocks, including this one, so the dispatcher needs to look the next block up again.
+			if (opcode == 0x00EE || opcode >> 12 == 0xB || opcode >> 12 == 0xE || opcode == 0xF000
+				|| (opcode >> 12 == 0xF && (instruction.NN == 0x0A || instruction.NN == 0x33 || instruction.NN == 0x55)))
+			{
+				EmitDynamicExit(count);
+				break;
+			}
+
+			// Everything else falls through to the next instruction, unless it stopped the emulator (an invalid opcode or 00FD).
+			uint8_t* const skipExit = EmitRunningCheck();
+			EmitDynamicExit(count);
+			*skipExit = static_cast<uint8_t>(m_Cursor - skipExit - 1);
+			ended = false;
+			break;
+		}
+
+		if (ended)
+		{
+			block.Size = pc + 2 - programCounter;
+			break;
+		}
+		// Blocks stop at the end of memory rather than wrapping, which keeps invalidation simple.
+		if (count >= MaxBlockInstructions || nextPc <= pc)
+		{
+			EmitStaticExit(nextPc, count, block);
+			block.Size = pc + 2 - programCounter;
+			break;
+		}
+		pc = nextPc;
+	}
+
+	C8_ASSERT(m_Cursor <= m_Code + m_CodeCapacity, "JIT block overran the code cache");
+	block.InstructionCount = count;
+	memcpy(instructionCountField, &count, sizeof(count));
+
+	for (uint32_t granule = block.StartPc >> 6; granule <= (block.StartPc + block.Size - 1) >> 6; granule++)
+		m_GranuleBlocks[granule].push_back(&block);
+
+	m_BlockMap[programCounter] = &block;
+	return &block;
+}
+
+bool Jit::EmitNative(const DecodedInstruction& instruction)
+{
+	const uint32_t quirks = m_Emulator.m_Interpreter->Quirks;
+	const uint32_t vx = m_VRegistersOffset + instruction.X;
+	const uint32_t vy = m_VRegistersOffset + instruction.Y;
+	const uint32_t vf = m_VRegistersOffset + 0xF;
+
+	switch (instruction.Opcode >> 12)
+	{
+	case 0x6:
+		Emit8(0xC6); Emit8(0x83); Emit32(vx); Emit8(instruction.NN); // mov byte [rbx + vx], NN
+		return true;
+	case 0x7:
+		Emit8(0x80); Emit8(0x83); Emit32(vx); Emit8(instruction.NN); // add byte [rbx + vx], NN
+		return true;
+	case 0xA:
+		Emit8(0x66); Emit8(0xC7); Emit8(0x83); Emit32(m_IRegisterOffset); Emit16(instruction.NNN); // mov word [rbx + i], NNN
+		return true;
+	case 0x8:
+		switch (instruction.N)
+		{
+		case 0x0:
+			EmitEmulatorOp(0x8A, RegAL, vy); // mov al, [rbx + vy]
+			EmitEmulatorOp(0x88, RegAL, vx); // mov [rbx + vx], al
+			return true;
+		case 0x1:
+		case 0x2:
+		case 0x3:
+		{
+			static constexpr uint8_t logicOps[] = { 0x08, 0x20, 0x30 }; // or, and, xor
+			EmitEmulatorOp(0x8A, RegAL, vy);                          // mov al, [rbx + vy]
+			EmitEmulatorOp(logicOps[instruction.N - 1], RegAL, vx);   // op [rbx + vx], al
+			if (quirks & Quirks::LogicResetsVF)
+			{
+				Emit8(0xC6); Emit8(0x83); Emit32(vf); Emit8(0); // mov byte [rbx + vf], 0
+			}
+			return true;
+		}
+		// VF is written last, like the interpreter, so it holds the flag when it's also the destination.
+		case 0x4:
+			EmitEmulatorOp(0x8A, RegAL, vx);      // mov al, [rbx + vx]
+			EmitEmulatorOp(0x02, RegAL, vy);      // add al, [rbx + vy]
+			Emit8(0x0F); Emit8(0x92); Emit8(0xC1); // setc cl
+			break;
+		case 0x5:
+			EmitEmulatorOp(0x8A, RegAL, vx);      // mov al, [rbx + vx]
+			EmitEmulatorOp(0x2A, RegAL, vy);      // sub al, [rbx + vy]
+			Emit8(0x0F); Emit8(0x93); Emit8(0xC1); // setnc cl
+			break;
+		case 0x7:
+			EmitEmulatorOp(0x8A, RegAL, vy);      // mov al, [rbx + vy]
+			EmitEmulatorOp(0x2A, RegAL, vx);      // sub al, [rbx + vx]
+			Emit8(0x0F); Emit8(0x93); Emit8(0xC1); // setnc cl
+			break;
+		case 0x6:
+			EmitEmulatorOp(0x8A, RegAL, (quirks & Quirks::ShiftUsesVY) ? vy : vx); // mov al, [rbx + source]
+			Emit8(0x88); Emit8(0xC1);             // mov cl, al
+			Emit8(0x80); Emit8(0xE1); Emit8(0x01); // and cl, 1
+			Emit8(0xD0); Emit8(0xE8);             // shr al, 1
+			break;
+		case 0xE:
+			EmitEmulatorOp(0x8A, RegAL, (quirks & Quirks::ShiftUsesVY) ? vy : vx); // mov al, [rbx + source]
+			Emit8(0x88); Emit8(0xC1);             // mov cl, al
+			Emit8(0xC0); Emit8(0xE9); Emit8(0x07); // shr cl, 7
+			Emit8(0x00); Emit8(0xC0);             // add al, al
+			break;
+		default:
+			return false;
+		}
+		EmitEmulatorOp(0x88, RegAL, vx); // mov [rbx + vx], al
+		EmitEmulatorOp(0x88, RegCL, vf); // mov [rbx + vf], cl
+		return true;
+	case 0xF:
+		switch (instruction.NN)
+		{
+		case 0x07:
+			EmitEmulatorOp(0x8A, RegAL, m_DelayTimerOffset); // mov al, [rbx + delay]
+			EmitEmulatorOp(0x88, RegAL, vx);                 // mov [rbx + vx], al
+			return true;
+		case 0x15:
+		case 0x18:
+			EmitEmulatorOp(0x8A, RegAL, vx); // mov al, [rbx + vx]
+			EmitEmulatorOp(0x88, RegAL, instruction.NN == 0x15 ? m_DelayTimerOffset : m_SoundTimerOffset); // mov [rbx + timer], al
+			return true;
+		case 0x1E:
+			Emit8(0x0F); Emit8(0xB6); Emit8(0x83); Emit32(vx);              // movzx eax, byte [rbx + vx]
+			Emit8(0x66); Emit8(0x01); Emit8(0x83); Emit32(m_IRegisterOffset); // add word [rbx + i], ax
+			return true;
+		default:
+			return false;
+		}
+	default:
+		return false;
+	}
+}
+
+void Jit::EmitHandlerCall(const DecodedInstruction& instruction, const uint16_t nextPc)
+{
+	// Handlers expect the program counter to already point at the next instruction.
+	Emit8(0x66); Emit8(0xC7); Emit8(0x83); Emit32(m_ProgramCounterOffset); Emit16(nextPc); // mov word [rbx + pc], nextPc
+
+	m_Instructions.push_back(instruction);
+#ifdef C8_PLATFORM_WINDOWS
+	Emit8(0x48); Emit8(0x89); Emit8(0xD9); // mov rcx, rbx
+	Emit8(0x48); Emit8(0xBA);              // mov rdx, &instruction
+#else
+	Emit8(0x48); Emit8(0x89); Emit8(0xDF); // mov rdi, rbx
+	Emit8(0x48); Emit8(0xBE);              // mov rsi, &instruction
+#endif
+	Emit64(reinterpret_cast<uint64_t>(&m_Instructions.back()));
+	Emit8(0x48); Emit8(0xB8);              // mov rax, handler
+	Emit64(reinterpret_cast<uint64_t>(instruction.Handler));
+	Emit8(0xFF); Emit8(0xD0);              // call rax
+}
+
+void Jit::EmitStaticExit(const uint16_t targetPc, const uint32_t instructionCount, Block& block)
+{
+	const uint32_t exitIndex = static_cast<uint32_t>(m_Exits.size());
+
+	Emit8(0x66); Emit8(0xC7); Emit8(0x83); Emit32(m_ProgramCounterOffset); Emit16(targetPc); // mov word [rbx + pc], target
+	Emit8(0x48); Emit8(0x81); Emit8(0xAD); Emit32(offsetof(JitContext, Budget)); Emit32(instructionCount); // sub qword [rbp + budget], count
+	// The target checks the budget itself on the way in
+	Emit8(0x80); Emit8(0xBB); Emit32(m_RunningOffset); Emit8(0); // cmp byte [rbx + running], 0
+	Emit8(0x0F); Emit8(0x84);              // je unlinked
+	uint8_t* const runningJump = m_Cursor;
+	Emit32(0);
+	Emit8(0xE9);                           // jmp target block, once linked
+	uint8_t* const linkJump = m_Cursor;
+	Emit32(0);
+
+	uint8_t* const unlinked = m_Cursor;
+	PatchRel32(runningJump, unlinked);
+	PatchRel32(linkJump, unlinked);
+	Emit8(0xC7); Emit8(0x85); Emit32(offsetof(JitContext, LastExit)); Emit32(exitIndex); // mov dword [rbp + lastExit], index
+	Emit8(0xE9); EmitRel32(m_Epilogue);    // jmp epilogue
+
+	Exit exit;
+	exit.Owner = &block;
+	exit.JumpField = linkJump;
+	exit.Unlinked = unlinked;
+	exit.TargetPc = targetPc;
+	m_Exits.push_back(exit);
+}
+
+void Jit::EmitDynamicExit(const uint32_t instructionCount)
+{
+	// The program counter has already been set by whatever handler ran last.
+	Emit8(0x48); Emit8(0x81); Emit8(0xAD); Emit32(offsetof(JitContext, Budget)); Emit32(instructionCount); // sub qword [rbp + budget], count
+	Emit8(0xC7); Emit8(0x85); Emit32(offsetof(JitContext, LastExit)); Emit32(static_cast<uint32_t>(-1)); // mov dword [rbp + lastExit], -1
+	Emit8(0xE9); EmitRel32(m_Epilogue);    // jmp epilogue
+}
+
+uint8_t* Jit::EmitRunningCheck()
+{
+	Emit8(0x80); Emit8(0xBB); Emit32(m_RunningOffset); Emit8(0); // cmp byte [rbx + running], 0
+	Emit8(0x75);                                                 // jne rel8, patched by the caller
+	uint8_t* const jump = m_Cursor;
+	Emit8(0);
+	return jump;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Code emission
+// -----------------------------------------------------------------------------------------------
+void Jit::Emit8(const uint8_t value)
+{
+	*m_Cursor++ = value;
+}
+
+void Jit::Emit16(const uint16_t value)
+{
+	memcpy(m_Cursor, &value, sizeof(value));
+	m_Cursor += sizeof(value);
+}
+
+void Jit::Emit32(const uint32_t value)
+{
+	memcpy(m_Cursor, &value, sizeof(value));
+	m_Cursor += sizeof(value);
+}
+
+void Jit::Emit64(const uint64_t value)
+{
+	memcpy(m_Cursor, &value, sizeof(value));
+	m_Cursor += sizeof(value);
+}
+
+void Jit::EmitRel32(const uint8_t* target)
+{
+	PatchRel32(m_Cursor, target);
+	m_Cursor += 4;
+}
+
+void Jit::PatchRel32(uint8_t* field, const uint8_t* target)
+{
+	const int32_t displacement = static_cast<int32_t>(target - (field + 4));
+	memcpy(field, &displacement, sizeof(displacement));
+}
+
+void Jit::EmitEmulatorOp(const uint8_t opcode, const uint8_t reg, const uint32_t offset)
+{
+	Emit8(opcode);
+	Emit8(static_cast<uint8_t>(0x80 | reg << 3 | 0x3)); // ModRM: [rbx + disp32]
+	Emit32(offset);
+}
@@ -0,0 +1,75 @@
+#include "c8pch.h"
+#include "Core/MappedFile.h"
+
+#ifndef C8_PLATFORM_WINDOWS
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path)
+{
+#ifdef C8_PLATFORM_WINDOWS
+	const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return;
+	}
+	m_Size = static_cast<size_t>(size.QuadPart);
+	m_Open = true;
+	// Mapping an empty file fails, and there'd be nothing to read anyway
+	if (m_Size > 0)
+	{
+		// The view keeps the mapping, and the mapping the file, open by itself
+		if (const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr))
+		{
+			m_Data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			CloseHandle(mapping);
+		}
+		m_Open = m_Data != nullptr;
+	}
+	CloseHandle(file);
+#else
+	const int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return;
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode))
+	{
+		close(file);
+		return;
+	}
+	m_Size = static_cast<size_t>(info.st_size);
+	m_Open = true;
+	// Mapping an empty file fails, and there'd be nothing to read anyway
+	if (m_Size > 0)
+	{
+		// The mapping keeps the file open by itself
+		void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0);
+		m_Data = data != MAP_FAILED ? static_cast<const uint8_t*>(data) : nullptr;
+		m_Open = m_Data != nullptr;
+	}
+	close(file);
+#endif
+
+	if (!m_Open)
+		m_Size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+	if (!m_Data)
+		return;
+#ifdef C8_PLATFORM_WINDOWS
+	UnmapViewOfFile(m_Data);
+#else
+	munmap(const_cast<uint8_t*>(m_Data), m_Size);
+#endif
+}
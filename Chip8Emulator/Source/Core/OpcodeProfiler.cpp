@@ -0,0 +1,228 @@
+#include "c8pch.h"
+#include "Core/OpcodeProfiler.h"
+
+#include <array>
+#include <iomanip>
+
+static constexpr const char* OpcodeClassNames[NumOpcodeClasses] = {
+	"0NNN", "00CN", "00DN", "00E0", "00EE", "00FB", "00FC", "00FD", "00FE", "00FF",
+	"1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "5XY2", "5XY3", "6XNN", "7XNN",
+	"8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE",
+	"9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "DXY0", "EX9E", "EXA1",
+	"F000", "FN01", "F002", "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29", "FX30", "FX33", "FX3A",
+	"FX55", "FX65", "FX75", "FX85",
+	"Invalid"
+};
+
+const char* GetOpcodeClassName(const OpcodeClass opcodeClass)
+{
+	return opcodeClass < OpcodeClass::NumClasses ? OpcodeClassNames[static_cast<uint32_t>(opcodeClass)] : "Unknown";
+}
+
+static OpcodeClass ClassifyOpcode(const uint16_t opcode)
+{
+	const uint8_t x = opcode >> 8 & 0xF;
+	const uint8_t n = opcode & 0xF;
+	const uint8_t nn = opcode & 0xFF;
+	switch (opcode >> 12)
+	{
+	case 0x0:
+		if (x != 0)
+			return OpcodeClass::Op_0NNN;
+		switch (nn)
+		{
+		case 0xE0: return OpcodeClass::Op_00E0;
+		case 0xEE: return OpcodeClass::Op_00EE;
+		case 0xFB: return OpcodeClass::Op_00FB;
+		case 0xFC: return OpcodeClass::Op_00FC;
+		case 0xFD: return OpcodeClass::Op_00FD;
+		case 0xFE: return OpcodeClass::Op_00FE;
+		case 0xFF: return OpcodeClass::Op_00FF;
+		default:
+			if ((nn & 0xF0) == 0xC0)
+				return OpcodeClass::Op_00CN;
+			if ((nn & 0xF0) == 0xD0)
+				return OpcodeClass::Op_00DN;
+			return OpcodeClass::Op_0NNN;
+		}
+	case 0x1: return OpcodeClass::Op_1NNN;
+	case 0x2: return OpcodeClass::Op_2NNN;
+	case 0x3: return OpcodeClass::Op_3XNN;
+	case 0x4: return OpcodeClass::Op_4XNN;
+	case 0x5:
+		switch (n)
+		{
+		case 0x0: return OpcodeClass::Op_5XY0;
+		case 0x2: return OpcodeClass::Op_5XY2;
+		case 0x3: return OpcodeClass::Op_5XY3;
+		default: return OpcodeClass::Invalid;
+		}
+	case 0x6: return OpcodeClass::Op_6XNN;
+	case 0x7: return OpcodeClass::Op_7XNN;
+	case 0x8:
+		switch (n)
+		{
+		case 0x0: return OpcodeClass::Op_8XY0;
+		case 0x1: return OpcodeClass::Op_8XY1;
+		case 0x2: return OpcodeClass::Op_8XY2;
+		case 0x3: return OpcodeClass::Op_8XY3;
+		case 0x4: return OpcodeClass::Op_8XY4;
+		case 0x5: return OpcodeClass::Op_8XY5;
+		case 0x6: return OpcodeClass::Op_8XY6;
+		case 0x7: return OpcodeClass::Op_8XY7;
+		case 0xE: return OpcodeClass::Op_8XYE;
+		default: return OpcodeClass::Invalid;
+		}
+	case 0x9: return n == 0 ? OpcodeClass::Op_9XY0 : OpcodeClass::Invalid;
+	case 0xA: return OpcodeClass::Op_ANNN;
+	case 0xB: return OpcodeClass::Op_BNNN;
+	case 0xC: return OpcodeClass::Op_CXNN;
+	case 0xD: return n == 0 ? OpcodeClass::Op_DXY0 : OpcodeClass::Op_DXYN;
+	case 0xE:
+		switch (nn)
+		{
+		case 0x9E: return OpcodeClass::Op_EX9E;
+		case 0xA1: return OpcodeClass::Op_EXA1;
+		default: return OpcodeClass::Invalid;
+		}
+	default:
+		switch (nn)
+		{
+		case 0x00: return x == 0 ? OpcodeClass::Op_F000 : OpcodeClass::Invalid;
+		case 0x01: return OpcodeClass::Op_FN01;
+		case 0x02: return x == 0 ? OpcodeClass::Op_F002 : OpcodeClass::Invalid;
+		case 0x07: return OpcodeClass::Op_FX07;
+		case 0x0A: return OpcodeClass::Op_FX0A;
+		case 0x15: return OpcodeClass::Op_FX15;
+		case 0x18: return OpcodeClass::Op_FX18;
+		case 0x1E: return OpcodeClass::Op_FX1E;
+		case 0x29: return OpcodeClass::Op_FX29;
+		case 0x30: return OpcodeClass::Op_FX30;
+		case 0x33: return OpcodeClass::Op_FX33;
+		case 0x3A: return OpcodeClass::Op_FX3A;
+		case 0x55: return OpcodeClass::Op_FX55;
+		case 0x65: return OpcodeClass::Op_FX65;
+		case 0x75: return OpcodeClass::Op_FX75;
+		case 0x85: return OpcodeClass::Op_FX85;
+		default: return OpcodeClass::Invalid;
+		}
+	}
+}
+
+// Built at startup rather than at compile time, as 64K entries is more than some compilers will evaluate in a constexpr
+static std::array<uint8_t, 0x10000> BuildOpcodeClasses()
+{
+	std::array<uint8_t, 0x10000> table = {};
+	for (uint32_t opcode = 0; opcode < table.size(); opcode++)
+		table[opcode] = static_cast<uint8_t>(ClassifyOpcode(static_cast<uint16_t>(opcode)));
+	return table;
+}
+
+static const std::array<uint8_t, 0x10000> s_OpcodeClassTable = BuildOpcodeClasses();
+const uint8_t* const OpcodeProfiler::s_OpcodeClasses = s_OpcodeClassTable.data();
+
+// -----------------------------------------------------------------------------------------------
+// Profiler
+// -----------------------------------------------------------------------------------------------
+OpcodeProfiler::OpcodeProfiler()
+	: m_AddressCounts(0x10000, 0)
+{
+	// Reading the clock takes long enough to be a fair part of a short instruction's sample, so it's measured here and
+	// taken off each one. The shortest of a few reads is the one least likely to have been interrupted.
+	uint64_t overhead = UINT64_MAX;
+	for (int i = 0; i < 64; i++)
+	{
+		const uint64_t start = GetTime();
+		overhead = std::min(overhead, GetTime() - start);
+	}
+	m_ClockOverhead = overhead;
+}
+
+void OpcodeProfiler::Reset()
+{
+	std::fill(std::begin(m_ClassCounts), std::end(m_ClassCounts), 0);
+	std::fill(std::begin(m_ClassSamples), std::end(m_ClassSamples), 0);
+	std::fill(std::begin(m_ClassSampledNs), std::end(m_ClassSampledNs), 0);
+	std::fill(m_AddressCounts.begin(), m_AddressCounts.end(), 0);
+	m_UntilSample = SampleInterval;
+}
+
+void OpcodeProfiler::TakeSnapshot(OpcodeProfile& profile) const
+{
+	profile.InstructionCount = 0;
+	for (uint32_t i = 0; i < NumOpcodeClasses; i++)
+	{
+		profile.Classes[i].Count = m_ClassCounts[i];
+		profile.Classes[i].Samples = m_ClassSamples[i];
+		profile.Classes[i].SampledNs = m_ClassSampledNs[i];
+		profile.InstructionCount += m_ClassCounts[i];
+	}
+
+	// Keeps the hottest addresses seen so far in order, inserting each that beats the coldest of them
+	profile.HotSpotCount = 0;
+	for (uint32_t address = 0; address < m_AddressCounts.size(); address++)
+	{
+		const uint64_t count = m_AddressCounts[address];
+		if (count == 0 || (profile.HotSpotCount == OpcodeProfile::MaxHotSpots && count <= profile.HotSpots[OpcodeProfile::MaxHotSpots - 1].Count))
+			continue;
+
+		uint32_t i = std::min(profile.HotSpotCount, OpcodeProfile::MaxHotSpots - 1);
+		for (; i > 0 && profile.HotSpots[i - 1].Count < count; i--)
+			profile.HotSpots[i] = profile.HotSpots[i - 1];
+		profile.HotSpots[i] = { static_cast<uint16_t>(address), count };
+		profile.HotSpotCount = std::min(profile.HotSpotCount + 1, OpcodeProfile::MaxHotSpots);
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+// CSV
+// -----------------------------------------------------------------------------------------------
+static void WriteCsvField(std::ostream& out, const std::string& field)
+{
+	if (field.find_first_of(",\"\r\n") == std::string::npos)
+	{
+		out << field;
+		return;
+	}
+	out << '"';
+	for (const char c : field)
+	{
+		if (c == '"')
+			out << '"';
+		out << c;
+	}
+	out << '"';
+}
+
+void OpcodeProfile::WriteCsvHeader(std::ostream& out)
+{
+	out << "run,kind,key,count,share,samples,mean_ns,estimated_ms\n";
+}
+
+void OpcodeProfile::WriteCsv(std::ostream& out, const std::string& run) const
+{
+	const double total = static_cast<double>(std::max<uint64_t>(InstructionCount, 1));
+	const auto flags = out.flags();
+	const auto precision = out.precision();
+	out << std::fixed << std::setprecision(6);
+
+	for (uint32_t i = 0; i < NumOpcodeClasses; i++)
+	{
+		const ClassStats& stats = Classes[i];
+		if (stats.Count == 0)
+			continue;
+		const double meanNs = GetMeanNs(static_cast<OpcodeClass>(i));
+		WriteCsvField(out, run);
+		out << ",class," << OpcodeClassNames[i] << ',' << stats.Count << ',' << static_cast<double>(stats.Count) / total << ','
+			<< stats.Samples << ',' << meanNs << ',' << meanNs * static_cast<double>(stats.Count) / 1e6 << '\n';
+	}
+	for (uint32_t i = 0; i < HotSpotCount; i++)
+	{
+		WriteCsvField(out, run);
+		out << ",address," << fmt::format("{0:#05x}", HotSpots[i].Address) << ',' << HotSpots[i].Count << ','
+			<< static_cast<double>(HotSpots[i].Count) / total << ",,,\n";
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,277 @@
+#include "c8pch.h"
+#include "Core/RewindBuffer.h"
+
+#include "Core/SaveState.h"
+
+// Records start with one of these, followed by runs: a varint count of zero bytes, then a varint count of literal bytes and
+// the bytes themselves, to the end of the record. Any zeros at the very end are left out.
+enum class RewindRecordType : uint8_t
+{
+	Delta,   // Runs of the XOR of the snapshot before and the snapshot after
+	Keyframe // Runs of the snapshot before itself
+};
+
+// Zeros in a literal shorter than this are copied as they are, rather than ending it, as a run would cost about as much
+static constexpr size_t MinZeroRun = 8;
+static constexpr size_t MaxVarintSize = 5;
+
+// Every run but the first covers at least MinZeroRun zeros and a literal byte, and costs at most two varints on top of that.
+// A literal can also be cut short at the end of each span Push encodes, of which there's at most one per page and two more.
+static size_t GetMaxRecordSize(const size_t stateSize)
+{
+	return 1 + stateSize + (stateSize / (MinZeroRun + 1) + Emulator::MaxMemoryPages + 4) * 2 * MaxVarintSize;
+}
+
+static FORCEINLINE uint8_t* WriteVarint(uint8_t* out, size_t value)
+{
+	while (value >= 0x80)
+	{
+		*out++ = static_cast<uint8_t>(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = static_cast<uint8_t>(value);
+	return out;
+}
+
+static FORCEINLINE size_t ReadVarint(const uint8_t*& in)
+{
+	size_t value = 0;
+	for (int shift = 0; ; shift += 7)
+	{
+		const uint8_t byte = *in++;
+		value |= static_cast<size_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return value;
+	}
+}
+
+// Writes the runs of before XOR after, or of just before for a keyframe, into out. The snapshots are encoded a span at a
+// time, in order, and anything between spans is taken to be zeros, i.e. unchanged.
+template<RewindRecordType Type>
+class RunEncoder
+{
+public:
+	RunEncoder(const uint8_t* const before, const uint8_t* const after, uint8_t* const out)
+		: m_Before(before), m_After(after), m_Out(out), m_Cursor(out)
+	{
+		*m_Cursor++ = static_cast<uint8_t>(Type);
+	}
+
+	void Encode(size_t i, const size_t end)
+	{
+		while (true)
+		{
+			// Most of a snapshot is unchanged, so zeros are skipped a word at a time
+			while (i + sizeof(uint64_t) <= end && IsZeroWord(i))
+				i += sizeof(uint64_t);
+			while (i < end && ByteAt(i) == 0)
+				i++;
+			if (i == end)
+				return;
+
+			const size_t literalStart = i;
+			size_t zeros = 0;
+			for (; i < end && zeros < MinZeroRun; i++)
+				zeros = ByteAt(i) == 0 ? zeros + 1 : 0;
+			// Leave the zeros that ended it, if any, for the next run
+			i -= zeros;
+
+			m_Cursor = WriteVarint(m_Cursor, literalStart - m_RunStart);
+			m_Cursor = WriteVarint(m_Cursor, i - literalStart);
+			for (size_t j = literalStart; j < i; j++)
+				*m_Cursor++ = ByteAt(j);
+			m_RunStart = i;
+		}
+	}
+
+	[[nodiscard]] size_t GetSize() const { return m_Cursor - m_Out; }
+
+private:
+	FORCEINLINE uint8_t ByteAt(const size_t i) const
+	{
+		if constexpr (Type == RewindRecordType::Delta)
+			return m_Before[i] ^ m_After[i];
+		else
+			return m_Before[i];
+	}
+
+	FORCEINLINE bool IsZeroWord(const size_t i) const
+	{
+		uint64_t word;
+		memcpy(&word, m_Before + i, sizeof(word));
+		if constexpr (Type == RewindRecordType::Delta)
+		{
+			uint64_t afterWord;
+			memcpy(&afterWord, m_After + i, sizeof(afterWord));
+			word ^= afterWord;
+		}
+		return word == 0;
+	}
+
+	const uint8_t* m_Before;
+	const uint8_t* m_After;
+	uint8_t* m_Out;
+	uint8_t* m_Cursor;
+	size_t m_RunStart = 0; // Where the zero run being counted started, i.e. the end of the last literal
+};
+
+// Decodes runs into state, which holds the snapshot after for a delta, and becomes the snapshot before either way
+template<RewindRecordType Type>
+static void DecodeRuns(const uint8_t* in, const uint8_t* const end, uint8_t* const state, const size_t size)
+{
+	size_t i = 0;
+	while (in < end)
+	{
+		const size_t run = ReadVarint(in);
+		const size_t literal = ReadVarint(in);
+		if constexpr (Type == RewindRecordType::Keyframe)
+			memset(state + i, 0, run);
+		i += run;
+		if constexpr (Type == RewindRecordType::Delta)
+		{
+			for (size_t j = 0; j < literal; j++)
+				state[i + j] ^= in[j];
+		}
+		else
+			memcpy(state + i, in, literal);
+		in += literal;
+		i += literal;
+	}
+	if constexpr (Type == RewindRecordType::Keyframe)
+		memset(state + i, 0, size - i);
+}
+
+RewindBuffer::RewindBuffer(const size_t capacity, const uint32_t maxSnapshots)
+	: m_Data(std::make_unique<uint8_t[]>(capacity)), m_Capacity(capacity), m_Records(std::max(maxSnapshots, 1u))
+{ }
+
+void RewindBuffer::Clear()
+{
+	m_WriteOffset = 0;
+	m_UsedBytes = 0;
+	m_FirstRecord = m_RecordCount = 0;
+	m_Newest.clear();
+}
+
+bool RewindBuffer::Push(Emulator& emulator)
+{
+	if (!emulator.SaveState(m_Pushed))
+		return false;
+
+	if (!m_Newest.empty())
+	{
+		const size_t maxSize = GetMaxRecordSize(m_Newest.size());
+		if (m_Encoded.size() < maxSize)
+			m_Encoded.resize(maxSize);
+
+		size_t size;
+		if (m_Pushed.size() != m_Newest.size())
+		{
+			RunEncoder<RewindRecordType::Keyframe> encoder(m_Newest.data(), nullptr, m_Encoded.data());
+			encoder.Encode(0, m_Newest.size());
+			size = encoder.GetSize();
+		}
+		else
+		{
+			RunEncoder<RewindRecordType::Delta> encoder(m_Newest.data(), m_Pushed.data(), m_Encoded.data());
+			// Memory that hasn't been written to since the last push can't have changed, so only the dirty pages need
+			// comparing, as long as memory is laid out the same in both, which the header says
+			if (memcmp(m_Newest.data(), m_Pushed.data(), SaveStateFormat::HeaderSize) == 0)
+			{
+				const size_t memoryEnd = SaveStateFormat::FixedSize + emulator.GetMemorySize();
+				encoder.Encode(0, SaveStateFormat::FixedSize);
+				for (uint32_t page = 0; page < emulator.GetMemoryPageCount(); page++)
+				{
+					if (emulator.IsPageDirty(page))
+					{
+						const size_t offset = SaveStateFormat::FixedSize + page * Emulator::MemoryPageSize;
+						encoder.Encode(offset, offset + Emulator::MemoryPageSize);
+					}
+				}
+				encoder.Encode(memoryEnd, m_Newest.size());
+			}
+			else
+				encoder.Encode(0, m_Newest.size());
+			size = encoder.GetSize();
+		}
+
+		if (uint8_t* record = AddRecord(static_cast<uint32_t>(size), static_cast<uint32_t>(m_Newest.size())))
+			memcpy(record, m_Encoded.data(), size);
+		else
+		{
+			// Can't get back past a snapshot that didn't fit, so history starts again from this one
+			C8_WARN("Rewind snapshot of {0} bytes doesn't fit in the rewind buffer; dropping history", size);
+			Clear();
+		}
+	}
+
+	std::swap(m_Newest, m_Pushed);
+	emulator.ClearDirtyPages();
+	return true;
+}
+
+bool RewindBuffer::StepBack(Emulator& emulator)
+{
+	if (m_RecordCount == 0)
+		return false;
+
+	const Record& record = m_Records[(m_FirstRecord + m_RecordCount - 1) % m_Records.size()];
+	const uint8_t* const data = m_Data.get() + record.Offset;
+	const uint8_t* const end = data + record.Size;
+	if (static_cast<RewindRecordType>(data[0]) == RewindRecordType::Delta)
+		DecodeRuns<RewindRecordType::Delta>(data + 1, end, m_Newest.data(), m_Newest.size());
+	else
+	{
+		m_Newest.resize(record.StateSize);
+		DecodeRuns<RewindRecordType::Keyframe>(data + 1, end, m_Newest.data(), m_Newest.size());
+	}
+
+	// It was the newest record, so its space is the next to be written
+	m_WriteOffset = record.Offset;
+	m_UsedBytes -= record.Size;
+	m_RecordCount--;
+	if (!emulator.LoadState(m_Newest))
+		return false;
+	// The emulator matches the newest snapshot again, so the next push only has to compare what changes after this
+	emulator.ClearDirtyPages();
+	return true;
+}
+
+uint8_t* RewindBuffer::AddRecord(const uint32_t size, const uint32_t stateSize)
+{
+	if (size > m_Capacity)
+		return nullptr;
+
+	// Records are kept whole, so if it doesn't fit before the end, what's left there is skipped
+	const uint32_t offset = m_WriteOffset + size <= m_Capacity ? m_WriteOffset : 0;
+	// Everything from the write offset up to the end of the new record is about to be written over, going round to the
+	// start if need be. Records are in order round the ring from the oldest, so dropping the oldest until it starts
+	// outside of that frees it all.
+	const size_t overwritten = offset == 0 && m_WriteOffset != 0 ? m_Capacity - m_WriteOffset + size : size;
+	while (m_RecordCount > 0)
+	{
+		const uint32_t oldestOffset = m_Records[m_FirstRecord].Offset;
+		const size_t distance = oldestOffset >= m_WriteOffset ? oldestOffset - m_WriteOffset : m_Capacity - m_WriteOffset + oldestOffset;
+		if (distance >= overwritten)
+			break;
+		DropOldestRecord();
+	}
+	if (m_RecordCount == m_Records.size())
+		DropOldestRecord();
+
+	Record& record = m_Records[(m_FirstRecord + m_RecordCount) % m_Records.size()];
+	record.Offset = offset;
+	record.Size = size;
+	record.StateSize = stateSize;
+	m_RecordCount++;
+	m_UsedBytes += size;
+	m_WriteOffset = offset + size;
+	return m_Data.get() + offset;
+}
+
+void RewindBuffer::DropOldestRecord()
+{
+	m_UsedBytes -= m_Records[m_FirstRecord].Size;
+	m_FirstRecord = (m_FirstRecord + 1) % static_cast<uint32_t>(m_Records.size());
+	m_RecordCount--;
+}
@@ -0,0 +1,263 @@
+#include "c8pch.h"
+#include "Core/RomDatabase.h"
+
+#include <climits>
+#include <filesystem>
+#include <fstream>
+
+#include "Core/Interpreter.h"
+#include "Core/MappedFile.h"
+#include "Core/SaveState.h"
+
+namespace RomDatabaseFormat
+{
+	constexpr char Magic[4] = { 'C', '8', 'D', 'B' };
+	constexpr uint16_t Version = 1;
+	constexpr size_t HeaderSize = 16;
+	constexpr size_t EntrySize = 32;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Hashing
+// -----------------------------------------------------------------------------------------------
+static constexpr uint64_t Prime64_1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t Prime64_2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t Prime64_3 = 0x165667B19E3779F9ull;
+static constexpr uint64_t Prime64_4 = 0x85EBCA77C2B2AE63ull;
+static constexpr uint64_t Prime64_5 = 0x27D4EB2F165667C5ull;
+
+static FORCEINLINE uint64_t RotateLeft(const uint64_t value, const int bits) { return value << bits | value >> (64 - bits); }
+
+template <typename T>
+static FORCEINLINE T ReadLittleEndian(const uint8_t* const bytes)
+{
+	T value = 0;
+#ifdef C8_BIG_ENDIAN
+	for (size_t i = 0; i < sizeof(T); i++)
+		value |= static_cast<T>(bytes[i]) << i * 8;
+#else
+	memcpy(&value, bytes, sizeof(T));
+#endif
+	return value;
+}
+
+static FORCEINLINE uint64_t HashRound(uint64_t accumulator, const uint64_t input)
+{
+	accumulator += input * Prime64_2;
+	return RotateLeft(accumulator, 31) * Prime64_1;
+}
+
+static FORCEINLINE uint64_t MergeRound(const uint64_t accumulator, const uint64_t value)
+{
+	return (accumulator ^ HashRound(0, value)) * Prime64_1 + Prime64_4;
+}
+
+uint64_t RomDatabase::HashRom(const uint8_t* bytes, const size_t size)
+{
+	const uint8_t* const end = bytes + size;
+	uint64_t hash;
+	if (size >= 32)
+	{
+		// Four independent lanes over 32 byte stripes
+		uint64_t lanes[4] = { Prime64_1 + Prime64_2, Prime64_2, 0, 0 - Prime64_1 };
+		for (; bytes + 32 <= end; bytes += 32)
+		{
+			for (int lane = 0; lane < 4; lane++)
+				lanes[lane] = HashRound(lanes[lane], ReadLittleEndian<uint64_t>(bytes + lane * 8));
+		}
+		hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+		for (const uint64_t lane : lanes)
+			hash = MergeRound(hash, lane);
+	}
+	else
+		hash = Prime64_5;
+	hash += size;
+
+	for (; bytes + 8 <= end; bytes += 8)
+		hash = RotateLeft(hash ^ HashRound(0, ReadLittleEndian<uint64_t>(bytes)), 27) * Prime64_1 + Prime64_4;
+	if (bytes + 4 <= end)
+	{
+		hash = RotateLeft(hash ^ ReadLittleEndian<uint32_t>(bytes) * Prime64_1, 23) * Prime64_2 + Prime64_3;
+		bytes += 4;
+	}
+	for (; bytes < end; bytes++)
+		hash = RotateLeft(hash ^ *bytes * Prime64_5, 11) * Prime64_1;
+
+	hash ^= hash >> 33;
+	hash *= Prime64_2;
+	hash ^= hash >> 29;
+	hash *= Prime64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Database
+// -----------------------------------------------------------------------------------------------
+RomDatabase::RomDatabase() = default;
+
+RomDatabase::~RomDatabase() = default;
+
+bool RomDatabase::Open(const std::string& path)
+{
+	Close();
+	m_Path = path;
+
+	auto file = std::make_unique<MappedFile>(path);
+	if (!file->IsOpen())
+		return false;
+
+	const uint8_t* const data = file->GetData();
+	const size_t size = file->GetSize();
+	if (size < RomDatabaseFormat::HeaderSize || memcmp(data, RomDatabaseFormat::Magic, sizeof(RomDatabaseFormat::Magic)) != 0)
+	{
+		C8_WARN("{0} isn't a ROM database", path);
+		return false;
+	}
+	SaveStateReader reader(data + sizeof(RomDatabaseFormat::Magic));
+	const uint16_t version = reader.Read16();
+	reader.Skip(2);
+	const uint32_t entryCount = reader.Read32();
+	if (version != RomDatabaseFormat::Version)
+	{
+		C8_WARN("ROM database {0} is version {1}, expected {2}", path, version, RomDatabaseFormat::Version);
+		return false;
+	}
+	if (size != RomDatabaseFormat::HeaderSize + static_cast<size_t>(entryCount) * RomDatabaseFormat::EntrySize)
+	{
+		C8_WARN("ROM database {0} is {1} bytes, which doesn't match its {2} entries", path, size, entryCount);
+		return false;
+	}
+
+	m_File = std::move(file);
+	m_Entries = data + RomDatabaseFormat::HeaderSize;
+	m_EntryCount = entryCount;
+	return true;
+}
+
+void RomDatabase::Close()
+{
+	m_File.reset();
+	m_Entries = nullptr;
+	m_EntryCount = 0;
+}
+
+bool RomDatabase::Find(const uint64_t hash, RomInfo& info) const
+{
+	const uint32_t index = FindIndex(hash);
+	if (index == m_EntryCount || GetEntryHash(index) != hash)
+		return false;
+	info = ReadEntry(index);
+	return true;
+}
+
+bool RomDatabase::Store(const uint64_t hash, const RomInfo& info)
+{
+	if (m_Path.empty())
+	{
+		C8_ERROR("RomDatabase::Store called before Open");
+		return false;
+	}
+
+	// Find where it goes, replacing the entry for the same ROM if there is one
+	const uint32_t index = FindIndex(hash);
+	const bool replacing = index < m_EntryCount && GetEntryHash(index) == hash;
+	const uint32_t entryCount = m_EntryCount + (replacing ? 0 : 1);
+
+	std::vector<uint8_t> data(RomDatabaseFormat::HeaderSize + static_cast<size_t>(entryCount) * RomDatabaseFormat::EntrySize);
+	SaveStateWriter writer(data.data());
+	writer.WriteBytes(RomDatabaseFormat::Magic, sizeof(RomDatabaseFormat::Magic));
+	writer.Write16(RomDatabaseFormat::Version);
+	writer.Write16(0);
+	writer.Write32(entryCount);
+	writer.Write32(0);
+	if (index > 0)
+		writer.WriteBytes(m_Entries, static_cast<size_t>(index) * RomDatabaseFormat::EntrySize);
+	writer.Write32(static_cast<uint32_t>(hash));
+	writer.Write32(static_cast<uint32_t>(hash >> 32));
+	writer.Write32(static_cast<uint32_t>(info.KeyMap));
+	writer.Write32(static_cast<uint32_t>(info.KeyMap >> 32));
+	writer.Write32(info.Quirks);
+	writer.Write32(static_cast<uint32_t>(std::max(info.CyclesPerSecond, 0)));
+	writer.Write8(static_cast<uint8_t>(info.Mode));
+	for (int i = 0; i < 7; i++)
+		writer.Write8(0);
+	const uint32_t after = index + (replacing ? 1 : 0);
+	if (after < m_EntryCount)
+		writer.WriteBytes(m_Entries + static_cast<size_t>(after) * RomDatabaseFormat::EntrySize, static_cast<size_t>(m_EntryCount - after) * RomDatabaseFormat::EntrySize);
+
+	// The file can't be written over while it's mapped, on Windows at least, so it's unmapped first. The new one is
+	// written alongside and moved over the top, so a failed write never leaves a broken database behind.
+	const std::string path = m_Path;
+	const std::string tempPath = path + ".tmp";
+	Close();
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+		if (!file)
+		{
+			C8_ERROR("Failed to write ROM database: {0}", tempPath);
+			Open(path);
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if (error)
+	{
+		C8_ERROR("Failed to replace ROM database {0}: {1}", path, error.message());
+		std::filesystem::remove(tempPath, error);
+		Open(path);
+		return false;
+	}
+	return Open(path);
+}
+
+CompatibilityMode RomDatabase::GetModeForQuirks(const RomInfo& info)
+{
+	if (info.Quirks == 0 || Interpreter::GetVariant(info.Mode).Quirks == info.Quirks)
+		return info.Mode;
+	for (int i = 0; i < static_cast<int>(CompatibilityMode::NumModes); i++)
+	{
+		const auto mode = static_cast<CompatibilityMode>(i);
+		if (Interpreter::GetVariant(mode).Quirks == info.Quirks)
+			return mode;
+	}
+	C8_WARN("No compatibility mode has quirks {0:#x}; running in {1}", info.Quirks, GetCompatibilityModeName(info.Mode));
+	return info.Mode;
+}
+
+uint32_t RomDatabase::FindIndex(const uint64_t hash) const
+{
+	uint32_t first = 0, count = m_EntryCount;
+	while (count > 0)
+	{
+		const uint32_t half = count / 2;
+		if (GetEntryHash(first + half) < hash)
+		{
+			first += half + 1;
+			count -= half + 1;
+		}
+		else
+			count = half;
+	}
+	return first;
+}
+
+uint64_t RomDatabase::GetEntryHash(const uint32_t index) const
+{
+	return ReadLittleEndian<uint64_t>(m_Entries + static_cast<size_t>(index) * RomDatabaseFormat::EntrySize);
+}
+
+RomInfo RomDatabase::ReadEntry(const uint32_t index) const
+{
+	SaveStateReader reader(m_Entries + static_cast<size_t>(index) * RomDatabaseFormat::EntrySize + sizeof(uint64_t));
+	RomInfo info;
+	info.KeyMap = reader.Read32();
+	info.KeyMap |= static_cast<uint64_t>(reader.Read32()) << 32;
+	info.Quirks = reader.Read32();
+	info.CyclesPerSecond = static_cast<int>(std::min(reader.Read32(), static_cast<uint32_t>(INT_MAX)));
+	const uint8_t mode = reader.Read8();
+	info.Mode = mode < static_cast<uint8_t>(CompatibilityMode::NumModes) ? static_cast<CompatibilityMode>(mode) : CompatibilityMode::Chip8;
+	return info;
+}
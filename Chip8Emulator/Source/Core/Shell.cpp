@@ -1,10 +1,17 @@
 #include "c8pch.h"
 #include "Core/Shell.h"
 
+#include <filesystem>
+#include <fstream>
+
 #include <SDL3/SDL.h>
 #include <imgui.h>
 
+#include "Core/EmulationThread.h"
 #include "Core/Emulator.h"
+#include "Core/MappedFile.h"
+#include "Core/OpcodeProfiler.h"
+#include "Core/RomDatabase.h"
 #include "backends/imgui_impl_sdl3.h"
 #include "backends/imgui_impl_sdlrenderer3.h"
 
@@ -36,6 +43,7 @@ bool Shell::Init()
 	InitLog(prefPath);
 	C8_TRACE("Hello! Welcome to Chip-8 :)");
 	C8_TRACE("	Saving stuff to: {0}", prefPath);
+	m_PrefPath = prefPath != nullptr ? prefPath : "";
 	
 	// Create the window.
 	m_Window = SDL_CreateWindow("Chip8 Emulator", 1280, 600, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIDDEN);
@@ -125,8 +133,16 @@ bool Shell::Init()
 		return false;	
 	}
 
-	// Create emulator
+	// Create emulator, and start it running on its own thread, paced by SDL's high resolution clock
 	m_Emulator = new Emulator();
+	m_EmulationThread = new EmulationThread(*m_Emulator, &SDL_GetTicksNS);
+	m_EmulationThread->Start();
+
+	// The ROM database lives alongside everything else we save. If there isn't one yet, it's created when a ROM's settings are first remembered.
+	m_RomDatabase = new RomDatabase();
+	const std::string romDatabasePath = fmt::format("{0}{1}", prefPath != nullptr ? prefPath : "", RomDatabase::FileName);
+	if (m_RomDatabase->Open(romDatabasePath))
+		C8_TRACE("	Loaded {0} ROMs from the ROM database", m_RomDatabase->GetEntryCount());
 
 	m_Initialised = true;
 
@@ -151,6 +167,8 @@ void Shell::Run()
 					m_Running = false;
 				if (event.type == SDL_EVENT_WINDOW_CLOSE_REQUESTED && event.window.windowID == SDL_GetWindowID(m_Window))
 					m_Running = false;
+				if (event.type == SDL_EVENT_DROP_FILE && event.drop.data != nullptr)
+					LoadRom(event.drop.data);
 				if (event.type == SDL_EVENT_KEY_DOWN)
 				{
 					switch (event.key.key)
@@ -158,7 +176,24 @@ void Shell::Run()
 						case SDLK_ESCAPE:
 							m_Running = false;
 							break;
+						case SDLK_TAB:
+							if (!event.key.repeat)
+								SetTurbo(!m_Turbo);
+							break;
+						case SDLK_F5:
+							m_EmulationThread->PushInput({ EmulatorInput::Type::SaveState, 0, false, 0 });
+							break;
+						case SDLK_F9:
+							m_EmulationThread->PushInput({ EmulatorInput::Type::LoadState, 0, false, 0 });
+							break;
+						case SDLK_BACKSPACE:
+							if (!event.key.repeat)
+								m_EmulationThread->PushInput({ EmulatorInput::Type::Rewind, 0, true, 0 });
+							break;
 						case SDLK_R:
+							// R is on the keypad too, so this needs Ctrl
+							if (!(event.key.mod & SDL_KMOD_CTRL))
+								break;
 							m_RequestingRestart = !m_RequestingRestart;
 							if (m_RequestingRestart)
 								C8_INFO("The shell will restart when closed.");
@@ -169,9 +204,24 @@ void Shell::Run()
 							break;
 					}
 				}
+				// Rewinding goes on for as long as it's held
+				if (event.type == SDL_EVENT_KEY_UP && event.key.key == SDLK_BACKSPACE)
+					m_EmulationThread->PushInput({ EmulatorInput::Type::Rewind, 0, false, 0 });
+				if ((event.type == SDL_EVENT_KEY_DOWN || event.type == SDL_EVENT_KEY_UP) && !event.key.repeat && !(event.key.mod & SDL_KMOD_CTRL))
+					HandleKeypadKey(event.key.scancode, event.type == SDL_EVENT_KEY_DOWN);
 			}
 
 			// Draw c-8
+			m_EmulationThread->AcquireFrame();
+			const EmulatorFrame& frame = m_EmulationThread->GetFrame();
+			// Fast-forwarding produces far more frames than are worth drawing, so only some of them get presented
+			if (frame.Turbo && !ShouldPresentTurboFrame(frame))
+			{
+				SDL_Delay(1);
+				continue;
+			}
+			if (frame.Sequence != m_PresentedFrame)
+				UpdateDisplayTexture();
 
 			// Begin imgui frame
 			ImGui_ImplSDLRenderer3_NewFrame();
@@ -181,20 +231,84 @@ void Shell::Run()
 			// Draw UI
 			ImGui::Begin("Emulator Playground", nullptr, ImGuiWindowFlags_HorizontalScrollbar);
 			// TODO: Make this a combo box
-			if (ImGui::BeginCombo("Compatibility Mode", GetCompatibilityModeName(m_Emulator->GetCompatibilityMode())))
+			// The emulator is busy on its own thread, so show its state as of the newest frame, and send it changes as inputs
+			if (ImGui::BeginCombo("Compatibility Mode", GetCompatibilityModeName(frame.Mode)))
 			{
 				for (int i = 0; i < static_cast<int>(CompatibilityMode::NumModes); i++)
 				{
-					const bool isSelected = m_Emulator->GetCompatibilityMode() == static_cast<CompatibilityMode>(i);
+					const bool isSelected = frame.Mode == static_cast<CompatibilityMode>(i);
 					if (ImGui::Selectable(GetCompatibilityModeName(static_cast<CompatibilityMode>(i)), isSelected))
-						m_Emulator->SetCompatibilityMode(static_cast<CompatibilityMode>(i));
+						m_EmulationThread->PushInput({ EmulatorInput::Type::CompatibilityMode, 0, false, static_cast<uint32_t>(i) });
+					if (isSelected)
+						ImGui::SetItemDefaultFocus();
+				}
+				ImGui::EndCombo();
+			}
+			bool debugLogs = frame.DebugLogs;
+			if (ImGui::Checkbox("Debug Logs", &debugLogs))
+				m_EmulationThread->PushInput({ EmulatorInput::Type::DebugLogs, 0, debugLogs, 0 });
+			ImGui::SameLine();
+			bool turbo = m_Turbo;
+			if (ImGui::Checkbox("Turbo", &turbo))
+				SetTurbo(turbo);
+			ImGui::SameLine();
+			bool profiling = frame.Profiling;
+			if (ImGui::Checkbox("Profile", &profiling))
+				m_EmulationThread->PushInput({ EmulatorInput::Type::Profile, 0, profiling, 0 });
+			ImGui::SetItemTooltip("Count and time the instructions executed. Runs on the interpreter whatever the backend.");
+			ImGui::SameLine();
+			ImGui::Text("%.2fx, %.2f MIPS", frame.SpeedMultiplier, frame.Mips);
+			if (ImGui::BeginCombo("Backend", GetExecutionBackendName(frame.Backend)))
+			{
+				for (int i = 0; i < static_cast<int>(ExecutionBackend::NumBackends); i++)
+				{
+					const bool isSelected = frame.Backend == static_cast<ExecutionBackend>(i);
+					if (ImGui::Selectable(GetExecutionBackendName(static_cast<ExecutionBackend>(i)), isSelected))
+						m_EmulationThread->PushInput({ EmulatorInput::Type::ExecutionBackend, 0, false, static_cast<uint32_t>(i) });
 					if (isSelected)
 						ImGui::SetItemDefaultFocus();
 				}
 				ImGui::EndCombo();
 			}
-			ImGui::Checkbox("Debug Logs", &m_Emulator->m_DebugLogs);
+			int cyclesPerSecond = frame.CyclesPerSecond;
+			if (ImGui::InputInt("Cycles Per Second", &cyclesPerSecond, 100, 1000))
+				m_EmulationThread->PushInput({ EmulatorInput::Type::CyclesPerSecond, 0, false, static_cast<uint32_t>(std::max(cyclesPerSecond, 1)) });
+			if (ImGui::InputInt("Turbo Frame Skip", &m_TurboFrameSkip))
+				m_TurboFrameSkip = std::max(m_TurboFrameSkip, 0);
+			ImGui::SetItemTooltip("While in turbo, present every Nth emulated frame as well as every %d ms. 0 presents on the time alone.",
+				static_cast<int>(TurboPresentInterval / 1'000'000));
+			if (ImGui::Button("Save State"))
+				m_EmulationThread->PushInput({ EmulatorInput::Type::SaveState, 0, false, 0 });
+			ImGui::SetItemTooltip("F5");
+			ImGui::SameLine();
+			ImGui::BeginDisabled(!frame.HasSaveState);
+			if (ImGui::Button("Load State"))
+				m_EmulationThread->PushInput({ EmulatorInput::Type::LoadState, 0, false, 0 });
+			ImGui::SetItemTooltip("F9");
+			ImGui::EndDisabled();
+			if (frame.Rewinding)
+				ImGui::Text("Rewinding, %.1fs left", frame.RewindSeconds);
+			else
+				ImGui::Text("Rewind: %.1fs, hold Backspace", frame.RewindSeconds);
+			ImGui::Separator();
+			if (m_RomName.empty())
+				ImGui::TextUnformatted("Drop a ROM onto the window to load it");
+			else
+			{
+				ImGui::Text("%s (%016llx)%s", m_RomName.c_str(), static_cast<unsigned long long>(m_RomHash), m_RomInDatabase ? ", settings from the ROM database" : "");
+				if (ImGui::Button("Remember Settings"))
+				{
+					RomInfo info;
+					info.Mode = frame.Mode;
+					info.CyclesPerSecond = frame.CyclesPerSecond;
+					info.KeyMap = m_KeyMap;
+					m_RomInDatabase = m_RomDatabase->Store(m_RomHash, info) || m_RomInDatabase;
+				}
+				ImGui::SetItemTooltip("Run this ROM in the current mode and at the current rate whenever it's loaded");
+			}
 			ImGui::End();
+			if (frame.Profiling)
+				DrawProfiler(frame);
 
 			// Draw imgui
 			ImGui::Render();
@@ -202,10 +316,12 @@ void Shell::Run()
 			SDL_SetRenderDrawColor(m_Renderer, static_cast<Uint8>(clearColor.x * 255), static_cast<Uint8>(clearColor.y * 255),
 				static_cast<Uint8>(clearColor.z * 255), static_cast<Uint8>(clearColor.w * 255));
 			SDL_RenderClear(m_Renderer);
+			DrawDisplay();
 			ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), m_Renderer);
 			
 			// Finally, present the frame.
 			SDL_RenderPresent(m_Renderer);
+			m_LastPresentTime = SDL_GetTicksNS();
 		}
 		Shutdown();
 	} while (m_RequestingRestart);
@@ -216,7 +332,22 @@ void Shell::Shutdown()
 	if (!m_Initialised)
 		return;
 
+	// Stop the thread before the emulator it's running goes away
+	delete m_EmulationThread;
+	m_EmulationThread = nullptr;
 	delete m_Emulator;
+	m_Emulator = nullptr;
+	delete m_RomDatabase;
+	m_RomDatabase = nullptr;
+	m_RomName.clear();
+	m_KeyMap = 0;
+
+	if (m_DisplayTexture)
+	{
+		SDL_DestroyTexture(m_DisplayTexture);
+		m_DisplayTexture = nullptr;
+		m_DisplayTextureWidth = m_DisplayTextureHeight = 0;
+	}
 
 	ImGui_ImplSDLRenderer3_Shutdown();
 	ImGui_ImplSDL3_Shutdown();
@@ -232,3 +363,218 @@ void Shell::Shutdown()
 
 	m_Initialised = false;
 }
+
+void Shell::HandleKeypadKey(const int scancode, const bool pressed)
+{
+	// The COSMAC VIP's hex keypad, laid out on the left of a keyboard by position:
+	// 1 2 3 C    1 2 3 4
+	// 4 5 6 D    Q W E R
+	// 7 8 9 E    A S D F
+	// A 0 B F    Z X C V
+	static const std::unordered_map<int, uint8_t> keypad = {
+		{ SDL_SCANCODE_1, 0x1 }, { SDL_SCANCODE_2, 0x2 }, { SDL_SCANCODE_3, 0x3 }, { SDL_SCANCODE_4, 0xC },
+		{ SDL_SCANCODE_Q, 0x4 }, { SDL_SCANCODE_W, 0x5 }, { SDL_SCANCODE_E, 0x6 }, { SDL_SCANCODE_R, 0xD },
+		{ SDL_SCANCODE_A, 0x7 }, { SDL_SCANCODE_S, 0x8 }, { SDL_SCANCODE_D, 0x9 }, { SDL_SCANCODE_F, 0xE },
+		{ SDL_SCANCODE_Z, 0xA }, { SDL_SCANCODE_X, 0x0 }, { SDL_SCANCODE_C, 0xB }, { SDL_SCANCODE_V, 0xF }
+	};
+
+	const auto it = keypad.find(scancode);
+	if (it != keypad.end())
+		m_EmulationThread->PushInput({ EmulatorInput::Type::Key, MapRomKey(m_KeyMap, it->second), pressed, 0 });
+}
+
+void Shell::LoadRom(const std::string& path)
+{
+	const MappedFile file(path);
+	if (!file.IsOpen())
+	{
+		C8_ERROR("Failed to open file: {}", path);
+		return;
+	}
+
+	m_RomName = std::filesystem::path(path).filename().string();
+	m_RomHash = RomDatabase::HashRom(file.GetData(), file.GetSize());
+	RomInfo info;
+	m_RomInDatabase = m_RomDatabase->Find(m_RomHash, info);
+	// A ROM that isn't known keeps the mode and rate that were already picked
+	const EmulatorFrame& frame = m_EmulationThread->GetFrame();
+	const CompatibilityMode mode = m_RomInDatabase ? RomDatabase::GetModeForQuirks(info) : frame.Mode;
+	m_KeyMap = info.KeyMap;
+	if (m_RomInDatabase)
+		C8_INFO("Found {0} in the ROM database: {1} at {2} cycles per second", m_RomName, GetCompatibilityModeName(mode), info.CyclesPerSecond);
+
+	m_EmulationThread->LoadRom(std::vector<uint8_t>(file.GetData(), file.GetData() + file.GetSize()), mode, info.CyclesPerSecond);
+}
+
+void Shell::DrawProfiler(const EmulatorFrame& frame)
+{
+	const OpcodeProfile& profile = frame.Profile;
+	ImGui::Begin("Opcode Profiler");
+	ImGui::Text("%llu instructions, one in %u timed", static_cast<unsigned long long>(profile.InstructionCount), OpcodeProfiler::SampleInterval);
+	ImGui::SameLine();
+	if (ImGui::Button("Export CSV"))
+		ExportProfile(profile);
+
+	// Busiest first. Time is estimated from each class's mean sample over everything it executed.
+	uint32_t classes[NumOpcodeClasses];
+	uint32_t classCount = 0;
+	double totalNs = 0.0;
+	for (uint32_t i = 0; i < NumOpcodeClasses; i++)
+	{
+		if (profile.Classes[i].Count == 0)
+			continue;
+		classes[classCount++] = i;
+		totalNs += profile.GetMeanNs(static_cast<OpcodeClass>(i)) * static_cast<double>(profile.Classes[i].Count);
+	}
+	std::sort(classes, classes + classCount, [&profile](const uint32_t a, const uint32_t b) { return profile.Classes[a].Count > profile.Classes[b].Count; });
+
+	const double total = static_cast<double>(std::max<uint64_t>(profile.InstructionCount, 1));
+	if (ImGui::BeginTable("Classes", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+	{
+		ImGui::TableSetupColumn("Opcode");
+		ImGui::TableSetupColumn("Count");
+		ImGui::TableSetupColumn("Share");
+		ImGui::TableSetupColumn("Mean ns");
+		ImGui::TableSetupColumn("Time");
+		ImGui::TableHeadersRow();
+		for (uint32_t i = 0; i < classCount; i++)
+		{
+			const auto opcodeClass = static_cast<OpcodeClass>(classes[i]);
+			const OpcodeProfile::ClassStats& stats = profile.Classes[classes[i]];
+			const double meanNs = profile.GetMeanNs(opcodeClass);
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(GetOpcodeClassName(opcodeClass));
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", static_cast<unsigned long long>(stats.Count));
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f%%", static_cast<double>(stats.Count) / total * 100.0);
+			ImGui::TableNextColumn();
+			if (stats.Samples > 0)
+				ImGui::Text("%.1f", meanNs);
+			else
+				ImGui::TextUnformatted("-");
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f%%", totalNs > 0.0 ? meanNs * static_cast<double>(stats.Count) / totalNs * 100.0 : 0.0);
+		}
+		ImGui::EndTable();
+	}
+
+	ImGui::Separator();
+	if (ImGui::BeginTable("Hot Spots", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+	{
+		ImGui::TableSetupColumn("Address");
+		ImGui::TableSetupColumn("Count");
+		ImGui::TableSetupColumn("Share");
+		ImGui::TableHeadersRow();
+		for (uint32_t i = 0; i < profile.HotSpotCount; i++)
+		{
+			const OpcodeProfile::HotSpot& hotSpot = profile.HotSpots[i];
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("0x%03X", hotSpot.Address);
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", static_cast<unsigned long long>(hotSpot.Count));
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f%%", static_cast<double>(hotSpot.Count) / total * 100.0);
+		}
+		ImGui::EndTable();
+	}
+	ImGui::End();
+}
+
+void Shell::ExportProfile(const OpcodeProfile& profile) const
+{
+	const std::string run = m_RomName.empty() ? "opcodes" : m_RomName;
+	const std::string path = fmt::format("{0}{1}.profile.csv", m_PrefPath, run);
+	std::ofstream file(path, std::ios::trunc);
+	OpcodeProfile::WriteCsvHeader(file);
+	profile.WriteCsv(file, run);
+	if (!file)
+	{
+		C8_ERROR("Failed to write opcode profile: {0}", path);
+		return;
+	}
+	C8_INFO("Exported opcode profile to {0}", path);
+}
+
+void Shell::SetTurbo(const bool turbo)
+{
+	if (m_EmulationThread->PushInput({ EmulatorInput::Type::Turbo, 0, turbo, 0 }))
+		m_Turbo = turbo;
+}
+
+bool Shell::ShouldPresentTurboFrame(const EmulatorFrame& frame) const
+{
+	if (m_TurboFrameSkip > 0 && frame.Sequence - m_PresentedFrame >= static_cast<uint64_t>(m_TurboFrameSkip))
+		return true;
+	return SDL_GetTicksNS() - m_LastPresentTime >= TurboPresentInterval;
+}
+
+void Shell::UpdateDisplayTexture()
+{
+	const EmulatorFrame& frame = m_EmulationThread->GetFrame();
+	const DisplayFrame& display = frame.Display;
+	const uint16_t width = display.Width, height = display.Height;
+	if (width == 0 || height == 0)
+		return;
+
+	// Each frame only carries the rows that changed since the one before it, so if any were skipped, everything has to go up
+	bool uploadAll = frame.Sequence != m_PresentedFrame + 1;
+	m_PresentedFrame = frame.Sequence;
+
+	if (!m_DisplayTexture || m_DisplayTextureWidth != width || m_DisplayTextureHeight != height)
+	{
+		if (m_DisplayTexture)
+			SDL_DestroyTexture(m_DisplayTexture);
+		m_DisplayTexture = SDL_CreateTexture(m_Renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+		if (!m_DisplayTexture)
+		{
+			C8_ERROR("Failed to create display texture: {0}", SDL_GetError());
+			m_DisplayTextureWidth = m_DisplayTextureHeight = 0;
+			return;
+		}
+		SDL_SetTextureScaleMode(m_DisplayTexture, SDL_SCALEMODE_NEAREST);
+		m_DisplayTextureWidth = width;
+		m_DisplayTextureHeight = height;
+		m_DisplayPixels.resize(static_cast<size_t>(width) * height);
+		// The new texture starts out with nothing in it
+		uploadAll = true;
+	}
+
+	// Nothing drawn since last frame, nothing to upload
+	if (!uploadAll && !display.HasDirtyRows())
+		return;
+
+	// Upload each run of changed rows as its own rect
+	uint16_t row = 0;
+	while (row < height)
+	{
+		if (!uploadAll && !display.IsRowDirty(row))
+		{
+			row++;
+			continue;
+		}
+		const uint16_t firstRow = row;
+		while (row < height && (uploadAll || display.IsRowDirty(row)))
+			row++;
+
+		uint32_t* pixels = m_DisplayPixels.data() + static_cast<size_t>(firstRow) * width;
+		display.ResolveRows(pixels, DisplayFrame::DefaultPalette, firstRow, row - firstRow);
+		const SDL_Rect rect = { 0, firstRow, width, row - firstRow };
+		SDL_UpdateTexture(m_DisplayTexture, &rect, pixels, width * static_cast<int>(sizeof(uint32_t)));
+	}
+}
+
+void Shell::DrawDisplay()
+{
+	if (!m_DisplayTexture)
+		return;
+
+	int outputWidth = 0, outputHeight = 0;
+	SDL_GetCurrentRenderOutputSize(m_Renderer, &outputWidth, &outputHeight);
+	const float scale = std::min(static_cast<float>(outputWidth) / m_DisplayTextureWidth, static_cast<float>(outputHeight) / m_DisplayTextureHeight);
+	const float width = m_DisplayTextureWidth * scale, height = m_DisplayTextureHeight * scale;
+	const SDL_FRect destination = { (outputWidth - width) / 2, (outputHeight - height) / 2, width, height };
+	SDL_RenderTexture(m_Renderer, m_DisplayTexture, nullptr, &destination);
+}
@@ -0,0 +1,112 @@
+#include "c8pch.h"
+#include "Core/WorkStealingPool.h"
+
+// The pool and queue the current thread works for, so jobs submitted from inside a job stay on the same worker
+static thread_local WorkStealingPool* s_CurrentPool = nullptr;
+static thread_local uint32_t s_CurrentWorker = 0;
+
+WorkStealingPool::WorkStealingPool(uint32_t threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+	m_Queues.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; i++)
+		m_Queues.push_back(std::make_unique<WorkerQueue>());
+	m_Threads.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; i++)
+		m_Threads.emplace_back(&WorkStealingPool::WorkerMain, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	Wait();
+	{
+		std::lock_guard lock(m_StateMutex);
+		m_Stopping = true;
+	}
+	m_WorkAvailable.notify_all();
+	for (std::thread& thread : m_Threads)
+		thread.join();
+}
+
+void WorkStealingPool::Submit(Job job)
+{
+	const uint32_t index = s_CurrentPool == this
+		? s_CurrentWorker
+		: m_NextQueue.fetch_add(1, std::memory_order_relaxed) % static_cast<uint32_t>(m_Queues.size());
+
+	m_Unfinished.fetch_add(1, std::memory_order_relaxed);
+	{
+		std::lock_guard lock(m_Queues[index]->Mutex);
+		m_Queues[index]->Jobs.push_back(std::move(job));
+	}
+	{
+		// Under the lock, so a worker can't check for work and go to sleep in between
+		std::lock_guard lock(m_StateMutex);
+		m_Queued.fetch_add(1, std::memory_order_relaxed);
+	}
+	m_WorkAvailable.notify_one();
+}
+
+void WorkStealingPool::Wait()
+{
+	std::unique_lock lock(m_StateMutex);
+	m_AllFinished.wait(lock, [this] { return m_Unfinished.load(std::memory_order_acquire) == 0; });
+}
+
+void WorkStealingPool::WorkerMain(const uint32_t index)
+{
+	s_CurrentPool = this;
+	s_CurrentWorker = index;
+
+	Job job;
+	while (true)
+	{
+		if (TryPop(index, job) || TrySteal(index, job))
+		{
+			m_Queued.fetch_sub(1, std::memory_order_relaxed);
+			job();
+			job = nullptr;
+			if (m_Unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				std::lock_guard lock(m_StateMutex);
+				m_AllFinished.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock lock(m_StateMutex);
+		m_WorkAvailable.wait(lock, [this] { return m_Stopping || m_Queued.load(std::memory_order_relaxed) > 0; });
+		if (m_Stopping && m_Queued.load(std::memory_order_relaxed) == 0)
+			return;
+	}
+}
+
+bool WorkStealingPool::TryPop(const uint32_t index, Job& job)
+{
+	WorkerQueue& queue = *m_Queues[index];
+	std::lock_guard lock(queue.Mutex);
+	if (queue.Jobs.empty())
+		return false;
+	job = std::move(queue.Jobs.back());
+	queue.Jobs.pop_back();
+	return true;
+}
+
+bool WorkStealingPool::TrySteal(const uint32_t thief, Job& job)
+{
+	// Start with the next worker along rather than always the first, so thieves spread out over the victims
+	const uint32_t count = static_cast<uint32_t>(m_Queues.size());
+	for (uint32_t offset = 1; offset < count; offset++)
+	{
+		WorkerQueue& queue = *m_Queues[(thief + offset) % count];
+		std::unique_lock lock(queue.Mutex, std::try_to_lock);
+		if (!lock.owns_lock() || queue.Jobs.empty())
+			continue;
+		job = std::move(queue.Jobs.front());
+		queue.Jobs.pop_front();
+		return true;
+	}
+	return false;
+}
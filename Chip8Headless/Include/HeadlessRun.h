@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Core/Emulator.h"
+#include "Core/OpcodeProfiler.h"
+
+// How to run a ROM with no window: the emulator's settings, and when to stop
+struct HeadlessOptions
+{
+	CompatibilityMode Mode = CompatibilityMode::Chip8;
+	ExecutionBackend Backend = ExecutionBackend::Interpreter;
+	int CyclesPerSecond = 700;
+	uint32_t RandomSeed = 0xC8C8C8C8;
+	bool RandomInput = false; // Press random keys for random stretches of time, driven by RandomSeed
+	bool Profile = false;     // Count and time the opcodes executed, see OpcodeProfiler. Runs on the interpreter whatever Backend is.
+	// Stops after whichever comes first, or when the program stops itself
+	uint64_t MaxInstructions = UINT64_MAX;
+	uint64_t MaxFrames = UINT64_MAX;
+};
+
+// The state a ROM finished in, for comparing runs against each other
+struct HeadlessResult
+{
+	std::string RomPath;
+	HeadlessOptions Options;
+	bool Loaded = false;
+	bool Running = false;
+	EmulatorFault Fault = EmulatorFault::None;
+	uint16_t FaultAddress = 0;
+	uint64_t Instructions = 0;
+	uint64_t Frames = 0;
+
+	uint16_t DisplayWidth = 0, DisplayHeight = 0;
+	uint8_t DisplayPlanes = 0;
+	bool HiRes = false;
+	uint64_t DisplayHash = 0; // FNV-1a of every plane of the packed display
+
+	uint16_t ProgramCounter = 0, IRegister = 0;
+	uint8_t VRegisters[16] = { 0 };
+	uint8_t DelayTimer = 0, SoundTimer = 0, StackPointer = 0;
+
+	uint32_t MemorySize = 0;
+	uint32_t MemoryCrc = 0; // CRC-32 of the whole of memory
+
+	OpcodeProfile Profile; // If Options.Profile
+};
+
+// Loads rom (read from romPath) and runs it in emulated time, as fast as the host allows: frames of CyclesPerSecond / 60
+// instructions, with the timers ticking once per frame. Everything it uses is its own, so any number can run at once.
+[[nodiscard]] HeadlessResult RunHeadless(const std::string& romPath, const std::vector<uint8_t>& rom, const HeadlessOptions& options);
+
+// Writes result as a JSON object. 64 bit values are written as hex strings, as JSON numbers can't hold all of them.
+void WriteResultJson(std::ostream& out, const HeadlessResult& result);
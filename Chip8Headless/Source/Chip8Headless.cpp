@@ -0,0 +1,309 @@
+#include "c8pch.h"
+
+#include <climits>
+#include <filesystem>
+#include <fstream>
+
+#include "HeadlessRun.h"
+#include "Core/MappedFile.h"
+#include "Core/RomDatabase.h"
+#include "Core/WorkStealingPool.h"
+
+static constexpr const char* Usage =
+	"Usage: chip8-headless [options] <rom or directory of roms>...\n"
+	"  --mode <chip8|chip8e|chip48|superchip|xochip10|xochip11>  Compatibility mode, chip8 by default\n"
+	"  --backend <interpreter|jit|aot>  Execution backend, interpreter by default\n"
+	"  --cycles <n>  Stop after n instructions\n"
+	"  --frames <n>  Stop after n frames (1/60s of emulated time each); 600 by default if --cycles isn't given\n"
+	"  --cps <n>     Instructions per second of emulated time, 700 by default\n"
+	"  --seed <n>    Random seed for CXNN and --random-input\n"
+	"  --seeds <n>   Run every ROM n times, with seeds counting up from --seed\n"
+	"  --random-input  Press random keys, driven by the seed\n"
+	"  --jobs <n>    Worker threads, one per hardware thread by default\n"
+	"  --output <file>  Where to write the results, stdout by default\n"
+	"  --rom-db <file>  Run ROMs found in this ROM database in its mode and at its rate, unless --mode or --cps say otherwise\n"
+	"  --remember    Store --mode and --cps in the --rom-db for every ROM given, then run them as usual\n"
+	"  --profile <file>  Profile the opcodes each run executes, on the interpreter, and write them to this CSV file\n"
+	"  --help, -h    Show this message";
+
+struct RomFile
+{
+	std::string Path;
+	std::vector<uint8_t> Bytes;
+	bool Read = false;
+	HeadlessOptions Options; // With anything from the ROM database applied
+};
+
+static bool ParseNumber(const char* text, uint64_t& value)
+{
+	try
+	{
+		size_t end = 0;
+		value = std::stoull(text, &end, 0);
+		return text[end] == '\0';
+	}
+	catch (const std::exception&)
+	{
+		return false;
+	}
+}
+
+static RomFile ReadRom(const std::string& path)
+{
+	RomFile rom;
+	rom.Path = path;
+	const MappedFile file(path);
+	if (!file.IsOpen())
+	{
+		C8_ERROR("Failed to open file: {}", path);
+		return rom;
+	}
+	rom.Bytes.assign(file.GetData(), file.GetData() + file.GetSize());
+	rom.Read = true;
+	return rom;
+}
+
+// Directories are expanded to the files directly inside them, in name order so the output is always in the same order
+static void AddRomPaths(const std::string& path, std::vector<std::string>& paths)
+{
+	std::error_code error;
+	if (!std::filesystem::is_directory(path, error))
+	{
+		paths.push_back(path);
+		return;
+	}
+
+	std::vector<std::string> files;
+	for (const auto& entry : std::filesystem::directory_iterator(path, error))
+	{
+		if (entry.is_regular_file(error))
+			files.push_back(entry.path().string());
+	}
+	std::sort(files.begin(), files.end());
+	paths.insert(paths.end(), files.begin(), files.end());
+}
+
+// chip8-headless: runs ROMs with no window, audio or input, and writes the state each one finished in as a JSON array.
+// Runs are deterministic, so the output can be diffed against a known good run to catch regressions.
+// Every run gets its own emulator, and they're spread over a work-stealing pool with a thread per core, so a directory of
+// ROMs, or one ROM with many seeds, uses the whole machine. Results are always written in the same order.
+static int Run(int argc, char* argv[])
+{
+	static const std::unordered_map<std::string, CompatibilityMode> modes = {
+		{ "chip8", CompatibilityMode::Chip8 },
+		{ "chip8e", CompatibilityMode::Chip8E },
+		{ "chip48", CompatibilityMode::Chip48 },
+		{ "superchip", CompatibilityMode::SuperChip },
+		{ "xochip10", CompatibilityMode::XOChip10 },
+		{ "xochip11", CompatibilityMode::XOChip11 }
+	};
+	static const std::unordered_map<std::string, ExecutionBackend> backends = {
+		{ "interpreter", ExecutionBackend::Interpreter },
+		{ "jit", ExecutionBackend::Jit },
+		{ "aot", ExecutionBackend::Aot }
+	};
+
+	HeadlessOptions options;
+	std::vector<std::string> romPaths;
+	std::string outputPath, romDatabasePath, profilePath;
+	bool limited = false, modeGiven = false, cyclesPerSecondGiven = false, remember = false;
+	uint64_t seedCount = 1;
+	uint32_t threadCount = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--help" || arg == "-h")
+		{
+			std::cout << Usage << "\n";
+			return 0;
+		}
+		if (arg.rfind("--", 0) != 0)
+		{
+			AddRomPaths(arg, romPaths);
+			continue;
+		}
+		if (arg == "--random-input")
+		{
+			options.RandomInput = true;
+			continue;
+		}
+		if (arg == "--remember")
+		{
+			remember = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			C8_ERROR("Missing value for {0}\n{1}", arg, Usage);
+			return 1;
+		}
+
+		const char* value = argv[++i];
+		uint64_t number = 0;
+		if (arg == "--mode" && modes.count(value))
+		{
+			options.Mode = modes.at(value);
+			modeGiven = true;
+		}
+		else if (arg == "--backend" && backends.count(value))
+			options.Backend = backends.at(value);
+		else if (arg == "--cycles" && ParseNumber(value, number))
+		{
+			options.MaxInstructions = number;
+			limited = true;
+		}
+		else if (arg == "--frames" && ParseNumber(value, number))
+		{
+			options.MaxFrames = number;
+			limited = true;
+		}
+		else if (arg == "--cps" && ParseNumber(value, number) && number > 0 && number <= INT_MAX)
+		{
+			options.CyclesPerSecond = static_cast<int>(number);
+			cyclesPerSecondGiven = true;
+		}
+		else if (arg == "--seed" && ParseNumber(value, number) && number <= UINT32_MAX)
+			options.RandomSeed = static_cast<uint32_t>(number);
+		else if (arg == "--seeds" && ParseNumber(value, number) && number > 0 && number <= UINT32_MAX)
+			seedCount = number;
+		else if (arg == "--jobs" && ParseNumber(value, number) && number <= 4096)
+			threadCount = static_cast<uint32_t>(number);
+		else if (arg == "--output")
+			outputPath = value;
+		else if (arg == "--rom-db")
+			romDatabasePath = value;
+		else if (arg == "--profile")
+		{
+			profilePath = value;
+			options.Profile = true;
+		}
+		else
+		{
+			C8_ERROR("Invalid option: {0} {1}\n{2}", arg, value, Usage);
+			return 1;
+		}
+	}
+
+	if (romPaths.empty())
+	{
+		C8_ERROR(Usage);
+		return 1;
+	}
+	if (remember && romDatabasePath.empty())
+	{
+		C8_ERROR("--remember needs a --rom-db to store into\n{0}", Usage);
+		return 1;
+	}
+	if (!limited)
+		options.MaxFrames = 600;
+
+	std::ofstream outputFile;
+	if (!outputPath.empty())
+	{
+		outputFile.open(outputPath, std::ios::binary);
+		if (!outputFile.is_open())
+		{
+			C8_ERROR("Failed to open output file: {}", outputPath);
+			return 1;
+		}
+	}
+	std::ostream& output = outputPath.empty() ? std::cout : outputFile;
+	std::ofstream profileFile;
+	if (!profilePath.empty())
+	{
+		profileFile.open(profilePath, std::ios::binary);
+		if (!profileFile.is_open())
+		{
+			C8_ERROR("Failed to open profile file: {}", profilePath);
+			return 1;
+		}
+	}
+
+	std::vector<RomFile> roms;
+	roms.reserve(romPaths.size());
+	for (const std::string& path : romPaths)
+		roms.push_back(ReadRom(path));
+
+	RomDatabase romDatabase;
+	if (!romDatabasePath.empty())
+		romDatabase.Open(romDatabasePath);
+	for (RomFile& rom : roms)
+	{
+		rom.Options = options;
+		if (!rom.Read || romDatabasePath.empty())
+			continue;
+
+		const uint64_t hash = RomDatabase::HashRom(rom.Bytes.data(), rom.Bytes.size());
+		RomInfo info;
+		if (remember)
+		{
+			info.Mode = options.Mode;
+			info.CyclesPerSecond = cyclesPerSecondGiven ? options.CyclesPerSecond : 0;
+			if (!romDatabase.Store(hash, info))
+				return 1;
+		}
+		else if (romDatabase.Find(hash, info))
+		{
+			if (!modeGiven)
+				rom.Options.Mode = RomDatabase::GetModeForQuirks(info);
+			if (!cyclesPerSecondGiven && info.CyclesPerSecond > 0)
+				rom.Options.CyclesPerSecond = info.CyclesPerSecond;
+		}
+	}
+
+	// One job per run, each writing only its own result
+	std::vector<HeadlessResult> results(roms.size() * seedCount);
+	{
+		WorkStealingPool pool(threadCount);
+		for (size_t rom = 0; rom < roms.size(); rom++)
+		{
+			for (uint64_t seed = 0; seed < seedCount; seed++)
+			{
+				HeadlessOptions runOptions = roms[rom].Options;
+				runOptions.RandomSeed = static_cast<uint32_t>(options.RandomSeed + seed);
+				HeadlessResult& result = results[rom * seedCount + seed];
+				if (!roms[rom].Read)
+				{
+					result.RomPath = roms[rom].Path;
+					result.Options = runOptions;
+					continue;
+				}
+				pool.Submit([&result, &file = roms[rom], runOptions] { result = RunHeadless(file.Path, file.Bytes, runOptions); });
+			}
+		}
+		pool.Wait();
+	}
+
+	bool allLoaded = true;
+	output << "[";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		allLoaded &= results[i].Loaded;
+		output << (i > 0 ? ",\n" : "\n");
+		WriteResultJson(output, results[i]);
+	}
+	output << "\n]\n";
+
+	if (profileFile.is_open())
+	{
+		OpcodeProfile::WriteCsvHeader(profileFile);
+		for (const HeadlessResult& result : results)
+		{
+			if (result.Loaded)
+				result.Profile.WriteCsv(profileFile, fmt::format("{0} seed {1}", result.RomPath, result.Options.RandomSeed));
+		}
+	}
+
+	return allLoaded ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+	InitLog(nullptr, LogTarget::Stderr);
+	// Only what went wrong, e.g. why a ROM stopped; the results say everything else
+	s_Chip8EmulatorLogger->set_level(spdlog::level::warn);
+
+	const int result = Run(argc, argv);
+	ShutdownLog();
+	return result;
+}
@@ -0,0 +1,201 @@
+#include "c8pch.h"
+#include "HeadlessRun.h"
+
+#include <array>
+
+#include "Core/CycleScheduler.h"
+
+static uint64_t HashDisplay(const uint64_t* words, const size_t count)
+{
+	// FNV-1a, a byte at a time from the least significant, so the hash doesn't depend on the host's byte order
+	uint64_t hash = 0xCBF29CE484222325;
+	for (size_t i = 0; i < count; i++)
+	{
+		for (int byte = 0; byte < 8; byte++)
+		{
+			hash ^= words[i] >> (byte * 8) & 0xFF;
+			hash *= 0x100000001B3;
+		}
+	}
+	return hash;
+}
+
+static uint32_t Crc32(const uint8_t* data, const size_t size)
+{
+	static const auto table = []
+	{
+		std::array<uint32_t, 256> entries {};
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t crc = i;
+			for (int bit = 0; bit < 8; bit++)
+				crc = crc & 1 ? crc >> 1 ^ 0xEDB88320 : crc >> 1;
+			entries[i] = crc;
+		}
+		return entries;
+	}();
+
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ crc >> 8;
+	return ~crc;
+}
+
+static std::string EscapeJson(const std::string& text)
+{
+	std::string escaped;
+	escaped.reserve(text.size());
+	for (const char c : text)
+	{
+		switch (c)
+		{
+		case '"':
+			escaped += "\\\"";
+			break;
+		case '\\':
+			escaped += "\\\\";
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+				escaped += fmt::format("\\u{:04x}", static_cast<int>(c));
+			else
+				escaped += c;
+			break;
+		}
+	}
+	return escaped;
+}
+
+// Holds down a random key, or nothing, for a random number of frames at a time
+class RandomKeypad
+{
+public:
+	explicit RandomKeypad(const uint32_t seed)
+		: m_State(seed ^ 0x9E3779B9) // So input doesn't follow the same sequence as CXNN with the same seed
+	{
+		if (m_State == 0)
+			m_State = 1;
+	}
+
+	void Update(Emulator& emulator)
+	{
+		if (m_FramesLeft > 0)
+		{
+			m_FramesLeft--;
+			return;
+		}
+
+		if (m_HeldKey != NoKey)
+			emulator.SetKeyState(m_HeldKey, false);
+
+		// xorshift32
+		m_State ^= m_State << 13;
+		m_State ^= m_State >> 17;
+		m_State ^= m_State << 5;
+		m_HeldKey = m_State & 1 ? static_cast<uint8_t>(m_State >> 4 & 0xF) : NoKey;
+		m_FramesLeft = m_State >> 8 & 0xF;
+		if (m_HeldKey != NoKey)
+			emulator.SetKeyState(m_HeldKey, true);
+	}
+
+private:
+	static constexpr uint8_t NoKey = 0xFF;
+
+	uint32_t m_State;
+	uint8_t m_HeldKey = NoKey;
+	uint32_t m_FramesLeft = 0;
+};
+
+HeadlessResult RunHeadless(const std::string& romPath, const std::vector<uint8_t>& rom, const HeadlessOptions& options)
+{
+	HeadlessResult result;
+	result.RomPath = romPath;
+	result.Options = options;
+
+	Emulator emulator;
+	emulator.SetDebugLogs(false);
+	emulator.SetExecutionBackend(options.Backend);
+	emulator.SetCyclesPerSecond(options.CyclesPerSecond);
+	emulator.SetRandomSeed(options.RandomSeed);
+	emulator.LoadRom(options.Mode, rom);
+	std::unique_ptr<OpcodeProfiler> profiler;
+	if (options.Profile)
+	{
+		profiler = std::make_unique<OpcodeProfiler>();
+		emulator.SetProfiler(profiler.get());
+	}
+	// A ROM that couldn't be loaded never starts running
+	result.Loaded = emulator.IsRunning();
+	if (!result.Loaded)
+		return result;
+
+	// Only AdvanceTick is used, so the scheduler's clock never comes into it and runs are reproducible
+	CycleScheduler scheduler;
+	RandomKeypad keypad(options.RandomSeed);
+	while (emulator.IsRunning() && result.Frames < options.MaxFrames && result.Instructions < options.MaxInstructions)
+	{
+		if (options.RandomInput)
+			keypad.Update(emulator);
+		scheduler.AdvanceTick(options.CyclesPerSecond);
+		const uint64_t credit = scheduler.GetCycleCredit();
+		if (credit > 0)
+		{
+			const uint64_t ran = emulator.Step(std::min(credit, options.MaxInstructions - result.Instructions));
+			scheduler.ConsumeCycles(ran);
+			result.Instructions += ran;
+		}
+		emulator.TickTimers();
+		result.Frames++;
+	}
+
+	if (profiler)
+	{
+		profiler->TakeSnapshot(result.Profile);
+		emulator.SetProfiler(nullptr);
+	}
+
+	result.Running = emulator.IsRunning();
+	result.Fault = emulator.GetFault();
+	result.FaultAddress = emulator.GetFaultAddress();
+
+	result.DisplayWidth = emulator.GetDisplayWidth();
+	result.DisplayHeight = emulator.GetDisplayHeight();
+	result.DisplayPlanes = emulator.GetDisplayPlanes();
+	result.HiRes = emulator.IsHiRes();
+	result.DisplayHash = HashDisplay(emulator.GetDisplayData(),
+		static_cast<size_t>(emulator.GetDisplayPlanes()) * emulator.GetDisplayHeight() * emulator.GetDisplayRowWords());
+
+	result.ProgramCounter = emulator.GetProgramCounter();
+	result.IRegister = emulator.GetIRegister();
+	for (uint8_t i = 0; i < 16; i++)
+		result.VRegisters[i] = emulator.GetVRegister(i);
+	result.DelayTimer = emulator.GetDelayTimer();
+	result.SoundTimer = emulator.GetSoundTimer();
+	result.StackPointer = emulator.GetStackPointer();
+
+	result.MemorySize = emulator.GetMemorySize();
+	result.MemoryCrc = Crc32(emulator.GetMemory(), emulator.GetMemorySize());
+	return result;
+}
+
+void WriteResultJson(std::ostream& out, const HeadlessResult& result)
+{
+	out << fmt::format("{{\"rom\":\"{}\",\"mode\":\"{}\",\"backend\":\"{}\",\"seed\":{},\"randomInput\":{},\"loaded\":{}",
+		EscapeJson(result.RomPath), GetCompatibilityModeName(result.Options.Mode), GetExecutionBackendName(result.Options.Backend),
+		result.Options.RandomSeed, result.Options.RandomInput, result.Loaded);
+	if (!result.Loaded)
+	{
+		out << "}";
+		return;
+	}
+
+	out << fmt::format(",\"running\":{},\"fault\":\"{}\",\"faultAddress\":{},\"instructions\":{},\"frames\":{}",
+		result.Running, GetEmulatorFaultName(result.Fault), result.FaultAddress, result.Instructions, result.Frames);
+	out << fmt::format(",\"display\":{{\"width\":{},\"height\":{},\"planes\":{},\"hiRes\":{},\"hash\":\"{:016x}\"}}",
+		result.DisplayWidth, result.DisplayHeight, result.DisplayPlanes, result.HiRes, result.DisplayHash);
+	out << fmt::format(",\"registers\":{{\"pc\":{},\"i\":{},\"v\":[", result.ProgramCounter, result.IRegister);
+	for (uint8_t i = 0; i < 16; i++)
+		out << (i > 0 ? "," : "") << static_cast<int>(result.VRegisters[i]);
+	out << fmt::format("],\"delayTimer\":{},\"soundTimer\":{},\"stackPointer\":{}}}", result.DelayTimer, result.SoundTimer, result.StackPointer);
+	out << fmt::format(",\"memory\":{{\"size\":{},\"crc32\":\"{:08x}\"}}}}", result.MemorySize, result.MemoryCrc);
+}
@@ -1,6 +1,11 @@
 workspace "Chip8Emulator"
 	configurations { "Debug", "Release", "Dist" }
-	platforms { "Win64" }
+	-- The shell only builds on Windows for now; on Linux, build the command line tools, e.g. make Chip8Bench
+	if os.istarget("linux") then
+		platforms { "Linux64" }
+	else
+		platforms { "Win64" }
+	end
 	startproject "Chip8Emulator"
 
 outputdir = "%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}"
@@ -11,6 +16,88 @@ IncludeDir["PPK_ASSERT"] = "Chip8Emulator/Vendor/PPK_ASSERT/Include"
 IncludeDir["SDL"] = "Chip8Emulator/Vendor/SDL/include"
 IncludeDir["imgui"] = "Chip8Emulator/Vendor/imgui/"
 
+-- The emulator core without the SDL/imgui shell, for the command line tools to build from
+CoreFiles = {
+	"Chip8Emulator/Include/Core/**.h", "Chip8Emulator/Include/c8pch.h",
+	"Chip8Emulator/Source/Core/**.cpp", "Chip8Emulator/Source/c8pch.cpp",
+
+	"Chip8Emulator/Vendor/PPK_ASSERT/Source/*.cpp"
+}
+CoreShellFiles = { "Chip8Emulator/Include/Core/Shell.h", "Chip8Emulator/Source/Core/Shell.cpp" }
+
+newoption {
+	trigger = "avx2",
+	description = "Build for CPUs with AVX2, which the display code uses when it can"
+}
+
+newoption {
+	trigger = "log-level",
+	value = "LEVEL",
+	description = "Compile out log messages below this level (see Chip8EmulatorLog.h)",
+	allowed = {
+		{ "trace", "Everything" },
+		{ "info", "Info and up" },
+		{ "warn", "Warnings and up" },
+		{ "error", "Errors and up" },
+		{ "critical", "Critical errors only" },
+		{ "off", "No logging at all" }
+	}
+}
+
+newoption {
+	trigger = "hot-trace",
+	description = "Trace every instruction the interpreter executes. Very slow; for debugging only."
+}
+
+-- Configuration and platform settings shared by every project in this file
+function CommonSettings()
+	cppdialect "C++17"
+
+	filter "configurations:Debug"
+		defines { "C8_DEBUG", "C8_ENABLE_ASSERTS" }
+		symbols "On"
+		runtime "Debug"
+
+	filter "configurations:Release"
+		defines { "C8_RELEASE", "C8_ENABLE_ASSERTS" }
+		optimize "On"
+		symbols "On"
+		runtime "Release"
+
+	filter "configurations:Dist"
+		defines { "C8_DIST" }
+		optimize "On"
+		symbols "Off"
+		runtime "Release"
+
+	filter "system:windows"
+		systemversion "latest"
+		defines { "C8_PLATFORM_WINDOWS" }
+
+	filter "system:linux"
+		links { "pthread" }
+
+	filter "platforms:Win64"
+		system "Windows"
+		architecture "x64"
+
+	filter "platforms:Linux64"
+		system "Linux"
+		architecture "x64"
+
+	filter "options:avx2"
+		vectorextensions "AVX2"
+
+	filter "options:hot-trace"
+		defines { "C8_ENABLE_HOT_TRACE" }
+
+	filter {}
+
+	if _OPTIONS["log-level"] then
+		defines { "C8_LOG_LEVEL=C8_LOG_LEVEL_" .. _OPTIONS["log-level"]:upper() }
+	end
+end
+
 include "Chip8Emulator/Vendor/imgui.lua"
 
 project "Chip8Emulator"
@@ -64,29 +151,12 @@ project "Chip8Emulator"
 os.mkdir("Chip8Emulator/Source")
 os.mkdir("Chip8Emulator/Include")
 
-filter "configurations:Debug"
-	defines { "C8_DEBUG", "C8_ENABLE_ASSERTS" }
-	symbols "On"
-	runtime "Debug"
-
-filter "configurations:Release"
-	defines { "C8_RELEASE", "C8_ENABLE_ASSERTS" }
-	optimize "On"
-	symbols "On"
-	runtime "Release"
+CommonSettings()
 
 filter "configurations:Dist"
-	defines { "C8_DIST" }
 	kind "WindowedApp"
-	optimize "On"
-	symbols "Off"
-	runtime "Release"
 
 filter "system:windows"
-	cppdialect "C++17"
-	systemversion "latest"
-	defines { "C8_PLATFORM_WINDOWS" }
-
 	links
 	{
 		"version",
@@ -96,6 +166,100 @@ filter "system:windows"
 		"Setupapi"
 	}
 
-filter "platforms:Win64"
-	system "Windows"
-	architecture "x64"
+filter {}
+
+-- Statically recompiles a ROM into a C++ translation unit, see Chip8AOT/Source/Chip8AOT.cpp
+project "Chip8AOT"
+	kind "ConsoleApp"
+	targetname "chip8-aot"
+	staticruntime "On"
+	language "C++"
+	location "Chip8AOT"
+	targetdir ("Build/%{prj.name}/" .. outputdir)
+	objdir ("Build/%{prj.name}/Intermediates/" .. outputdir)
+
+	pchheader "c8pch.h"
+	pchsource "Chip8Emulator/Source/c8pch.cpp"
+
+	files { CoreFiles, "Chip8AOT/Include/**.h", "Chip8AOT/Source/**.cpp" }
+	removefiles { CoreShellFiles }
+
+	includedirs 
+	{ 
+		"%{IncludeDir.spdlog}",
+		"%{IncludeDir.PPK_ASSERT}",
+		"%{IncludeDir.SDL}",
+
+		"Chip8Emulator/Include",
+		"Chip8AOT/Include"
+	}
+
+	defines {
+		"_CRT_SECURE_NO_WARNINGS"
+	}
+
+	CommonSettings()
+
+-- Runs ROMs without a window and writes the state they finished in as JSON, see Chip8Headless/Source/Chip8Headless.cpp
+project "Chip8Headless"
+	kind "ConsoleApp"
+	targetname "chip8-headless"
+	staticruntime "On"
+	language "C++"
+	location "Chip8Headless"
+	targetdir ("Build/%{prj.name}/" .. outputdir)
+	objdir ("Build/%{prj.name}/Intermediates/" .. outputdir)
+
+	pchheader "c8pch.h"
+	pchsource "Chip8Emulator/Source/c8pch.cpp"
+
+	files { CoreFiles, "Chip8Headless/Include/**.h", "Chip8Headless/Source/**.cpp" }
+	removefiles { CoreShellFiles }
+
+	includedirs 
+	{ 
+		"%{IncludeDir.spdlog}",
+		"%{IncludeDir.PPK_ASSERT}",
+		"%{IncludeDir.SDL}",
+
+		"Chip8Emulator/Include",
+		"Chip8Headless/Include"
+	}
+
+	defines {
+		"_CRT_SECURE_NO_WARNINGS"
+	}
+
+	CommonSettings()
+
+-- Times the emulator core's subsystems on their own and writes the results as JSON, see Chip8Bench/Source/Chip8Bench.cpp
+project "Chip8Bench"
+	kind "ConsoleApp"
+	targetname "chip8-bench"
+	staticruntime "On"
+	language "C++"
+	location "Chip8Bench"
+	targetdir ("Build/%{prj.name}/" .. outputdir)
+	objdir ("Build/%{prj.name}/Intermediates/" .. outputdir)
+
+	pchheader "c8pch.h"
+	pchsource "Chip8Emulator/Source/c8pch.cpp"
+
+	files { CoreFiles, "Chip8Bench/Include/**.h", "Chip8Bench/Source/**.cpp" }
+	removefiles { CoreShellFiles }
+
+	includedirs 
+	{ 
+		"%{IncludeDir.spdlog}",
+		"%{IncludeDir.PPK_ASSERT}",
+		"%{IncludeDir.SDL}",
+
+		"Chip8Emulator/Include",
+		"Chip8Bench/Include"
+	}
+
+	defines {
+		"_CRT_SECURE_NO_WARNINGS"
+	}
+
+	CommonSettings()